@@ -0,0 +1,322 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module is the interface of libz80sim in z80sim.h, for
+ *	programs which embed the Z80 in their own simulation instead
+ *	of running z80sim and talking to it over the sockets.
+ *	The library has all modules of z80sim without main.c, it
+ *	doesn't install signal handlers and without Z80_BOARD it
+ *	opens no sockets. z80_run() runs for a number of T-states
+ *	with the timed variant of the CPU emulation, the program
+ *	does its devices between the runs and in the callbacks.
+ *
+ *	Ports go to the in and out callbacks first, then to the
+ *	devices of io.c. Writes into memory with hook are found
+ *	before the instruction by memwr.c, the write callback is
+ *	called after it. Snapshots are core file images, see core.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "global.h"
+#include "z80sim.h"
+
+#ifndef WANT_TIM
+#error "libz80sim needs WANT_TIM in config.h for z80_run()"
+#endif
+
+extern void cpu(void);
+extern void init_io(void), exit_io(void);
+extern void io_hook(int (*)(BYTE), int (*)(BYTE, BYTE));
+extern int load_file(char *);
+extern size_t core_image(BYTE *);
+extern int core_restore(BYTE *, size_t, char *);
+
+struct z80sim {
+	int z_flags;			/* flags of z80_create() */
+	z80_in_fn z_in;			/* port callbacks */
+	z80_out_fn z_out;
+	void *z_ioctx;
+	z80_write_fn z_wr;		/* write callback */
+	void *z_wrctx;
+};
+
+static struct z80sim z_sim;
+static int z_used;			/* z_sim is created */
+
+/*
+ *	Hooks of io.c and memwr.c, calling the callbacks
+ */
+static int z_in(BYTE port)
+{
+	register int r;
+
+	if (z_sim.z_in != NULL && (r = (*z_sim.z_in)(z_sim.z_ioctx, port)) >= 0)
+		return(r & 0xff);
+	return((z_sim.z_flags & Z80_BOARD) ? -1 : 0xff);
+}
+
+static int z_out(BYTE port, BYTE data)
+{
+	if (z_sim.z_out != NULL && (*z_sim.z_out)(z_sim.z_ioctx, port, data) >= 0)
+		return(0);
+	return((z_sim.z_flags & Z80_BOARD) ? -1 : 0);
+}
+
+static void z_wr(WORD adr, BYTE data)
+{
+	if (z_sim.z_wr != NULL)
+		(*z_sim.z_wr)(z_sim.z_wrctx, adr, data);
+}
+
+/*
+ *	Run the CPU with state s until it stops
+ *
+ *	Output: CPU error
+ */
+static int z_cpu(int s)
+{
+	cpu_state = s;
+	cpu_error = NONE;
+	cpu();
+	return(cpu_error);
+}
+
+/*
+ *	Create the Z80, reset and with all memory RAM filled with 0
+ *
+ *	Output: the Z80, NULL if there is one already
+ */
+z80sim *z80_create(int flags)
+{
+	if (z_used)
+		return(NULL);
+	z_used = 1;
+	memset(&z_sim, 0, sizeof(z_sim));
+	z_sim.z_flags = flags;
+	memset(ram, 0, 65536);
+	mem_map(0, 65536L, 0, 0);
+	mem_hook(z_wr);
+	io_hook(z_in, z_out);
+	f_flag = 0;				/* no CPU speed */
+	tc_flag = 1;				/* timed variant */
+	cpu_steps = cpu_tstates = 0;
+	z80_reset(&z_sim);
+	if (flags & Z80_BOARD)
+		init_io();
+	return(&z_sim);
+}
+
+void z80_destroy(z80sim *m)
+{
+	if (m->z_flags & Z80_BOARD)
+		exit_io();
+	io_hook(NULL, NULL);
+	mem_hook(NULL);
+	mem_map(0, 65536L, 0, 0);
+	z_used = 0;
+}
+
+/*
+ *	Reset of the CPU, memory and counters stay
+ */
+void z80_reset(z80sim *m)
+{
+	wrk_ram = PC = ram;
+	STACK = ram + 0xffff;
+	A = 0xff;
+	F = 0xff;
+	I = IFF = 0;
+	R = 0L;
+	int_mode = 0;
+	int_type = INT_NONE;
+	cpu_halt = 0;
+}
+
+unsigned char *z80_memory(z80sim *m)
+{
+	return(ram);
+}
+
+/*
+ *	Set len bytes from address adr to a kind of memory
+ *
+ *	Output: 0 ok, -1 unknown kind
+ */
+int z80_map(z80sim *m, unsigned short adr, unsigned long len, int kind)
+{
+	if (kind & ~(Z80_ROM | Z80_HOOK))
+		return(-1);
+	if (len > 65536)
+		len = 65536;
+	mem_map(adr, len, (kind & Z80_ROM) != 0, (kind & Z80_HOOK) != 0);
+	return(0);
+}
+
+/*
+ *	Load a file like the r command, binary, Intel hex, S-records
+ *	or a manifest (@file), PC is set to the start address
+ *
+ *	Output: 0 ok, -1 error
+ */
+int z80_load(z80sim *m, const char *fn)
+{
+	char s[LENCMD];
+
+	if (strlen(fn) >= sizeof(s))
+		return(-1);
+	strcpy(s, fn);
+	return(load_file(s) ? -1 : 0);
+}
+
+void z80_io(z80sim *m, z80_in_fn in, z80_out_fn out, void *ctx)
+{
+	m->z_in = in;
+	m->z_out = out;
+	m->z_ioctx = ctx;
+}
+
+void z80_write(z80sim *m, z80_write_fn wr, void *ctx)
+{
+	m->z_wr = wr;
+	m->z_wrctx = ctx;
+}
+
+/*
+ *	Run for tstates T-states, the last instruction is completed,
+ *	so it may be a few more. HALT with interrupts enabled waits
+ *	for an interrupt in the emulated time.
+ *
+ *	Output: Z80_OK or the CPU error which stopped it
+ */
+int z80_run(z80sim *m, unsigned long long tstates)
+{
+	register int err;
+
+	if (tstates == 0)
+		return(Z80_OK);
+	cpu_tstop = cpu_tstates + tstates;
+	err = z_cpu(CONTIN_RUN);
+	cpu_tstop = ~0ULL;
+	return(err);
+}
+
+/*
+ *	Execute one instruction
+ *
+ *	Output: Z80_OK or the CPU error
+ */
+int z80_step(z80sim *m)
+{
+	return(z_cpu(SINGLE_STEP));
+}
+
+/*
+ *	Stop z80_run() after the current instruction, for callbacks
+ */
+void z80_stop(z80sim *m)
+{
+	cpu_state = STOPPED;
+}
+
+unsigned long long z80_tstates(z80sim *m)
+{
+	return(cpu_tstates);
+}
+
+unsigned long long z80_steps(z80sim *m)
+{
+	return(cpu_steps);
+}
+
+/*
+ *	Interrupts are taken before the next instruction, a maskable
+ *	one when it's enabled, it stays pending until then
+ */
+void z80_int(z80sim *m, unsigned char data)
+{
+	int_lsb = data;
+	int_type = INT_INT;
+}
+
+void z80_nmi(z80sim *m)
+{
+	int_type = INT_NMI;
+}
+
+void z80_getregs(z80sim *m, struct z80_regs *r)
+{
+	r->af = (A << 8) + (F & 0xff);
+	r->bc = (B << 8) + C;
+	r->de = (D << 8) + E;
+	r->hl = (H << 8) + L;
+	r->af_ = (A_ << 8) + (F_ & 0xff);
+	r->bc_ = (B_ << 8) + C_;
+	r->de_ = (D_ << 8) + E_;
+	r->hl_ = (H_ << 8) + L_;
+	r->ix = IX;
+	r->iy = IY;
+	r->sp = STACK - ram;
+	r->pc = PC - ram;
+	r->i = I;
+	r->r = R & 0xff;
+	r->iff = IFF;
+	r->im = int_mode;
+}
+
+void z80_setregs(z80sim *m, const struct z80_regs *r)
+{
+	A = r->af >> 8;
+	F = r->af & 0xff;
+	B = r->bc >> 8;
+	C = r->bc & 0xff;
+	D = r->de >> 8;
+	E = r->de & 0xff;
+	H = r->hl >> 8;
+	L = r->hl & 0xff;
+	A_ = r->af_ >> 8;
+	F_ = r->af_ & 0xff;
+	B_ = r->bc_ >> 8;
+	C_ = r->bc_ & 0xff;
+	D_ = r->de_ >> 8;
+	E_ = r->de_ & 0xff;
+	H_ = r->hl_ >> 8;
+	L_ = r->hl_ & 0xff;
+	IX = r->ix;
+	IY = r->iy;
+	STACK = ram + r->sp;
+	PC = ram + r->pc;
+	I = r->i;
+	R = r->r;
+	IFF = r->iff & 3;
+	int_mode = r->im;
+	cpu_halt = 0;			/* new PC, not in HALT anymore */
+}
+
+/*
+ *	Save CPU, devices and memory into buf, with buf NULL only
+ *	the size needed is returned
+ *
+ *	Output: size of the snapshot
+ */
+size_t z80_save(z80sim *m, void *buf)
+{
+	return(core_image((BYTE *) buf));
+}
+
+/*
+ *	Restore a snapshot of z80_save() with n bytes
+ *
+ *	Output: 0 ok, -1 not a snapshot or damaged
+ */
+int z80_restore(z80sim *m, const void *buf, size_t n)
+{
+	return(core_restore((BYTE *) buf, n, "snapshot") ? -1 : 0);
+}
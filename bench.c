@@ -0,0 +1,911 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module measures the speed of the emulation with a set
+ *	of synthetic Z80 workloads. Each workload is loaded at 0100H
+ *	and runs for a number of seconds of host time, then the
+ *	emulated clock frequency, the host time per instruction and
+ *	the T-states per instruction are shown and can be written
+ *	into a JSON file to compare versions of the emulator.
+ *
+ *	The machine state is saved before and restored after the
+ *	benchmark, so it can be run from the monitor at any time.
+ *	Without WANT_TIM the instructions are counted with the R
+ *	register and the T-states are unknown.
+ *
+ *	The op-code microbenchmark at the end of the module measures
+ *	every op-code alone.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "config.h"
+#include "global.h"
+
+extern void cpu(void);
+extern size_t io_export(BYTE *);
+extern int io_import(BYTE *, size_t);
+extern int dart_inject(int, BYTE *, int);
+extern int dis_r(unsigned char *, int, char *);
+
+#define BN_ORG		0x0100		/* load address of the workloads */
+
+struct bench {
+	char *b_name;
+	char *b_desc;
+	BYTE *b_code;			/* code at BN_ORG */
+	int b_len;
+	BYTE *b_data;			/* data at b_dadr */
+	int b_dlen;
+	WORD b_dadr;
+	int b_ints;			/* needs interrupts */
+	int b_dart;			/* DART input */
+};
+
+struct bnres {				/* result of a workload */
+	unsigned long long r_steps;
+	unsigned long long r_tstates;
+	double r_host;			/* wall clock seconds */
+	double r_cpu;			/* process CPU seconds */
+	int r_err;
+};
+
+/*
+ *	ALU op-codes on registers and immediates in a DJNZ loop
+ */
+static BYTE bn_alu[] = {
+	0x31, 0x00, 0xff,		/* 0100	LD SP,FF00H */
+	0x3e, 0x00,			/* 0103	LD A,0 */
+	0x06, 0x00,			/* 0105	LD B,0 */
+	0x80,				/* 0107	ADD A,B */
+	0x91,				/* 0108	SUB C */
+	0xa2,				/* 0109	AND D */
+	0xab,				/* 010A	XOR E */
+	0xb4,				/* 010B	OR H */
+	0xbd,				/* 010C	CP L */
+	0xce, 0x05,			/* 010D	ADC A,5 */
+	0xde, 0x03,			/* 010F	SBC A,3 */
+	0x3c,				/* 0111	INC A */
+	0x0d,				/* 0112	DEC C */
+	0x2c,				/* 0113	INC L */
+	0x27,				/* 0114	DAA */
+	0x10, 0xf0,			/* 0115	DJNZ 0107H */
+	0xc3, 0x05, 0x01		/* 0117	JP 0105H */
+};
+
+/*
+ *	Block copy of 4 KB with LDIR
+ */
+static BYTE bn_ldir[] = {
+	0x31, 0x00, 0xff,		/* 0100	LD SP,FF00H */
+	0x21, 0x00, 0x80,		/* 0103	LD HL,8000H */
+	0x11, 0x00, 0x90,		/* 0106	LD DE,9000H */
+	0x01, 0x00, 0x10,		/* 0109	LD BC,1000H */
+	0xed, 0xb0,			/* 010C	LDIR */
+	0xc3, 0x03, 0x01		/* 010E	JP 0103H */
+};
+
+/*
+ *	CB prefixed shifts and bit operations on registers and (HL)
+ */
+static BYTE bn_cb[] = {
+	0x31, 0x00, 0xff,		/* 0100	LD SP,FF00H */
+	0x21, 0x00, 0x80,		/* 0103	LD HL,8000H */
+	0xcb, 0x00,			/* 0106	RLC B */
+	0xcb, 0x19,			/* 0108	RR C */
+	0xcb, 0x22,			/* 010A	SLA D */
+	0xcb, 0x3b,			/* 010C	SRL E */
+	0xcb, 0x5f,			/* 010E	BIT 3,A */
+	0xcb, 0xee,			/* 0110	SET 5,(HL) */
+	0xcb, 0xae,			/* 0112	RES 5,(HL) */
+	0xcb, 0x7e,			/* 0114	BIT 7,(HL) */
+	0xcb, 0x16,			/* 0116	RL (HL) */
+	0x18, 0xec			/* 0118	JR 0106H */
+};
+
+/*
+ *	IX/IY indexed loads, arithmetic and DDCB/FDCB op-codes
+ */
+static BYTE bn_index[] = {
+	0x31, 0x00, 0xff,		/* 0100	LD SP,FF00H */
+	0xdd, 0x21, 0x00, 0x80,		/* 0103	LD IX,8000H */
+	0xfd, 0x21, 0x00, 0x90,		/* 0107	LD IY,9000H */
+	0xdd, 0x7e, 0x01,		/* 010B	LD A,(IX+1) */
+	0xfd, 0x86, 0x02,		/* 010E	ADD A,(IY+2) */
+	0xdd, 0x77, 0x03,		/* 0111	LD (IX+3),A */
+	0xfd, 0x34, 0x04,		/* 0114	INC (IY+4) */
+	0xdd, 0x46, 0xff,		/* 0117	LD B,(IX-1) */
+	0xdd, 0x23,			/* 011A	INC IX */
+	0xdd, 0x2b,			/* 011C	DEC IX */
+	0xdd, 0xcb, 0x05, 0xc6,		/* 011E	SET 0,(IX+5) */
+	0xfd, 0xcb, 0x06, 0x46,		/* 0122	BIT 0,(IY+6) */
+	0xdd, 0xe5,			/* 0126	PUSH IX */
+	0xfd, 0xe1,			/* 0128	POP IY */
+	0xfd, 0x21, 0x00, 0x90,		/* 012A	LD IY,9000H */
+	0x18, 0xdb			/* 012E	JR 010BH */
+};
+
+/*
+ *	Nested subroutine calls with PUSH/POP and conditional RET
+ */
+static BYTE bn_call[] = {
+	0x31, 0x00, 0xff,		/* 0100	LD SP,FF00H */
+	0xcd, 0x0b, 0x01,		/* 0103	CALL 010BH */
+	0xcd, 0x0e, 0x01,		/* 0106	CALL 010EH */
+	0x18, 0xf8,			/* 0109	JR 0103H */
+	0xc5,				/* 010B	PUSH BC */
+	0xe1,				/* 010C	POP HL */
+	0xc9,				/* 010D	RET */
+	0xcd, 0x0b, 0x01,		/* 010E	CALL 010BH */
+	0xc0,				/* 0111	RET NZ */
+	0xc9				/* 0112	RET */
+};
+
+/*
+ *	Mode 2 interrupts from CTC channel 0 every 60 instructions,
+ *	the vector table is at 0200H and the handler at 0300H
+ */
+static BYTE bn_int[] = {
+	0x31, 0x00, 0xff,		/* 0100	LD SP,FF00H */
+	0xed, 0x5e,			/* 0103	IM 2 */
+	0x3e, 0x02,			/* 0105	LD A,02H */
+	0xed, 0x47,			/* 0107	LD I,A */
+	0x3e, 0x00,			/* 0109	LD A,00H */
+	0xd3, 0x04,			/* 010B	OUT (04H),A	vector */
+	0x3e, 0x85,			/* 010D	LD A,85H */
+	0xd3, 0x04,			/* 010F	OUT (04H),A	ints, TC */
+	0x3e, 0x04,			/* 0111	LD A,04H */
+	0xd3, 0x04,			/* 0113	OUT (04H),A	TC 4 */
+	0xfb,				/* 0115	EI */
+	0x23,				/* 0116	INC HL */
+	0x80,				/* 0117	ADD A,B */
+	0x18, 0xfc			/* 0118	JR 0116H */
+};
+
+static BYTE bn_intvec[] = {
+	0x00, 0x03,			/* 0200	DEFW 0300H */
+	[0x100] = 0x08,			/* 0300	EX AF,AF' */
+	0xd9,				/* 0301	EXX */
+	0x04,				/* 0302	INC B */
+	0xd9,				/* 0303	EXX */
+	0x08,				/* 0304	EX AF,AF' */
+	0xfb,				/* 0305	EI */
+	0xed, 0x4d			/* 0306	RETI */
+};
+
+/*
+ *	Polling of DART channel A, received bytes are stored at (HL)
+ */
+static BYTE bn_dart[] = {
+	0x31, 0x00, 0xff,		/* 0100	LD SP,FF00H */
+	0xdb, 0x0a,			/* 0103	IN A,(0AH)	RR0 */
+	0xe6, 0x01,			/* 0105	AND 1 */
+	0x28, 0xfa,			/* 0107	JR Z,0103H */
+	0xdb, 0x08,			/* 0109	IN A,(08H)	data */
+	0x77,				/* 010B	LD (HL),A */
+	0x23,				/* 010C	INC HL */
+	0x18, 0xf4			/* 010D	JR 0103H */
+};
+
+static struct bench bn_tab[] = {
+	{ "alu", "ALU op-codes", bn_alu, sizeof(bn_alu), NULL, 0, 0, 0, 0 },
+	{ "ldir", "LDIR memcopy", bn_ldir, sizeof(bn_ldir), NULL, 0, 0, 0, 0 },
+	{ "cb", "CB bit ops", bn_cb, sizeof(bn_cb), NULL, 0, 0, 0, 0 },
+	{ "index", "IX/IY indexed", bn_index, sizeof(bn_index), NULL, 0, 0,
+	  0, 0 },
+	{ "call", "CALL/RET", bn_call, sizeof(bn_call), NULL, 0, 0, 0, 0 },
+	{ "int", "CTC interrupts", bn_int, sizeof(bn_int), bn_intvec,
+	  sizeof(bn_intvec), 0x0200, 1, 0 },
+	{ "dart", "DART polling", bn_dart, sizeof(bn_dart), NULL, 0, 0, 0,
+	  1 },
+	{ NULL, NULL, NULL, 0, NULL, 0, 0, 0, 0 }
+};
+
+static struct bnstate {			/* machine saved by the benchmarks */
+	BYTE *m_ram;			/* RAM and I/O devices */
+	size_t m_iolen;
+	BYTE m_a, m_b, m_c, m_d, m_e, m_h, m_l;
+	BYTE m_a_, m_b_, m_c_, m_d_, m_e_, m_h_, m_l_;
+	BYTE m_i, m_iff;
+	int m_f, m_f_;
+	WORD m_ix, m_iy, m_pc, m_sp;
+	long m_r;
+	int m_im, m_it, m_fl;
+#ifdef WANT_TIM
+	unsigned long long m_steps, m_ts;
+#endif
+} bn_mach;
+
+static char *bn_feat[] = {		/* options which change the speed */
+#ifdef WANT_INT
+	"WANT_INT",
+#endif
+#ifdef WANT_COUNTERS
+	"WANT_COUNTERS",
+#endif
+#ifdef WANT_TIM
+	"WANT_TIM",
+#endif
+#ifdef HISIZE
+	"HISIZE",
+#endif
+#ifdef SBSIZE
+	"SBSIZE",
+#endif
+#ifdef SNSIZE
+	"SNSIZE",
+#endif
+#ifdef WANT_TRACE
+	"WANT_TRACE",
+#endif
+#ifdef WANT_PROF
+	"WANT_PROF",
+#endif
+#ifdef WANT_COV
+	"WANT_COV",
+#endif
+	NULL
+};
+
+static void bn_timeout(int sig)
+{
+	cpu_state = STOPPED;
+}
+
+static double bn_secs(clockid_t id)
+{
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+	return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*
+ *	Run workload b for secs seconds
+ */
+static void bn_run(struct bench *b, double secs, struct bnres *r)
+{
+	struct itimerval it;
+	BYTE in[DART_BUFSIZE];
+	double t0, c0;
+#ifdef WANT_TIM
+	unsigned long long s0 = cpu_steps, ts0 = cpu_tstates;
+#endif
+	register int i;
+
+	memset(r, 0, sizeof(struct bnres));
+	memset(ram, 0, 65536);
+	memcpy(ram + BN_ORG, b->b_code, b->b_len);
+	if (b->b_data != NULL)
+		memcpy(ram + b->b_dadr, b->b_data, b->b_dlen);
+	if (b->b_dart) {
+		for (i = 0; i < sizeof(in); i++)
+			in[i] = i;
+		dart_inject(0, in, sizeof(in));
+	}
+	PC = ram + BN_ORG;
+	STACK = ram + 0xff00;
+	R = 0L;
+	IFF = 0;
+	int_type = INT_NONE;
+	int_mode = 0;
+#ifdef SNSIZE
+	snap_dirty();
+#endif
+	memset(&it, 0, sizeof(it));
+	it.it_value.tv_sec = secs;
+	it.it_value.tv_usec = (secs - (long) secs) * 1e6;
+	signal(SIGALRM, bn_timeout);
+	t0 = bn_secs(CLOCK_MONOTONIC);
+	c0 = bn_secs(CLOCK_PROCESS_CPUTIME_ID);
+	setitimer(ITIMER_REAL, &it, NULL);
+	cpu_state = CONTIN_RUN;
+	cpu_error = NONE;
+	cpu();
+	r->r_host = bn_secs(CLOCK_MONOTONIC) - t0;
+	r->r_cpu = bn_secs(CLOCK_PROCESS_CPUTIME_ID) - c0;
+	r->r_err = cpu_error;
+#ifdef WANT_TIM
+	r->r_steps = cpu_steps - s0;
+	r->r_tstates = cpu_tstates - ts0;
+	if (r->r_steps == 0)		/* variant without counting */
+		r->r_steps = R;
+#else
+	r->r_steps = R;
+#endif
+}
+
+/*
+ *	Write the results as JSON into file fn
+ */
+static int bn_json(char *fn, double secs, struct bnres *res)
+{
+	register struct bench *b;
+	register struct bnres *r;
+	register int i;
+	int fixed;
+	FILE *fp;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		perror(fn);
+		return(1);
+	}
+	fprintf(fp, "{\n  \"release\": \"%s\",\n  \"core\": \"%s\",\n"
+		"  \"features\": [", RELEASE, core_name(&fixed));
+	for (i = 0; bn_feat[i] != NULL; i++)
+		fprintf(fp, "%s\"%s\"", i ? ", " : " ", bn_feat[i]);
+	fputs(" ],\n", fp);
+	fprintf(fp, "  \"secs\": %g,\n  \"workloads\": [\n", secs);
+	for (b = bn_tab, r = res; b->b_name != NULL; b++, r++) {
+		fprintf(fp, "    { \"name\": \"%s\", \"error\": %d, "
+			"\"instructions\": %llu, ", b->b_name, r->r_err,
+			r->r_steps);
+#ifdef WANT_TIM
+		fprintf(fp, "\"tstates\": %llu, \"mhz\": %.3f, "
+			"\"tstates_per_instr\": %.3f, ", r->r_tstates,
+			r->r_tstates / r->r_host / 1e6,
+			r->r_steps ? (double) r->r_tstates / r->r_steps : 0.0);
+#else
+		fputs("\"tstates\": null, \"mhz\": null, "
+		      "\"tstates_per_instr\": null, ", fp);
+#endif
+		fprintf(fp, "\"host_secs\": %.6f, \"cpu_secs\": %.6f, "
+			"\"mips\": %.3f, \"ns_per_instr\": %.3f }%s\n",
+			r->r_host, r->r_cpu, r->r_steps / r->r_host / 1e6,
+			r->r_steps ? r->r_cpu * 1e9 / r->r_steps : 0.0,
+			(b + 1)->b_name != NULL ? "," : "");
+	}
+	fputs("  ]\n}\n", fp);
+	fclose(fp);
+	return(0);
+}
+
+/*
+ *	Save the machine before a benchmark
+ *
+ *	Output: 0 ok, 1 not enough memory
+ */
+static int bn_save(void)
+{
+	register struct bnstate *m = &bn_mach;
+
+	m->m_iolen = io_export(NULL);
+	if ((m->m_ram = malloc(65536 + m->m_iolen)) == NULL) {
+		puts("not enough memory for the benchmark");
+		return(1);
+	}
+	memcpy(m->m_ram, ram, 65536);
+	io_export(m->m_ram + 65536);
+	m->m_a = A; m->m_f = F; m->m_b = B; m->m_c = C;
+	m->m_d = D; m->m_e = E; m->m_h = H; m->m_l = L;
+	m->m_a_ = A_; m->m_f_ = F_; m->m_b_ = B_; m->m_c_ = C_;
+	m->m_d_ = D_; m->m_e_ = E_; m->m_h_ = H_; m->m_l_ = L_;
+	m->m_ix = IX; m->m_iy = IY; m->m_i = I; m->m_iff = IFF; m->m_r = R;
+	m->m_pc = PC - ram; m->m_sp = STACK - ram;
+	m->m_im = int_mode; m->m_it = int_type; m->m_fl = f_flag;
+#ifdef WANT_TIM
+	m->m_steps = cpu_steps;
+	m->m_ts = cpu_tstates;
+#endif
+	f_flag = 0;
+	return(0);
+}
+
+/*
+ *	Restore the machine after a benchmark
+ */
+static void bn_restore(void)
+{
+	register struct bnstate *m = &bn_mach;
+
+	memcpy(ram, m->m_ram, 65536);
+	io_import(m->m_ram + 65536, m->m_iolen);
+	free(m->m_ram);
+	A = m->m_a; F = m->m_f; B = m->m_b; C = m->m_c;
+	D = m->m_d; E = m->m_e; H = m->m_h; L = m->m_l;
+	A_ = m->m_a_; F_ = m->m_f_; B_ = m->m_b_; C_ = m->m_c_;
+	D_ = m->m_d_; E_ = m->m_e_; H_ = m->m_h_; L_ = m->m_l_;
+	IX = m->m_ix; IY = m->m_iy; I = m->m_i; IFF = m->m_iff; R = m->m_r;
+	PC = ram + m->m_pc; STACK = ram + m->m_sp;
+	int_mode = m->m_im; int_type = m->m_it; f_flag = m->m_fl;
+#ifdef WANT_TIM
+	cpu_steps = m->m_steps;
+	cpu_tstates = m->m_ts;
+#endif
+	cpu_error = NONE;
+#ifdef SNSIZE
+	snap_dirty();
+#endif
+}
+
+/*
+ *	Run the benchmark, s is [secs][,file] with the seconds
+ *	per workload (default 1) and the file for the JSON results
+ *
+ *	Output: 0 ok, 1 error
+ */
+int bench_run(char *s)
+{
+	static struct bnres res[sizeof(bn_tab) / sizeof(struct bench)];
+	register struct bench *b;
+	register struct bnres *r;
+	double secs = 1.0;
+	char *fn = NULL;
+	int ret = 0, fixed;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	if ((fn = strchr(s, ',')) != NULL)
+		*fn++ = '\0';
+	if (*s && (secs = atof(s)) <= 0.0) {
+		printf("can't run the benchmark for %s seconds\n", s);
+		return(1);
+	}
+	if (bn_save())
+		return(1);
+
+	printf("CPU emulation variant %s\n", core_name(&fixed));
+	puts("Workload        Instructions        T-states        MHz  ns/instr   T/instr");
+	for (b = bn_tab, r = res; b->b_name != NULL; b++, r++) {
+		fflush(stdout);
+		bn_run(b, secs, r);
+		printf("%-15s %12llu", b->b_desc, r->r_steps);
+#ifdef WANT_TIM
+		printf("  %14llu %10.2f", r->r_tstates,
+		       r->r_tstates / r->r_host / 1e6);
+#else
+		printf("               -          -");
+#endif
+		printf("  %8.2f", r->r_steps ? r->r_cpu * 1e9 / r->r_steps : 0.0);
+#ifdef WANT_TIM
+		printf("  %8.2f", r->r_steps ?
+		       (double) r->r_tstates / r->r_steps : 0.0);
+#else
+		printf("         -");
+#endif
+		if (r->r_err != NONE)
+			printf("  error %d", r->r_err);
+#if !defined(WANT_INT) || !defined(WANT_COUNTERS)
+		if (b->b_ints)
+			printf("  no interrupts compiled in");
+#endif
+		putchar('\n');
+	}
+	if (fn != NULL && *fn)
+		ret = bn_json(fn, secs, res);
+	bn_restore();
+	return(ret);
+}
+
+/*
+ *	Per op-code microbenchmark: every op-code of the main table,
+ *	the CB, DD, ED, FD and the DDCB/FDCB tables runs count times
+ *	on random registers. The op-code is repeated OB_K times at
+ *	OB_CODE and ended with ED FF, which traps and stops the CPU,
+ *	the cost of starting and stopping the CPU is measured first
+ *	and subtracted. Branches go to the next instruction, RET
+ *	pops the address of the next instruction from a prepared
+ *	stack. RST, JP (rr) and the block instructions run once per
+ *	start of the CPU.
+ *
+ *	The pointer registers are random in 8000H-BFFFH, B is 1-0FH
+ *	and C selects a port of the 8255, so that no instruction
+ *	writes into the code or the stack or beyond the end of the
+ *	memory, or programs the CTC and the DART. Output of the I/O devices goes to /dev/null.
+ *
+ *	On Linux the host CPU cycles and instructions are counted
+ *	with perf_event_open(), if the kernel allows it.
+ */
+
+#define OB_CODE		0x1000		/* code of the op-code */
+#define OB_STACK	0xf800		/* stack */
+#define OB_DATA		0x9000		/* nn of op-codes with address */
+#define OB_K		1000		/* op-codes per start of the CPU */
+#define OB_BASE		10000		/* starts to measure the overhead */
+
+struct obtab {				/* op-code tables */
+	char *t_name;
+	BYTE t_pre[2];			/* prefix */
+	int t_npre;
+};
+
+struct obres {				/* result of an op-code */
+	struct obtab *o_tab;
+	int o_op;
+	char o_mn[DISLEN];		/* mnemonic */
+	char *o_skip;			/* reason if not measured */
+	unsigned long long o_n;		/* no. of instructions */
+	unsigned long long o_ts;	/* T-states */
+	double o_ns;			/* host nanoseconds */
+	double o_cyc;			/* host cycles and instructions */
+	double o_ins;
+};
+
+static struct obtab ob_tab[] = {
+	{ "main", { 0 }, 0 },
+	{ "cb", { 0xcb }, 1 },
+	{ "dd", { 0xdd }, 1 },
+	{ "ed", { 0xed }, 1 },
+	{ "fd", { 0xfd }, 1 },
+	{ "ddcb", { 0xdd, 0xcb }, 2 },
+	{ "fdcb", { 0xfd, 0xcb }, 2 },
+	{ NULL, { 0 }, 0 }
+};
+
+static unsigned int ob_seed = 0x2545f491;
+static double ob_base;			/* overhead of a start */
+static double ob_bcyc, ob_bins;
+static int ob_pfd = -1;			/* perf counters */
+static int ob_ifd = -1;
+
+static BYTE ob_rand(void)
+{
+	ob_seed ^= ob_seed << 13;
+	ob_seed ^= ob_seed >> 17;
+	ob_seed ^= ob_seed << 5;
+	return(ob_seed);
+}
+
+/*
+ *	Random registers, see above for the limits
+ */
+static void ob_regs(void)
+{
+	A = ob_rand(); F = ob_rand(); B = 1 + ob_rand() % 15; C = ob_rand() & 3;
+	D = 0x80 | (ob_rand() & 0x3f); E = ob_rand();
+	H = 0x80 | (ob_rand() & 0x3f); L = ob_rand();
+	A_ = ob_rand(); F_ = ob_rand(); B_ = 1 + ob_rand() % 15;
+	C_ = ob_rand() & 3; D_ = 0x80 | (ob_rand() & 0x3f); E_ = ob_rand();
+	H_ = 0x80 | (ob_rand() & 0x3f); L_ = ob_rand();
+	IX = ((0x80 | (ob_rand() & 0x3f)) << 8) + ob_rand();
+	IY = ((0x80 | (ob_rand() & 0x3f)) << 8) + ob_rand();
+	STACK = ram + OB_STACK;
+	PC = ram + OB_CODE;
+	IFF = 0;
+	int_type = INT_NONE;
+}
+
+#ifdef __linux__
+static int ob_perf(int type, int group)
+{
+	struct perf_event_attr pe;
+
+	memset(&pe, 0, sizeof(pe));
+	pe.type = PERF_TYPE_HARDWARE;
+	pe.size = sizeof(pe);
+	pe.config = type;
+	pe.disabled = (group == -1);
+	pe.read_format = PERF_FORMAT_GROUP;
+	pe.exclude_kernel = 1;
+	pe.exclude_hv = 1;
+	return(syscall(__NR_perf_event_open, &pe, 0, -1, group, 0));
+}
+#endif
+
+/*
+ *	Start the CPU at OB_CODE, the end of the code is at adr
+ *
+ *	Output: host nanoseconds, -1 if the CPU didn't stop at adr
+ */
+static double ob_start(WORD adr, double *cyc, double *ins)
+{
+	unsigned long long c[3];
+	double t;
+
+	cpu_state = CONTIN_RUN;
+	cpu_error = NONE;
+#ifdef __linux__
+	if (ob_pfd != -1)
+		ioctl(ob_pfd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+	t = bn_secs(CLOCK_MONOTONIC);
+	cpu();
+	t = bn_secs(CLOCK_MONOTONIC) - t;
+#ifdef __linux__
+	if (ob_pfd != -1) {
+		ioctl(ob_pfd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		if (read(ob_pfd, c, sizeof(c)) == sizeof(c)) {
+			*cyc += c[1];
+			*ins += c[2];
+		}
+		ioctl(ob_pfd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	}
+#endif
+	if (cpu_error != OPTRAP2 || PC != ram + adr + 2)
+		return(-1.0);
+	return(t * 1e9);
+}
+
+/*
+ *	Make the instruction op of table t at adr into p, the mnemonic
+ *	into mn
+ *
+ *	Output: size of the instruction
+ */
+static int ob_ins(struct obtab *t, int op, WORD adr, BYTE *p, char *mn)
+{
+	register int i, n = 0, len;
+	register char *s;
+	WORD nn = OB_DATA;
+
+	memset(p, 0, 8);
+	for (i = 0; i < t->t_npre; i++)
+		p[n++] = t->t_pre[i];
+	if (t->t_npre == 2)
+		p[n++] = 0x05;			/* displacement of DDCB */
+	p[n++] = op;
+	len = dis_r(p, adr, mn);
+	if (len - n == 2) {
+		if (t->t_npre == 1 && op == 0x36) {	/* LD (IX+d),n */
+			p[n] = 0x05;
+		} else {
+			if (t->t_npre == 0 && ((op & 0xc7) == 0xc2
+			    || (op & 0xc7) == 0xc4 || op == 0xc3 || op == 0xcd))
+				nn = adr + len;	/* JP, CALL */
+			p[n] = nn;
+			p[n + 1] = nn >> 8;
+		}
+	} else if (len - n == 1 && t->t_npre == 1 && t->t_pre[0] != 0xed)
+		p[n] = 0x05;			/* displacement */
+	dis_r(p, adr, mn);
+	if ((s = strstr(mn, "\t;")) != NULL)	/* no symbols */
+		*s = '\0';
+	if ((s = strchr(mn, '\n')) != NULL)
+		*s = '\0';
+	for (s = mn; *s; s++)
+		if (*s == '\t')
+			*s = ' ';
+	return(len);
+}
+
+/*
+ *	Measure op-code op of table t
+ */
+static void ob_run(struct obtab *t, int op, long count, struct obres *r)
+{
+	BYTE ins[8];
+	register int i, k, len;
+	register WORD adr, end;
+	long nb;
+	double ns;
+	enum { OB_SEQ, OB_RET, OB_ONE, OB_JPR, OB_RST } kind = OB_SEQ;
+
+	memset(r, 0, sizeof(struct obres));
+	r->o_tab = t;
+	r->o_op = op;
+	len = ob_ins(t, op, OB_CODE, ins, r->o_mn);
+	if (strncmp(r->o_mn, "RET", 3) == 0)
+		kind = OB_RET;
+	else if (strncmp(r->o_mn, "RST", 3) == 0)
+		kind = OB_RST;
+	else if (strncmp(r->o_mn, "JP (", 4) == 0)
+		kind = OB_JPR;
+	else if (strlen(r->o_mn) == 4 && r->o_mn[3] == 'R'
+		 && (r->o_mn[2] == 'I' || r->o_mn[2] == 'D')
+		 && strchr("LCIO", r->o_mn[0]) != NULL)
+		kind = OB_ONE;			/* LDIR, CPDR, OTIR, ... */
+	k = (kind == OB_SEQ || kind == OB_RET) ? OB_K : 1;
+	for (i = 0, adr = OB_CODE; i < k; i++, adr += len) {
+		ob_ins(t, op, adr, ins, r->o_mn);
+		memcpy(ram + adr, ins, len);
+		if (kind == OB_RET) {
+			ram[OB_STACK + 2 * i] = adr + len;
+			ram[OB_STACK + 2 * i + 1] = (adr + len) >> 8;
+		}
+	}
+	end = (kind == OB_RST) ? op & 0x38 : adr;
+	ram[end] = 0xed;			/* ED FF traps */
+	ram[end + 1] = 0xff;
+	if ((nb = count / k) < 1)
+		nb = 1;
+	while (nb--) {
+		ob_regs();
+		if (kind == OB_JPR) {
+			if (t->t_npre == 0)
+				H = end >> 8, L = end;
+			else if (t->t_pre[0] == 0xdd)
+				IX = end;
+			else
+				IY = end;
+		}
+#ifdef WANT_TIM
+		r->o_ts -= cpu_tstates;
+#endif
+		if ((ns = ob_start(end, &r->o_cyc, &r->o_ins)) < 0.0) {
+			r->o_skip = (cpu_error == OPTRAP1 || cpu_error == OPTRAP2
+				     || cpu_error == OPTRAP4) ? "trap" :
+				    "doesn't run through";
+			return;
+		}
+#ifdef WANT_TIM
+		r->o_ts += cpu_tstates;
+#endif
+		r->o_ns += ns - ob_base;
+		r->o_cyc -= ob_bcyc;
+		r->o_ins -= ob_bins;
+		r->o_n += k;
+	}
+	if (r->o_ns < 0.0)
+		r->o_ns = 0.0;
+}
+
+static int ob_cmp(const void *a, const void *b)
+{
+	register const struct obres *x = a, *y = b;
+	register double dx, dy;
+
+	if (x->o_skip != NULL || y->o_skip != NULL)
+		return((x->o_skip != NULL) - (y->o_skip != NULL));
+	dx = x->o_ns / x->o_n;
+	dy = y->o_ns / y->o_n;
+	return(dx < dy ? 1 : (dx > dy ? -1 : 0));
+}
+
+/*
+ *	Write the results of the op-codes as JSON into file fn
+ */
+static int ob_json(char *fn, long count, struct obres *res, int n)
+{
+	register struct obres *r;
+	register int i;
+	int fixed;
+	FILE *fp;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		perror(fn);
+		return(1);
+	}
+	fprintf(fp, "{\n  \"release\": \"%s\",\n  \"core\": \"%s\",\n"
+		"  \"features\": [", RELEASE, core_name(&fixed));
+	for (i = 0; bn_feat[i] != NULL; i++)
+		fprintf(fp, "%s\"%s\"", i ? ", " : " ", bn_feat[i]);
+	fprintf(fp, " ],\n  \"count\": %ld,\n  \"perf\": %s,\n  \"opcodes\": [\n",
+		count, ob_pfd != -1 ? "true" : "false");
+	for (i = 0, r = res; i < n; i++, r++) {
+		fprintf(fp, "    { \"table\": \"%s\", \"opcode\": \"%02x\", "
+			"\"mnemonic\": \"%s\", ", r->o_tab->t_name, r->o_op,
+			r->o_mn);
+		if (r->o_skip != NULL)
+			fprintf(fp, "\"skipped\": \"%s\" }", r->o_skip);
+		else {
+			fprintf(fp, "\"instructions\": %llu, \"ns_per_instr\": %.3f",
+				r->o_n, r->o_ns / r->o_n);
+#ifdef WANT_TIM
+			fprintf(fp, ", \"tstates\": %llu, \"ns_per_tstate\": %.3f",
+				r->o_ts, r->o_ts ? r->o_ns / r->o_ts : 0.0);
+#endif
+			if (ob_pfd != -1)
+				fprintf(fp, ", \"cycles_per_instr\": %.1f, "
+					"\"host_instr_per_instr\": %.1f",
+					r->o_cyc / r->o_n, r->o_ins / r->o_n);
+			fputs(" }", fp);
+		}
+		fputs(i < n - 1 ? ",\n" : "\n", fp);
+	}
+	fputs("  ]\n}\n", fp);
+	fclose(fp);
+	return(0);
+}
+
+/*
+ *	Run the op-code microbenchmark, s is [count][,file] with
+ *	the no. of executions of each op-code (default 1000000)
+ *	and the file for the JSON results of all op-codes. The
+ *	slowest op-codes are shown.
+ *
+ *	Output: 0 ok, 1 error
+ */
+int opbench_run(char *s)
+{
+	static struct obres res[sizeof(ob_tab) / sizeof(struct obtab) * 256];
+	register struct obtab *t;
+	register struct obres *r;
+	register int op, n = 0, i;
+	long count = 1000000L;
+	char *fn;
+	int nul, out, skip = 0, ret = 0;
+	double ns;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	if ((fn = strchr(s, ',')) != NULL)
+		*fn++ = '\0';
+	if (*s && (count = atol(s)) <= 0) {
+		printf("can't run the op-codes %s times\n", s);
+		return(1);
+	}
+	if (bn_save())
+		return(1);
+#ifdef __linux__
+	if ((ob_pfd = ob_perf(PERF_COUNT_HW_CPU_CYCLES, -1)) != -1) {
+		if ((ob_ifd = ob_perf(PERF_COUNT_HW_INSTRUCTIONS, ob_pfd)) == -1) {
+			close(ob_pfd);
+			ob_pfd = -1;
+		}
+	}
+#endif
+	printf("Measuring %d op-code tables, %ld times each%s\n",
+	       (int)(sizeof(ob_tab) / sizeof(struct obtab)) - 1, count,
+	       ob_pfd != -1 ? ", with perf counters" : "");
+	fflush(stdout);
+	out = dup(1);			/* I/O devices print a lot */
+	if ((nul = open("/dev/null", O_WRONLY)) != -1)
+		dup2(nul, 1);
+
+	memset(ram, 0, 65536);		/* overhead of a CPU start */
+	ram[OB_CODE] = 0xed;
+	ram[OB_CODE + 1] = 0xff;
+	ob_base = ob_bcyc = ob_bins = 0.0;
+	for (i = 0; i < OB_BASE; i++) {
+		ob_regs();
+		if ((ns = ob_start(OB_CODE, &ob_bcyc, &ob_bins)) > 0.0)
+			ob_base += ns;
+	}
+	ob_base /= OB_BASE;
+	ob_bcyc /= OB_BASE;
+	ob_bins /= OB_BASE;
+
+	for (t = ob_tab; t->t_name != NULL; t++)
+		for (op = 0; op < 256; op++) {
+			if (t->t_npre == 0 && (op == 0xcb || op == 0xdd
+			    || op == 0xed || op == 0xfd))
+				continue;	/* prefixes */
+			if (t->t_npre == 1 && t->t_pre[0] != 0xed
+			    && op == 0xcb)
+				continue;
+			ob_run(t, op, count, &res[n]);
+			if (res[n++].o_skip != NULL)
+				skip++;
+		}
+
+	fflush(stdout);
+	if (nul != -1) {
+		dup2(out, 1);
+		close(nul);
+	}
+	close(out);
+#ifdef __linux__
+	if (ob_pfd != -1) {
+		close(ob_ifd);
+		close(ob_pfd);
+	}
+#endif
+	if (fn != NULL && *fn)
+		ret = ob_json(fn, count, res, n);
+	qsort(res, n, sizeof(struct obres), ob_cmp);
+	printf("%d op-codes, %d not measured (traps or HALT), start overhead %.1f ns\n",
+	       n - skip, skip, ob_base);
+	puts("Table  Op  Mnemonic            ns/instr  ns/T-state  cycles/instr");
+	for (i = 0, r = res; i < 25 && i < n - skip; i++, r++) {
+		printf("%-5s  %02x  %-18s  %8.2f", r->o_tab->t_name, r->o_op,
+		       r->o_mn, r->o_ns / r->o_n);
+#ifdef WANT_TIM
+		printf("  %10.3f", r->o_ts ? r->o_ns / r->o_ts : 0.0);
+#else
+		printf("           -");
+#endif
+		if (ob_pfd != -1)
+			printf("  %12.1f", r->o_cyc / r->o_n);
+		putchar('\n');
+	}
+	ob_pfd = ob_ifd = -1;
+	bn_restore();
+	return(ret);
+}
@@ -0,0 +1,384 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module contains the call graph profiler. The CALL,
+ *	RST and RET op-codes and the interrupt entry of the CPU
+ *	emulation feed a shadow call stack, the T-states are
+ *	counted in a calling context tree, with one node for
+ *	every path of calls from the start. A RET pops all frames
+ *	below the new stack pointer, so that code which drops
+ *	return addresses from the stack does not confuse the tree.
+ *
+ *	Reports are inclusive/exclusive T-states per subroutine,
+ *	folded stacks for flamegraph tools and callgrind files.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "global.h"
+
+#ifdef WANT_PROF
+
+#define CG_MAXDEPTH	256		/* max. depth of the call stack */
+#define CG_MAXNODES	1000000L	/* max. no. of nodes in the tree */
+#define CG_ROOT		0
+
+struct cgnode {				/* node of the calling context tree */
+	WORD n_fn;			/* address of the subroutine */
+	int n_parent;
+	int n_child;			/* first child */
+	int n_next;			/* next sibling */
+	unsigned long n_calls;		/* no. of calls into this node */
+	unsigned long long n_self;	/* T-states in this node */
+};
+
+struct cgframe {			/* shadow call stack */
+	int f_node;			/* node entered by the call */
+	WORD f_sp;			/* SP after push of return address */
+};
+
+struct cgedge {				/* for callgrind output */
+	WORD e_from, e_to;
+	unsigned long e_calls;
+	unsigned long long e_incl;
+};
+
+static struct cgnode *cg_node;
+static long cg_n, cg_max;
+static struct cgframe cg_stack[CG_MAXDEPTH];
+static int cg_depth;
+static int cg_cur = CG_ROOT;		/* current node */
+static unsigned long long cg_last;	/* T-states already counted */
+static unsigned long cg_lost;		/* calls not in the tree */
+
+static unsigned long long f_self[65536]; /* flat profile */
+static unsigned long long f_incl[65536];
+static unsigned long f_calls[65536];
+static int f_onpath[65536];
+
+/*
+ *	Start a new tree, with the root at address pc
+ */
+void cg_clear(void)
+{
+	if (cg_node == NULL) {
+		cg_max = 4096;
+		if ((cg_node = malloc(cg_max * sizeof(struct cgnode))) == NULL) {
+			cg_max = 0;
+			cg_flag = 0;
+			return;
+		}
+	}
+	cg_n = 1;
+	memset(&cg_node[CG_ROOT], 0, sizeof(struct cgnode));
+	cg_node[CG_ROOT].n_fn = PC - ram;
+	cg_node[CG_ROOT].n_child = -1;
+	cg_node[CG_ROOT].n_next = -1;
+	cg_node[CG_ROOT].n_parent = -1;
+	cg_depth = 0;
+	cg_cur = CG_ROOT;
+	cg_last = cpu_tstates;
+	cg_lost = 0;
+}
+
+/*
+ *	Count the T-states since the last call or return,
+ *	plus t for the op-code currently executed
+ */
+static void cg_charge(int t)
+{
+	if (cpu_tstates < cg_last)	/* went back in time */
+		cg_last = cpu_tstates;
+	cg_node[cg_cur].n_self += cpu_tstates - cg_last + t;
+	cg_last = cpu_tstates + t;
+}
+
+/*
+ *	Called from the CPU emulation for CALL and RST op-codes and
+ *	interrupts, after the return address was pushed and PC set to
+ *	address to, t is the no. of T-states of the op-code
+ */
+void cg_call(WORD to, int t)
+{
+	register int n;
+	register struct cgnode *p;
+
+	if (cg_node == NULL)
+		cg_clear();
+	cg_charge(t);
+	if (cg_depth == CG_MAXDEPTH) {
+		cg_lost++;
+		return;
+	}
+	for (n = cg_node[cg_cur].n_child; n != -1; n = cg_node[n].n_next)
+		if (cg_node[n].n_fn == to)
+			break;
+	if (n == -1) {
+		if (cg_n == cg_max) {
+			if (cg_max >= CG_MAXNODES ||
+			    (p = realloc(cg_node, 2 * cg_max * sizeof(struct cgnode))) == NULL) {
+				cg_lost++;
+				return;
+			}
+			cg_node = p;
+			cg_max *= 2;
+		}
+		n = cg_n++;
+		p = &cg_node[n];
+		p->n_fn = to;
+		p->n_parent = cg_cur;
+		p->n_child = -1;
+		p->n_next = cg_node[cg_cur].n_child;
+		p->n_calls = 0;
+		p->n_self = 0;
+		cg_node[cg_cur].n_child = n;
+	}
+	cg_node[n].n_calls++;
+	cg_stack[cg_depth].f_node = n;
+	cg_stack[cg_depth++].f_sp = STACK - ram;
+	cg_cur = n;
+}
+
+/*
+ *	Called from the CPU emulation for RET, RETI and RETN after
+ *	the return address was popped, t is the no. of T-states
+ */
+void cg_ret(int t)
+{
+	register WORD sp = STACK - ram;
+
+	if (cg_node == NULL)
+		cg_clear();
+	cg_charge(t);
+	while (cg_depth && cg_stack[cg_depth - 1].f_sp < sp)
+		cg_depth--;
+	cg_cur = cg_depth ? cg_stack[cg_depth - 1].f_node : CG_ROOT;
+}
+
+/*
+ *	Name of a subroutine for the reports
+ */
+static char *cg_name(WORD adr)
+{
+	static char buf[LENCMD];
+	char *s;
+	int off;
+
+	if ((s = sym_lookup(adr, &off)) != NULL) {
+		if (off)
+			snprintf(buf, sizeof(buf), "%s+%x", s, off);
+		else
+			snprintf(buf, sizeof(buf), "%s", s);
+	} else
+		snprintf(buf, sizeof(buf), "%04x", adr);
+	return(buf);
+}
+
+/*
+ *	Inclusive T-states of node n, the flat profile is
+ *	summed up on the way, recursive calls are counted once
+ */
+static unsigned long long cg_incl(int n)
+{
+	register int c;
+	register WORD fn = cg_node[n].n_fn;
+	unsigned long long t = cg_node[n].n_self;
+
+	f_onpath[fn]++;
+	for (c = cg_node[n].n_child; c != -1; c = cg_node[c].n_next)
+		t += cg_incl(c);
+	f_onpath[fn]--;
+	f_self[fn] += cg_node[n].n_self;
+	f_calls[fn] += cg_node[n].n_calls;
+	if (f_onpath[fn] == 0)
+		f_incl[fn] += t;
+	return(t);
+}
+
+/*
+ *	Build the flat profile
+ *
+ *	Output: total T-states
+ */
+static unsigned long long cg_flat(void)
+{
+	memset(f_self, 0, sizeof(f_self));
+	memset(f_incl, 0, sizeof(f_incl));
+	memset(f_calls, 0, sizeof(f_calls));
+	if (cg_node == NULL)
+		return(0);
+	cg_charge(0);
+	return(cg_incl(CG_ROOT));
+}
+
+static int cg_cmp(const void *a, const void *b)
+{
+	register unsigned long long x = f_incl[*(WORD *) a];
+	register unsigned long long y = f_incl[*(WORD *) b];
+
+	return((x < y) ? 1 : (x > y) ? -1 : 0);
+}
+
+/*
+ *	Print the n subroutines with the most inclusive T-states
+ */
+void cg_print(int n)
+{
+	static WORD idx[65536];
+	register int i, m = 0;
+	unsigned long long total = cg_flat();
+
+	for (i = 0; i < 65536; i++)
+		if (f_incl[i] || f_self[i])
+			idx[m++] = i;
+	qsort(idx, m, sizeof(WORD), cg_cmp);
+	printf("Subroutine                 Calls       Inclusive  Exclusive     %%incl\n");
+	for (i = 0; i < m && i < n; i++)
+		printf("%-22.22s  %10lu  %14llu  %14llu  %5.1f\n",
+		       cg_name(idx[i]), f_calls[idx[i]], f_incl[idx[i]],
+		       f_self[idx[i]],
+		       total ? 100.0 * f_incl[idx[i]] / total : 0.0);
+	if (cg_lost)
+		printf("%lu calls too deep, not in the call graph\n", cg_lost);
+}
+
+/*
+ *	Write the stacks of node n in folded format,
+ *	path is the stack of the parent
+ */
+static void cg_fold(FILE *fp, int n, char *path, int len)
+{
+	register int c, l;
+
+	l = snprintf(path + len, CG_MAXDEPTH * 24 - len, "%s%s",
+		     len ? ";" : "", cg_name(cg_node[n].n_fn));
+	if (l >= CG_MAXDEPTH * 24 - len)
+		l = CG_MAXDEPTH * 24 - len - 1;
+	if (cg_node[n].n_self)
+		fprintf(fp, "%s %llu\n", path, cg_node[n].n_self);
+	for (c = cg_node[n].n_child; c != -1; c = cg_node[c].n_next)
+		cg_fold(fp, c, path, len + l);
+	path[len] = '\0';
+}
+
+static int cg_ecmp(const void *a, const void *b)
+{
+	register const struct cgedge *x = a, *y = b;
+
+	if (x->e_from != y->e_from)
+		return(x->e_from - y->e_from);
+	return(x->e_to - y->e_to);
+}
+
+/*
+ *	Inclusive T-states of all nodes, for the edges
+ */
+static unsigned long long cg_nincl(int n, unsigned long long *incl)
+{
+	register int c;
+	unsigned long long t = cg_node[n].n_self;
+
+	for (c = cg_node[n].n_child; c != -1; c = cg_node[c].n_next)
+		t += cg_nincl(c, incl);
+	return(incl[n] = t);
+}
+
+/*
+ *	Write a callgrind file
+ */
+static int cg_callgrind(FILE *fp)
+{
+	struct cgedge *e;
+	unsigned long long *incl;
+	register long i, m = 0;
+	int fn;
+
+	cg_flat();
+	if ((e = malloc(cg_n * sizeof(struct cgedge))) == NULL ||
+	    (incl = malloc(cg_n * sizeof(unsigned long long))) == NULL) {
+		free(e);
+		puts("not enough memory for call graph");
+		return(1);
+	}
+	cg_nincl(CG_ROOT, incl);
+	for (i = 1; i < cg_n; i++) {
+		e[m].e_from = cg_node[cg_node[i].n_parent].n_fn;
+		e[m].e_to = cg_node[i].n_fn;
+		e[m].e_calls = cg_node[i].n_calls;
+		e[m++].e_incl = incl[i];
+	}
+	qsort(e, m, sizeof(struct cgedge), cg_ecmp);
+
+	fprintf(fp, "# callgrind format\nversion: 1\ncreator: z80sim %s\n",
+		RELEASE);
+	fprintf(fp, "positions: instr\nevents: Tstates\n\n");
+	for (fn = 0, i = 0; fn < 65536; fn++) {
+		if (f_self[fn] == 0 && (i >= m || e[i].e_from != fn))
+			continue;
+		fprintf(fp, "fn=%s\n", cg_name(fn));
+		fprintf(fp, "0x%04x %llu\n", fn, f_self[fn]);
+		for (; i < m && e[i].e_from == fn; i++) {
+			unsigned long calls = e[i].e_calls;
+			unsigned long long t = e[i].e_incl;
+
+			while (i + 1 < m && e[i + 1].e_from == fn &&
+			       e[i + 1].e_to == e[i].e_to) {
+				i++;
+				calls += e[i].e_calls;
+				t += e[i].e_incl;
+			}
+			fprintf(fp, "cfn=%s\n", cg_name(e[i].e_to));
+			fprintf(fp, "calls=%lu 0x%04x\n", calls, e[i].e_to);
+			fprintf(fp, "0x%04x %llu\n", fn, t);
+		}
+		fputc('\n', fp);
+	}
+	free(e);
+	free(incl);
+	return(0);
+}
+
+/*
+ *	Write the call graph into file fn, as folded stacks if
+ *	folded is set, else in callgrind format
+ *
+ *	Output: 0 ok, 1 error
+ */
+int cg_write(char *fn, int folded)
+{
+	FILE *fp;
+	char *path;
+	int err = 0;
+
+	if (cg_node == NULL) {
+		puts("Call graph is empty");
+		return(1);
+	}
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	if (folded) {
+		if ((path = malloc(CG_MAXDEPTH * 24)) == NULL) {
+			fclose(fp);
+			return(1);
+		}
+		path[0] = '\0';
+		cg_charge(0);
+		cg_fold(fp, CG_ROOT, path, 0);
+		free(path);
+	} else
+		err = cg_callgrind(fp);
+	fclose(fp);
+	return(err);
+}
+
+#endif
@@ -42,6 +42,7 @@
 #include <memory.h>
 #include <ctype.h>
 #include <signal.h>
+#include <sysexits.h>
 #include "config.h"
 #include "global.h"
 
@@ -55,6 +56,7 @@ extern int load_file(char *);
 static void do_step(void);
 static void do_trace(char *);
 static void do_go(char *);
+static void do_snapat(char *);
 static int handel_break(void);
 static void do_dump(char *);
 static void do_list(char *);
@@ -68,8 +70,17 @@ static void print_reg(void);
 static void do_break(char *);
 static void do_hist(char *);
 static void do_count(char *);
-static void do_clock(void);
-static void timeout(int);
+static void do_tfile(char *);
+static void do_snap(char *);
+static void do_back(char *);
+static void do_tgoto(char *);
+static void do_prof(char *);
+static void do_cgraph(char *);
+static void do_cover(char *);
+static void do_clone(char *);
+static void do_sym(char *);
+static void do_dasm(char *);
+static void do_bench(char *);
 static void do_show(void);
 static void do_unix(char *);
 static void do_help(void);
@@ -80,28 +91,82 @@ struct termios old_term;
 /*
  *	The function "mon()" is the dialog user interface, called
  *	from the simulation just after program start.
+ *
+ *	In batch mode, with --script or if stdin is no terminal,
+ *	the commands are read without prompt, paging and terminal
+ *	settings, and the end of the script ends the monitor.
  */
 void mon(void)
 {
 	register int eoj = 1;
 	static char cmd[LENCMD];
+	FILE *fp = stdin;
 
-	tcgetattr(0, &old_term);
+	if (b_file != NULL && (fp = fopen(b_file, "r")) == NULL) {
+		printf("can't open file %s\n", b_file);
+		exit(EX_NOINPUT);
+	}
+	if (!b_flag)
+		tcgetattr(0, &old_term);
 
-	if (x_flag) {
-		if (load_file(xfn) == 0)
-			do_go("");
+	if (bn_arg != NULL) {
+		if (bench_run(bn_arg))
+			exit(EX_USAGE);
+		return;
+	}
+	if (ob_arg != NULL) {
+		if (opbench_run(ob_arg))
+			exit(EX_USAGE);
+		return;
+	}
+	if (pe_flag)
+		exit(lockstep_peer());
+	if (cp_arg != NULL)
+		exit(cpm_run(cp_arg));
+	if (ls_arg != NULL && fz_arg != NULL)
+		exit(lockstep_run(ls_arg, fz_arg));
+
+	if (x_flag && load_file(xfn)) {
+		if (ru_arg != NULL || rpc_path != NULL || gdb_arg != NULL
+		    || ls_arg != NULL)
+			exit(EX_NOINPUT);
+	} else if (ls_arg != NULL) {
+		exit(lockstep_run(ls_arg, NULL));
+	} else if (rpc_path != NULL) {
+		if (rpc_serve(rpc_path))
+			exit(EX_OSERR);
+		return;
+	} else if (gdb_arg != NULL) {
+		if (gdb_serve(gdb_arg))
+			exit(EX_OSERR);
+		return;
+	} else if (x_flag || r_flag) {
+		if (sa_arg != NULL) {
+			do_snapat(sa_arg);
+			return;
+		}
+		if (ru_arg != NULL) {
+			if (run_until(ru_arg) == EX_USAGE)
+				exit(EX_USAGE);
+			print_head();
+			print_reg();
+			return;
+		}
+		do_go("");
 	}
 	while (eoj) {
 		// these edits prevent a new cli prompt being printed at each interrupt
 		// TODO: find out why that happens in the first place
 		// (btw, that GOTO was here when i got here...) -jc
 
-		printf(">>> ");
+		if (!b_flag)
+			printf(">>> ");
     fflush(stdout);
 
 		next:
-		if (fgets(cmd, LENCMD, stdin) == NULL) { 
+		if (fgets(cmd, LENCMD, fp) == NULL) { 
+			if (b_flag)
+				break;
 			if (0==int_mode) putchar('\n');
 			goto next;
 		}
@@ -146,8 +211,38 @@ void mon(void)
 		case 'z':
 			do_count(cmd + 1);
 			break;
+		case 'T':
+			do_tfile(cmd + 1);
+			break;
+		case 'S':
+			do_snap(cmd + 1);
+			break;
+		case '<':
+			do_back(cmd + 1);
+			break;
+		case '@':
+			do_tgoto(cmd + 1);
+			break;
+		case 'P':
+			do_prof(cmd + 1);
+			break;
+		case 'C':
+			do_cgraph(cmd + 1);
+			break;
+		case 'O':
+			do_cover(cmd + 1);
+			break;
+		case 'F':
+			do_clone(cmd + 1);
+			break;
+		case 'y':
+			do_sym(cmd + 1);
+			break;
+		case 'L':
+			do_dasm(cmd + 1);
+			break;
 		case 'c':
-			do_clock();
+			do_bench(cmd + 1);
 			break;
 		case 's':
 			do_show();
@@ -229,8 +324,12 @@ static void do_go(char *s)
 {
 	while (isspace((int)*s))
 		s++;
-	if (isxdigit((int)*s))
+	if (isxdigit((int)*s)) {
 		PC = ram + exatoi(s);
+#ifdef SNSIZE
+		snap_dirty();
+#endif
+	}
 	cont:
 	cpu_state = CONTIN_RUN;
 	cpu_error = NONE;
@@ -244,6 +343,221 @@ static void do_go(char *s)
 	print_reg();
 }
 
+/*
+ *	Single step and run for the control socket, like the
+ *	commands but without output
+ *
+ *	Output: cpu_error
+ */
+int mon_step(void)
+{
+	cpu_state = SINGLE_STEP;
+	cpu_error = NONE;
+	cpu();
+	if (cpu_error == OPHALT)
+		handel_break();
+	return(cpu_error);
+}
+
+int mon_go(void)
+{
+	cont:
+	cpu_state = CONTIN_RUN;
+	cpu_error = NONE;
+	cpu();
+	if (cpu_error == OPHALT)
+		if (handel_break())
+			if (!cpu_error)
+				goto cont;
+	return(cpu_error);
+}
+
+/*
+ *	Set a breakpoint at adr for the control socket,
+ *	which stops at pass no. pass
+ *
+ *	Output: no. of the breakpoint, -1 if none is free
+ */
+int mon_break(WORD adr, int pass)
+{
+#ifdef SBSIZE
+	register int i;
+
+	for (i = 0; i < SBSIZE; i++)
+		if (soft[i].sb_pass == 0 || soft[i].sb_adr == adr)
+			break;
+	if (i == SBSIZE)
+		return(-1);
+	if (soft[i].sb_pass)
+		*(ram + soft[i].sb_adr) = soft[i].sb_oldopc;
+	soft[i].sb_adr = adr;
+	soft[i].sb_oldopc = *(ram + adr);
+	soft[i].sb_pass = (pass > 0) ? pass : 1;
+	soft[i].sb_passcount = 0;
+	*(ram + adr) = 0x76;
+#ifdef SNSIZE
+	snap_dirty();
+#endif
+	return(i);
+#else
+	return(-1);
+#endif
+}
+
+/*
+ *	Remove the breakpoint at adr
+ *
+ *	Output: 0 ok, 1 no breakpoint at adr
+ */
+int mon_clear(WORD adr)
+{
+#ifdef SBSIZE
+	register int i;
+
+	for (i = 0; i < SBSIZE; i++)
+		if (soft[i].sb_pass && soft[i].sb_adr == adr) {
+			*(ram + adr) = soft[i].sb_oldopc;
+			memset((char *) &soft[i], 0, sizeof(struct softbreak));
+#ifdef SNSIZE
+			snap_dirty();
+#endif
+			return(0);
+		}
+#endif
+	return(1);
+}
+
+/*
+ *	Run the program until the address, or the T-state if s
+ *	starts with @, or with "halt" until a HALT is reached.
+ *	Software breakpoints on the way are handled as usual, a
+ *	HALT or trap before the address or T-state stops it.
+ *	T-states already passed are reached with the snapshots.
+ *
+ *	Output: 0 reached, else the cpu_error which stopped the CPU,
+ *		or EX_USAGE if s is not usable
+ */
+int run_until(char *s)
+{
+	register WORD adr = 0;
+	register int halt = 0, at = 0;
+	BYTE old = 0;
+#ifdef WANT_TIM
+	unsigned long long ts = 0;
+	int fixed;
+#endif
+
+	while (isspace((int)*s))
+		s++;
+	if (*s == '@') {
+#ifdef WANT_TIM
+		ts = strtoull(s + 1, NULL, 0);
+		if (ts < cpu_tstates) {
+#ifdef SNSIZE
+			if (snap_tgoto(ts)) {
+				cpu_err_msg();
+				return(cpu_error);
+			}
+			return(cpu_error = NONE);
+#else
+			puts("T-states passed, going back needs snapshots");
+			puts("Please recompile with SNSIZE defined in config.h");
+			return(EX_USAGE);
+#endif
+		}
+		if (strcmp(core_name(&fixed), "fast") == 0 && fixed) {
+			puts("CPU emulation variant fast counts no T-states");
+			return(EX_USAGE);
+		}
+		if (ts == cpu_tstates)
+			return(cpu_error = NONE);
+		at = 1;
+#else
+		puts("Sorry, no T-state count available");
+		puts("Please recompile with WANT_TIM defined in config.h");
+		return(EX_USAGE);
+#endif
+	} else if (!(halt = (strncmp(s, "halt", 4) == 0)) &&
+		   !isxdigit((int)*s)) {
+		printf("can't run until %s\n", s);
+		return(EX_USAGE);
+	}
+	if (!halt && !at) {
+		adr = exatoi(s);
+		old = ram[adr];
+		ram[adr] = 0x76;	/* HALT like a breakpoint */
+	}
+	cont:
+	cpu_state = CONTIN_RUN;
+	cpu_error = NONE;
+#ifdef WANT_TIM
+	if (at)
+		cpu_tstop = ts;
+#endif
+	cpu();
+#ifdef WANT_TIM
+	cpu_tstop = ~0ULL;
+	if (cpu_halt) {			/* stopped while waiting in HALT, */
+		cpu_halt = 0;		/* back to it, the monitor waits */
+		PC--;			/* for interrupts in real time */
+	}
+#endif
+	if (cpu_error == OPHALT && !halt && !at && PC - ram - 1 == adr) {
+#ifdef HISIZE
+		hist_undo();
+#endif
+#ifdef WANT_TRACE
+		trace_undo();
+#endif
+#ifdef WANT_TIM
+		cpu_steps--;
+#endif
+		cpu_error = NONE;
+		PC--;
+	} else if (cpu_error == OPHALT && handel_break()) {
+		if (!cpu_error)
+			goto cont;
+	} else if (cpu_error == OPHALT && halt)
+		cpu_error = NONE;
+	if (!halt && !at) {
+		ram[adr] = old;
+#ifdef SNSIZE
+		snap_dirty();
+#endif
+	}
+	if (cpu_error != NONE) {
+		cpu_err_msg();
+		if (at)
+			printf("T-state %s not reached\n", s + 1);
+		else if (!halt)
+			printf("%04x not reached\n", adr);
+	}
+	return(cpu_error);
+}
+
+/*
+ *	Run the program until the address or, if s starts with @,
+ *	the T-state given in s is reached, then save everything into
+ *	a core file, so that later runs can start from there with
+ *	--restore. The name of the core file follows after a comma,
+ *	default is core.z80.
+ */
+static void do_snapat(char *s)
+{
+	register char *fn;
+
+	f_flag = 0;			/* run at full speed */
+	if ((fn = strchr(s, ',')) != NULL)
+		*fn++ = '\0';
+	else
+		fn = "core.z80";
+	if (run_until(s))
+		exit(1);
+	if (core_save(fn))
+		exit(1);
+	printf("Saved core file %s at %04x\n", fn, (unsigned int)(PC - ram));
+}
+
 /*
  *	Handling of software breakpoints (HALT opcode):
  *
@@ -262,9 +576,13 @@ static int handel_break(void)
 	return(0);
 	was_softbreak:
 #ifdef HISIZE
-	h_next--;			/* correct history */
-	if (h_next < 0)
-		h_next = 0;
+	hist_undo();			/* correct history */
+#endif
+#ifdef WANT_TRACE
+	trace_undo();			/* and trace */
+#endif
+#ifdef WANT_TIM
+	cpu_steps--;			/* and instruction count */
 #endif
 	break_address =	PC - ram - 1;	/* store adr of breakpoint */
 	cpu_error = NONE;		/* HALT	was a breakpoint */
@@ -322,12 +640,15 @@ static void do_dump(char *s)
 static void do_list(char *s)
 {
 	register int i;
+	char buf[LENCMD];
 
 	while (isspace((int)*s))
 		s++;
 	if (isxdigit((int)*s))
 		wrk_ram	= ram +	exatoi(s);
 	for (i = 0; i <	10; i++) {
+		if (*sym_str(wrk_ram - ram, 0, buf, sizeof(buf)))
+			printf("%s:\n", buf);
 		printf("%04x - ", (unsigned int)(wrk_ram - ram));
 		disass(&wrk_ram, wrk_ram - ram);
 		if (wrk_ram > ram + 65535)
@@ -358,6 +679,9 @@ static void do_modify(char *s)
 		}
 		if (!isxdigit((int)nv[0]))
 			break;
+#ifdef SNSIZE
+		snap_dirty();
+#endif
 		*wrk_ram++ = exatoi(nv);
 		if (wrk_ram > ram + 65535)
 			wrk_ram	= ram;
@@ -392,6 +716,9 @@ static void do_fill(char *s)
 		puts("value missing");
 		return;
 	}
+#ifdef SNSIZE
+	snap_dirty();
+#endif
 	while (i--) {
 		*p++ = val;
 		if (p >	ram + 65535)
@@ -427,6 +754,9 @@ static void do_move(char *s)
 		puts("count missing");
 		return;
 	}
+#ifdef SNSIZE
+	snap_dirty();
+#endif
 	while (count--)	{
 		*p2++ =	*p1++;
 		if (p1 > ram + 65535)
@@ -448,6 +778,9 @@ static void do_port(char *s)
 	while (isspace((int)*s))
 		s++;
 	port = exatoi(s);
+#ifdef SNSIZE
+	snap_dirty();
+#endif
 	printf("%02x = %02x : ", port, io_in(port));
 	fgets(nv, sizeof(nv), stdin);
 	if (isxdigit((int)*nv))
@@ -467,6 +800,9 @@ static void do_reg(char *s)
 		print_head();
 		print_reg();
 	} else {
+#ifdef SNSIZE
+		snap_dirty();
+#endif
 		if (strncmp(s, "bc'", 3) == 0) {
 			printf("BC' = %04x : ",	B_ * 256 + C_);
 			fgets(nv, sizeof(nv), stdin);
@@ -702,45 +1038,69 @@ static void do_hist(char *s)
 	puts("Sorry, no history available");
 	puts("Please recompile with HISIZE defined in config.h");
 #else
-	int i,	l, b, e, c, sa;
+	int l, c, sa;
+	struct histit it;
+	struct history h;
+	char buf[LENCMD];
 
 	while (isspace((int)*s))
 		s++;
 	switch (*s) {
 	case 'c':
-		memset((char *)	his, 0,	sizeof(struct history) * HISIZE);
-		h_next = 0;
-		h_flag = 0;
+		hist_clear();
+		break;
+	case 'o':
+		if (strncmp(s, "on", 2) == 0) {
+			if (hist_size() == 0 && h_size <= 0) {
+				puts("history size is 0, set it with h s n");
+				break;
+			}
+			if (hist_size() == 0 && hist_init(h_size)) {
+				puts("not enough memory for history");
+				break;
+			}
+			h_flag = 1;
+		} else if (strncmp(s, "off", 3) == 0)
+			h_flag = 0;
+		else
+			puts("what??");
+		break;
+	case 's':
+		s++;
+		while (isspace((int)*s))
+			s++;
+		if (*s == '\0') {
+			printf("History %s, %lu bytes for about %ld entrys\n",
+			       h_flag ? "on" : "off", hist_size(), h_size);
+			break;
+		}
+		h_size = atol(s);
+		if (hist_init(h_size))
+			puts("not enough memory for history");
 		break;
 	default:
-		if ((h_next == 0) && (h_flag ==	0)) {
+		if (hist_first(&it)) {
 			puts("History memory is empty");
 			break;
 		}
-		e = h_next;
-		b = (h_flag) ? h_next +	1 : 0;
 		l = 0;
-		while (isspace((int)*s))
-			s++;
 		if (*s)
 			sa = exatoi(s);
 		else
 			sa = -1;
-		for (i = b; i != e; i++) {
-			if (i == HISIZE)
-				i = 0;
+		while (hist_next(&it, &h) == 0) {
 			if (sa != -1) {
-				if (his[i].h_adr < sa)
+				if (h.h_adr < sa)
 					continue;
 				else
 					sa = -1;
 			}
-			printf("%04x AF=%04x BC=%04x DE=%04x HL=%04x IX=%04x IY=%04x SP=%04x\n",
-			       his[i].h_adr, his[i].h_af, his[i].h_bc,
-			       his[i].h_de, his[i].h_hl, his[i].h_ix,
-			       his[i].h_iy, his[i].h_sp);
+			printf("%04x AF=%04x BC=%04x DE=%04x HL=%04x IX=%04x IY=%04x SP=%04x %s\n",
+			       h.h_adr, h.h_af, h.h_bc, h.h_de, h.h_hl,
+			       h.h_ix, h.h_iy, h.h_sp,
+			       sym_str(h.h_adr, 0xffff, buf, sizeof(buf)));
 			l++;
-			if (l == 20) {
+			if (l == 20 && !b_flag) {
 				l = 0;
 				printf("q = quit, else continue: ");
 				c = getkey();
@@ -784,50 +1144,353 @@ static void do_count(char *s)
 }
 
 /*
- *	Calculate the clock frequency of the emulated CPU:
- *	into memory locations 0000H to 0002H the following
- *	code will be stored:
- *		LOOP: JP LOOP
- *	It uses 10 T states for each execution. A 3 secound
- *	timer is started and then the CPU. For every opcode
- *	fetch the R register is incremented by one and after
- *	the timer is down and stopps the emulation, the clock
- *	speed of the CPU is calculated with:
- *		f = R /	300000
+ *	Trace of executed instructions into a file
  */
-static void do_clock(void)
+static void do_tfile(char *s)
 {
-	static BYTE save[3];
+#ifndef	WANT_TRACE
+	puts("Sorry, no trace available");
+	puts("Please recompile with WANT_TRACE defined in config.h");
+#else
+	register char *p;
+	int z = 0;
 
-	save[0]	= *(ram	+ 0x0000);	/* save memory locations */
-	save[1]	= *(ram	+ 0x0001);	/* 0000H - 0002H */
-	save[2]	= *(ram	+ 0x0002);
-	*(ram +	0x0000)	= 0xc3;		/* store opcode JP 0000H at address */
-	*(ram +	0x0001)	= 0x00;		/* 0000H */
-	*(ram +	0x0002)	= 0x00;
-	PC = ram + 0x0000;		/* set PC to this code */
-	R = 0L;				/* clear refresh register */
-	cpu_state = CONTIN_RUN;		/* initialize CPU */
-	cpu_error = NONE;
-	signal(SIGALRM,	timeout);	/* initialize timer interrupt handler */
-	alarm(3);			/* start 3 secound timer */
-	cpu();				/* start CPU */
-	*(ram +	0x0000)	= save[0];	/* restore memory locations */
-	*(ram +	0x0001)	= save[1];	/* 0000H - 0002H */
-	*(ram +	0x0002)	= save[2];
-	if (cpu_error == NONE)
-		printf("clock frequency = %5.2f Mhz\n",	((float) R) / 300000.0);
+	while (isspace((int)*s))
+		s++;
+	if ((p = strchr(s, '\n')) != NULL)
+		*p = '\0';
+	if (*s == '\0') {
+		trace_stat();
+		return;
+	}
+	if (strcmp(s, "off") == 0) {
+		trace_close();
+		return;
+	}
+	if ((p = strchr(s, ',')) != NULL) {
+		*p++ = '\0';
+		z = (*p == 'z');
+	}
+	trace_open(s, z);
+#endif
+}
+
+/*
+ *	Snapshots for reverse execution
+ */
+static void do_snap(char *s)
+{
+#ifndef	SNSIZE
+	puts("Sorry, no snapshots available");
+	puts("Please recompile with SNSIZE defined in config.h");
+#else
+	while (isspace((int)*s))
+		s++;
+	if (*s == '\0')
+		snap_stat();
+	else if (*s == 'c')
+		snap_clear();
+	else if (strncmp(s, "on", 2) == 0)
+		snap_setint(-1L);
+	else
+		snap_setint(atol(s));
+#endif
+}
+
+/*
+ *	Reverse execution: go back count instructions,
+ *	or to the last breakpoint reached
+ */
+static void do_back(char *s)
+{
+#ifndef	SNSIZE
+	puts("Sorry, no reverse execution available");
+	puts("Please recompile with SNSIZE defined in config.h");
+#else
+	BYTE *p;
+	int err;
+
+	while (isspace((int)*s))
+		s++;
+	if (*s == 'g')
+		err = snap_rcont();
 	else
-		puts("Interrupted by user");
+		err = snap_rstep((*s == '\0') ? 1 : strtoull(s, NULL, 10));
+	if (err)
+		cpu_err_msg();
+	print_head();
+	print_reg();
+	p = PC;
+	disass(&p, p - ram);
+#endif
+}
+
+/*
+ *	Go to T-state, back or forward
+ */
+static void do_tgoto(char *s)
+{
+#ifndef	SNSIZE
+	puts("Sorry, no reverse execution available");
+	puts("Please recompile with SNSIZE defined in config.h");
+#else
+	BYTE *p;
+
+	while (isspace((int)*s))
+		s++;
+	if (!isdigit((int)*s)) {
+		puts("T-states missing");
+		return;
+	}
+	if (snap_tgoto(strtoull(s, NULL, 10)))
+		cpu_err_msg();
+	printf("T-states: %llu\n", cpu_tstates);
+	print_head();
+	print_reg();
+	p = PC;
+	disass(&p, p - ram);
+#endif
+}
+
+/*
+ *	Execution profiler
+ */
+static void do_prof(char *s)
+{
+#ifndef	WANT_PROF
+	puts("Sorry, no profiler available");
+	puts("Please recompile with WANT_PROF defined in config.h");
+#else
+	extern void prof_print(FILE *, int, int);
+	register char *p;
+	int type = 'a';
+
+	while (isspace((int)*s))
+		s++;
+	if ((p = strchr(s, '\n')) != NULL)
+		*p = '\0';
+	if (strcmp(s, "on") == 0) {
+		p_flag = 1;
+		return;
+	}
+	if (strcmp(s, "off") == 0) {
+		p_flag = 0;
+		return;
+	}
+	switch (*s) {
+	case 'c':
+		prof_clear();
+		return;
+	case 'w':
+		s++;
+		while (isspace((int)*s))
+			s++;
+		if (*s == '\0')
+			puts("filename missing");
+		else
+			prof_write(s);
+		return;
+	case 'a':
+	case 's':
+	case 'o':
+		type = *s++;
+		while (isspace((int)*s))
+			s++;
+		break;
+	}
+	printf("Profiler %s\n", p_flag ? "on" : "off");
+	prof_print(stdout, type, (*s) ? atoi(s) : 20);
+#endif
+}
+
+/*
+ *	Call graph profiler
+ */
+static void do_cgraph(char *s)
+{
+#ifndef	WANT_PROF
+	puts("Sorry, no profiler available");
+	puts("Please recompile with WANT_PROF defined in config.h");
+#else
+	register char *p;
+	int folded;
+
+	while (isspace((int)*s))
+		s++;
+	if ((p = strchr(s, '\n')) != NULL)
+		*p = '\0';
+	if (strcmp(s, "on") == 0) {
+		if (!cg_flag)
+			cg_clear();
+		cg_flag = 1;
+		return;
+	}
+	if (strcmp(s, "off") == 0) {
+		cg_flag = 0;
+		return;
+	}
+	switch (*s) {
+	case 'c':
+		cg_clear();
+		return;
+	case 'f':
+	case 'g':
+		folded = (*s++ == 'f');
+		while (isspace((int)*s))
+			s++;
+		if (*s == '\0')
+			puts("filename missing");
+		else
+			cg_write(s, folded);
+		return;
+	}
+	printf("Call graph %s\n", cg_flag ? "on" : "off");
+	cg_print((*s) ? atoi(s) : 20);
+#endif
+}
+
+/*
+ *	Code coverage
+ */
+static void do_cover(char *s)
+{
+#ifndef	WANT_COV
+	puts("Sorry, no code coverage available");
+	puts("Please recompile with WANT_COV defined in config.h");
+#else
+	register char *p;
+	int cmd;
+
+	while (isspace((int)*s))
+		s++;
+	if ((p = strchr(s, '\n')) != NULL)
+		*p = '\0';
+	if (strcmp(s, "on") == 0) {
+		cov_flag = 1;
+		return;
+	}
+	if (strcmp(s, "off") == 0) {
+		cov_flag = 0;
+		return;
+	}
+	switch (cmd = *s) {
+	case 'c':
+		cov_clear();
+		return;
+	case 'w':
+	case 'm':
+	case 'r':
+	case 'l':
+		s++;
+		while (isspace((int)*s))
+			s++;
+		if (*s == '\0') {
+			puts("filename missing");
+			return;
+		}
+		if (cmd == 'w')
+			cov_save(s, 0);
+		else if (cmd == 'm')
+			cov_merge(s);
+		else if (cmd == 'r')
+			cov_report(s, 0, NULL);
+		else {
+			if ((p = strchr(s, ',')) != NULL)
+				*p++ = '\0';
+			cov_report(s, 1, p);
+		}
+		return;
+	}
+	printf("Code coverage %s\n", cov_flag ? "on" : "off");
+	cov_stat();
+#endif
+}
+
+/*
+ *	Run clones of the machine: F count[,in[,out[,seconds]]]
+ */
+static void do_clone(char *s)
+{
+	register char *p;
+	char *arg[4];
+	register int i;
+
+	if ((p = strchr(s, '\n')) != NULL)
+		*p = '\0';
+	for (i = 0; i < 4; i++) {
+		while (isspace((int)*s))
+			s++;
+		arg[i] = (*s) ? s : NULL;
+		if ((p = strchr(s, ',')) != NULL) {
+			*p = '\0';
+			s = p + 1;
+		} else
+			s += strlen(s);
+	}
+	if (arg[0] == NULL || atoi(arg[0]) < 1) {
+		puts("no. of clones missing");
+		return;
+	}
+	clone_run(atoi(arg[0]), arg[1], arg[2], arg[3] ? atoi(arg[3]) : 0);
+}
+
+/*
+ *	Load symbols
+ */
+static void do_sym(char *s)
+{
+	register char *p;
+	int n;
+
+	while (isspace((int)*s))
+		s++;
+	if ((p = strchr(s, '\n')) != NULL)
+		*p = '\0';
+	if (*s == '\0') {
+		printf("%d symbols loaded\n", sym_count());
+		return;
+	}
+	if (*s == 'c' && s[1] == '\0') {
+		sym_clear();
+		return;
+	}
+	if ((n = sym_load(s)) >= 0)
+		printf("%d symbols loaded from %s\n", n, s);
+}
+
+/*
+ *	Disassemble the whole image into a file
+ */
+static void do_dasm(char *s)
+{
+	register char *p;
+	WORD ent[64];
+	int n = 0;
+
+	while (isspace((int)*s))
+		s++;
+	for (p = s; *p && *p != ',' && *p != '\n'; p++)
+		;
+	while (*p == ',' && n < 64) {
+		*p++ = '\0';
+		ent[n++] = exatoi(p);
+		while (*p && *p != ',')
+			p++;
+	}
+	*p = '\0';
+	dasm_image(*s ? s : NULL, ent, n);
 }
 
 /*
- *	This function is the signal handler for the timer interrupt.
- *	The CPU emulation is stopped here.
+ *	Benchmark of the emulation with synthetic workloads
  */
-static void timeout(int sig)
+static void do_bench(char *s)
 {
-	cpu_state = STOPPED;
+	register char *p;
+
+	if ((p = strchr(s, '\n')) != NULL)
+		*p = '\0';
+	bench_run(s);
 }
 
 /*
@@ -835,15 +1498,16 @@ static void timeout(int sig)
  */
 static void do_show(void)
 {
-	register int i;
+	register char *s;
+	int i;
 
 	printf("Release: %s\n",	RELEASE);
 #ifdef HISIZE
-	i = HISIZE;
+	printf("No. of entrys in history memory: %ld (%s)\n", h_size,
+	       h_flag ? "on" : "off");
 #else
-	i = 0;
+	printf("No. of entrys in history memory: 0\n");
 #endif
-	printf("No. of entrys in history memory: %d\n",	i);
 #ifdef SBSIZE
 	i = SBSIZE;
 #else
@@ -874,6 +1538,24 @@ static void do_show(void)
 	i = 0;
 #endif
 	printf("T-State counting %spossible\n",	i ? "" : "im");
+#ifdef WANT_TRACE
+	i = 1;
+#else
+	i = 0;
+#endif
+	printf("Trace into file %spossible\n", i ? "" : "im");
+#ifdef WANT_PROF
+	i = 1;
+#else
+	i = 0;
+#endif
+	printf("Profiler %spossible\n", i ? "" : "im");
+#ifdef WANT_COV
+	i = 1;
+#else
+	i = 0;
+#endif
+	printf("Code coverage %spossible\n", i ? "" : "im");
 #ifdef CNTL_C
 	i = 1;
 #else
@@ -886,6 +1568,11 @@ static void do_show(void)
 	i = 0;
 #endif
 	printf("CPU simulation %sstopped on cntl-\\\n",	i ? "" : "not ");
+	s = core_name(&i);
+	if (i)
+		printf("CPU emulation variant %s\n", s);
+	else
+		printf("CPU emulation variant %s (auto, %s)\n", s, core_why());
 }
 
 /*
@@ -920,9 +1607,35 @@ static void do_help(void)
 	puts("b[no] c                   clear soft breakpoint");
 	puts("h [address]               show history");
 	puts("h c                       clear history");
+	puts("h on|off                  switch history on/off");
+	puts("h s [entrys]              show/set size of history");
 	puts("z start,stop              set trigger adr for t-state count");
 	puts("z                         show t-state count");
-	puts("c                         measure clock frequency");
+	puts("T filename[,z]            trace into file, z = compressed");
+	puts("T [off]                   show/stop trace");
+	puts("S [on|T-states]           show/set snapshot interval, 0 = off");
+	puts("S c                       clear snapshots");
+	puts("< [count]                 reverse step program");
+	puts("<g                        reverse run to last breakpoint");
+	puts("@ T-states                go to T-state");
+	puts("P on|off                  switch profiler on/off");
+	puts("P [a|s|o] [count]         show profile of addresses/symbols/op-codes");
+	puts("P c                       clear profile");
+	puts("P w filename              write profile into file");
+	puts("C on|off                  switch call graph on/off");
+	puts("C [count]                 show subroutines of the call graph");
+	puts("C c                       clear call graph");
+	puts("C f|g filename            write folded stacks/callgrind file");
+	puts("O on|off                  switch code coverage on/off");
+	puts("O [c]                     show/clear code coverage");
+	puts("O w|m filename            save/merge coverage bitmaps");
+	puts("O r filename              write coverage report");
+	puts("O l filename[,listing]    write lcov report");
+	puts("F count[,in[,out[,secs]]] run clones, DART A from/to files in/out");
+	puts("y filename                load symbols");
+	puts("y [c]                     show/clear symbols");
+	puts("L [filename][,adr,...]    disassemble image from entry adr");
+	puts("c [secs][,filename]       run benchmark, results as JSON into file");
 	puts("s                         show settings");
 	puts("! command                 execute UNIX command");
 	puts("q                         quit");
@@ -966,6 +1679,9 @@ static void cpu_err_msg(void)
 	case USERINT:
 		puts("User Interrupt");
 		break;
+	case BPTRAP:
+		printf("gdb breakpoint at %04x\n", (unsigned int)(PC - ram));
+		break;
 	case POWEROFF:
 		break;
 	default:
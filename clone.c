@@ -0,0 +1,236 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module clones the running machine, to run it many times
+ *	from the same state with different inputs. Every clone is a
+ *	child process made with fork(), so the memory is shared copy
+ *	on write by the host and the CPU and the I/O devices are
+ *	copied. The DART channel A of clone i reads its input from a
+ *	file and writes its output into a file, the names are made
+ *	from patterns with the clone no., e.g. in.%d and out.%d.
+ *
+ *	As many clones as the host has CPUs run at the same time.
+ *	A clone runs until HALT, an error or the time limit, then
+ *	the parent prints the result of each clone.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "global.h"
+
+extern void cpu(void);
+extern void dart_files(int, int, int);
+
+#define CL_NOFILE	-1		/* c_err, file c_fn not opened */
+
+struct clres {				/* result of a clone */
+	int c_err;			/* cpu_error or CL_NOFILE */
+	char c_fn[LENCMD];
+	WORD c_pc;			/* PC at the end */
+	unsigned long long c_steps;	/* no. of executed instructions */
+};
+
+struct clone {
+	pid_t c_pid;
+	int c_fd;			/* pipe for the result */
+	int c_no;
+};
+
+static void cl_timeout(int sig)
+{
+	cpu_state = STOPPED;
+}
+
+/*
+ *	Check a pattern for file names, only one %d for the clone no.
+ *	and %% are allowed
+ *
+ *	Output: 0 ok, 1 not usable
+ */
+static int cl_check(char *pat)
+{
+	register char *p;
+	register int n = 0;
+
+	if (strlen(pat) > LENCMD - 12)
+		return(1);
+	for (p = pat; *p; p++)
+		if (*p == '%') {
+			if (*++p == 'd')
+				n++;
+			else if (*p != '%')
+				return(1);
+		}
+	return(n > 1);
+}
+
+/*
+ *	File name of clone no. i from the pattern pat, checked with
+ *	cl_check()
+ */
+static void cl_name(char *fn, char *pat, int i)
+{
+	for (; *pat; pat++)
+		if (*pat != '%')
+			*fn++ = *pat;
+		else if (*++pat == 'd')
+			fn += sprintf(fn, "%d", i);
+		else
+			*fn++ = '%';
+	*fn = '\0';
+}
+
+/*
+ *	Run clone no. i, this is the child process
+ */
+static void cl_child(int i, int fd, char *in, char *out, int secs)
+{
+	struct clres r;
+	int ifd, ofd, nfd;
+#ifdef WANT_TIM
+	unsigned long long start = cpu_steps;
+#endif
+
+	memset(&r, 0, sizeof(r));
+	nfd = open("/dev/null", O_RDWR);
+	ifd = ofd = nfd;
+	if (in != NULL) {
+		cl_name(r.c_fn, in, i);
+		if ((ifd = open(r.c_fn, O_RDONLY)) == -1)
+			goto nofile;
+	}
+	if (out != NULL) {
+		cl_name(r.c_fn, out, i);
+		if ((ofd = open(r.c_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644))
+		    == -1)
+			goto nofile;
+	}
+	dart_files(0, ifd, ofd);	/* no sockets in the clones */
+	dart_files(1, nfd, nfd);
+	dup2(nfd, 1);
+#ifdef WANT_TRACE
+	tr_flag = 0;			/* the writer thread is in the parent */
+#endif
+#ifdef SNSIZE
+	snap_clear();
+#endif
+	f_flag = 0;
+	tc_flag = 1;			/* instructions of the result */
+	if (secs) {
+		signal(SIGALRM, cl_timeout);
+		alarm(secs);
+	}
+	cpu_state = CONTIN_RUN;
+	cpu_error = NONE;
+	cpu();
+	r.c_err = cpu_error;
+	r.c_pc = PC - ram;
+#ifdef WANT_TIM
+	r.c_steps = cpu_steps - start;
+#endif
+	write(fd, &r, sizeof(r));
+	_exit(cpu_error != NONE && cpu_error != OPHALT);
+
+	nofile:
+	r.c_err = CL_NOFILE;
+	write(fd, &r, sizeof(r));
+	_exit(1);
+}
+
+/*
+ *	Print the result of a clone
+ */
+static void cl_result(struct clone *c)
+{
+	struct clres r;
+	int status;
+
+	waitpid(c->c_pid, &status, 0);
+	if (read(c->c_fd, &r, sizeof(r)) != sizeof(r)) {
+		printf("%5d  died\n", c->c_no);
+	} else if (r.c_err == CL_NOFILE) {
+		printf("%5d  can't open file %s\n", c->c_no, r.c_fn);
+	} else {
+		printf("%5d  %04x  %12llu  ", c->c_no, r.c_pc, r.c_steps);
+		switch (r.c_err) {
+		case NONE:
+			puts("time limit");
+			break;
+		case OPHALT:
+			puts("HALT");
+			break;
+		default:
+			printf("error %d\n", r.c_err);
+			break;
+		}
+	}
+	close(c->c_fd);
+}
+
+/*
+ *	Run n clones of the machine, in and out are the patterns for
+ *	the DART files, NULL for none, secs is the time limit of a
+ *	clone in seconds, 0 for no limit
+ *
+ *	Output: 0 ok, 1 error
+ */
+int clone_run(int n, char *in, char *out, int secs)
+{
+	struct clone *c;
+	register int i, next = 0, done = 0;
+	int par, fd[2];
+
+	if ((in != NULL && cl_check(in)) || (out != NULL && cl_check(out))) {
+		puts("file names may only have one %d for the clone no. and %% for a %");
+		return(1);
+	}
+	if ((par = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		par = 1;
+	if ((c = calloc(par, sizeof(struct clone))) == NULL) {
+		puts("not enough memory for clones");
+		return(1);
+	}
+	fflush(stdout);
+	puts("Clone  PC    Instructions  Result");
+	while (done < n) {
+		while (next < n && next - done < par) {
+			if (pipe(fd) == -1) {
+				perror("pipe");
+				n = next;
+				break;
+			}
+			i = next % par;
+			fflush(stdout);
+			if ((c[i].c_pid = fork()) == 0) {
+				close(fd[0]);
+				cl_child(next, fd[1], in, out, secs);
+			}
+			close(fd[1]);
+			if (c[i].c_pid == -1) {
+				perror("fork");
+				close(fd[0]);
+				n = next;
+				break;
+			}
+			c[i].c_fd = fd[0];
+			c[i].c_no = next++;
+		}
+		if (done < next)
+			cl_result(&c[done++ % par]);
+	}
+	free(c);
+	return(0);
+}
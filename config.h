@@ -39,8 +39,12 @@
 #define	CNTL_C		/* cntl-c will stop running emulation */
 #define	CNTL_BS		/* cntl-\ will stop running emulation */
 #define	WANT_TIM	/* activate runtime measurement */
-#define	HISIZE	100	/* number of entrys in history */
+#define	HISIZE	100	/* default number of entrys in history */
+#define	WANT_TRACE	/* trace of executed instructions into files */
+#define	WANT_PROF	/* execution profiler, needs WANT_TIM */
+#define	WANT_COV	/* code coverage */
 #define	SBSIZE	4	/* number of software breakpoints */
+#define	SNSIZE	64	/* number of snapshots, needs WANT_TIM */
 /*#define FRONTPANEL*/	/* no frontpanel emulation */
 /*#define BUS_8080*/	/* no emulation of 8080 bus status */
 #define WANT_COUNTERS // enable counter management
@@ -69,6 +73,7 @@
 #define	RELEASE	"1.17"
 
 #define	LENCMD		80		/* length of command buffers etc */
+#define	DISLEN		128		/* length of a disassembled op-code */
 
 #define	S_FLAG		128		/* bit definitions of CPU flags */
 #define	Z_FLAG		64
@@ -101,6 +106,7 @@
 #define	OPTRAP2		5		/* illegal 2 byte op-code trap */
 #define	OPTRAP4		6		/* illegal 4 byte op-code trap */
 #define	USERINT		7		/* user	interrupt */
+#define	BPTRAP		8		/* breakpoint or watchpoint of gdb */
 #define POWEROFF	255		/* CPU off, no error */
 
 					/* type of CPU interrupt */
@@ -122,6 +128,11 @@ struct history {			/* structure of a history entry */
 	WORD	h_iy;			/* register IY */
 	WORD	h_sp;			/* register SP */
 };
+
+struct histit {				/* iterator over the history memory */
+	unsigned long long hi_off;	/* offset of next record */
+	WORD	hi_reg[7];		/* registers decoded so far */
+};
 #endif
 
 #ifdef SBSIZE
@@ -0,0 +1,315 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module saves and loads the state of the simulation in
+ *	core files. A core file has a header with version and the
+ *	sizes of the blocks following, and a CRC32 over the blocks:
+ *
+ *		header	CORE_HDRSIZE bytes
+ *		CPU	CORE_CPUSIZE bytes, registers, PC and SP as
+ *			Z80 addresses, interrupt state and counters
+ *		I/O	state of the PIO, CTC and DART, see io_export()
+ *		memory	65536 bytes
+ *
+ *	All values are little endian, so that the files can be used
+ *	on other hosts and with other builds. A file is written with
+ *	a single writev() and loaded with mmap(), core_image() and
+ *	core_restore() do the same in memory for the library.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "config.h"
+#include "global.h"
+
+#define CORE_MAGIC	"Z80CORE\n"
+#define CORE_VERSION	1
+#define CORE_HDRSIZE	32
+#define CORE_CPUSIZE	64
+
+extern size_t io_export(BYTE *);
+extern int io_import(BYTE *, size_t);
+
+static unsigned long crc_tab[256];
+
+static void put16(BYTE *p, unsigned v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(BYTE *p, unsigned long v)
+{
+	put16(p, v & 0xffff);
+	put16(p + 2, (v >> 16) & 0xffff);
+}
+
+#ifdef WANT_TIM
+static void put64(BYTE *p, unsigned long long v)
+{
+	put32(p, v & 0xffffffffUL);
+	put32(p + 4, (v >> 32) & 0xffffffffUL);
+}
+#endif
+
+static unsigned get16(BYTE *p)
+{
+	return(p[0] | (p[1] << 8));
+}
+
+static unsigned long get32(BYTE *p)
+{
+	return(get16(p) | ((unsigned long) get16(p + 2) << 16));
+}
+
+#ifdef WANT_TIM
+static unsigned long long get64(BYTE *p)
+{
+	return(get32(p) | ((unsigned long long) get32(p + 4) << 32));
+}
+#endif
+
+/*
+ *	CRC32 of n bytes at p, continued from crc
+ */
+static unsigned long crc32(unsigned long crc, BYTE *p, size_t n)
+{
+	register int i, j;
+	register unsigned long c;
+
+	if (crc_tab[1] == 0)
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+			crc_tab[i] = c;
+		}
+	crc ^= 0xffffffffUL;
+	while (n--)
+		crc = crc_tab[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return(crc ^ 0xffffffffUL);
+}
+
+/*
+ *	The CPU block of a core file
+ */
+static void co_getcpu(BYTE *cpu)
+{
+	memset(cpu, 0, CORE_CPUSIZE);
+	cpu[0] = A; cpu[1] = F; cpu[2] = B; cpu[3] = C;
+	cpu[4] = D; cpu[5] = E; cpu[6] = H; cpu[7] = L;
+	cpu[8] = A_; cpu[9] = F_; cpu[10] = B_; cpu[11] = C_;
+	cpu[12] = D_; cpu[13] = E_; cpu[14] = H_; cpu[15] = L_;
+	cpu[16] = I;
+	cpu[17] = IFF;
+	put32(cpu + 18, R);
+	put16(cpu + 22, IX);
+	put16(cpu + 24, IY);
+	put16(cpu + 26, PC - ram);
+	put16(cpu + 28, STACK - ram);
+	cpu[30] = int_mode;
+	cpu[31] = int_type;
+	cpu[32] = int_lsb;
+#ifdef WANT_TIM
+	cpu[33] = cpu_halt;
+	put64(cpu + 40, t_states);
+	put64(cpu + 48, cpu_steps);
+	put64(cpu + 56, cpu_tstates);
+#endif
+}
+
+/*
+ *	Set the CPU from the CPU block of a core file
+ */
+static void co_setcpu(BYTE *cpu)
+{
+	A = cpu[0]; F = cpu[1]; B = cpu[2]; C = cpu[3];
+	D = cpu[4]; E = cpu[5]; H = cpu[6]; L = cpu[7];
+	A_ = cpu[8]; F_ = cpu[9]; B_ = cpu[10]; C_ = cpu[11];
+	D_ = cpu[12]; E_ = cpu[13]; H_ = cpu[14]; L_ = cpu[15];
+	I = cpu[16];
+	IFF = cpu[17];
+	R = get32(cpu + 18);
+	IX = get16(cpu + 22);
+	IY = get16(cpu + 24);
+	PC = ram + get16(cpu + 26);
+	STACK = ram + get16(cpu + 28);
+	int_mode = cpu[30];
+	int_type = cpu[31];
+	int_lsb = cpu[32];
+#ifdef WANT_TIM
+	cpu_halt = cpu[33];
+	t_states = get64(cpu + 40);
+	cpu_steps = get64(cpu + 48);
+	cpu_tstates = get64(cpu + 56);
+#endif
+}
+
+/*
+ *	The header of a core file with n bytes I/O state
+ */
+static void co_header(BYTE *hdr, BYTE *cpu, BYTE *io, size_t n)
+{
+	unsigned long crc;
+
+	crc = crc32(0, cpu, CORE_CPUSIZE);
+	crc = crc32(crc, io, n);
+	crc = crc32(crc, ram, 65536);
+	memset(hdr, 0, CORE_HDRSIZE);
+	memcpy(hdr, CORE_MAGIC, 8);
+	put16(hdr + 8, CORE_VERSION);
+	put16(hdr + 10, CORE_HDRSIZE);
+	put32(hdr + 12, CORE_CPUSIZE);
+	put32(hdr + 16, n);
+	put32(hdr + 20, 65536);
+	put32(hdr + 24, crc);
+}
+
+/*
+ *	Save the CPU, the I/O devices and the memory into file fn
+ *
+ *	Output: 0 ok, 1 error
+ */
+int core_save(char *fn)
+{
+	BYTE hdr[CORE_HDRSIZE], cpu[CORE_CPUSIZE], *io;
+	struct iovec iov[4];
+	size_t n;
+	int fd, err = 0;
+
+	co_getcpu(cpu);
+	if ((io = malloc(io_export(NULL))) == NULL) {
+		puts("not enough memory for core file");
+		return(1);
+	}
+	n = io_export(io);
+	co_header(hdr, cpu, io, n);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = cpu;
+	iov[1].iov_len = sizeof(cpu);
+	iov[2].iov_base = io;
+	iov[2].iov_len = n;
+	iov[3].iov_base = ram;
+	iov[3].iov_len = 65536;
+	if ((fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1) {
+		printf("can't open file %s\n", fn);
+		free(io);
+		return(1);
+	}
+	if (writev(fd, iov, 4) != sizeof(hdr) + sizeof(cpu) + n + 65536) {
+		printf("can't write file %s\n", fn);
+		err = 1;
+	}
+	close(fd);
+	free(io);
+	return(err);
+}
+
+/*
+ *	Write the core file image into the buffer p,
+ *	with p NULL only the size is returned
+ *
+ *	Output: size of the image
+ */
+size_t core_image(BYTE *p)
+{
+	register size_t n = io_export(NULL);
+	BYTE *cpu, *io;
+
+	if (p == NULL)
+		return(CORE_HDRSIZE + CORE_CPUSIZE + n + 65536);
+	cpu = p + CORE_HDRSIZE;
+	io = cpu + CORE_CPUSIZE;
+	co_getcpu(cpu);
+	n = io_export(io);
+	memcpy(io + n, ram, 65536);
+	co_header(p, cpu, io, n);
+	return(CORE_HDRSIZE + CORE_CPUSIZE + n + 65536);
+}
+
+/*
+ *	Load the CPU, the I/O devices and the memory from the core
+ *	file image p with n bytes, fn is the name for the messages
+ *
+ *	Output: 0 ok, 1 error
+ */
+int core_restore(BYTE *p, size_t n, char *fn)
+{
+	BYTE *cpu, *io;
+	size_t hs, cs, is, rs;
+
+	if (n < CORE_HDRSIZE || memcmp(p, CORE_MAGIC, 8) != 0) {
+		printf("%s is not a core file\n", fn);
+		return(1);
+	}
+	hs = get16(p + 10);
+	cs = get32(p + 12);
+	is = get32(p + 16);
+	rs = get32(p + 20);
+	if (get16(p + 8) > CORE_VERSION) {
+		printf("%s has core file version %u, only %d supported\n",
+		       fn, get16(p + 8), CORE_VERSION);
+		return(1);
+	}
+	if (hs < CORE_HDRSIZE || cs < CORE_CPUSIZE || rs != 65536 ||
+	    hs + cs + is + rs != n) {
+		printf("%s is truncated or damaged\n", fn);
+		return(1);
+	}
+	if (crc32(0, p + hs, cs + is + rs) != get32(p + 24)) {
+		printf("checksum error in %s\n", fn);
+		return(1);
+	}
+	cpu = p + hs;
+	io = cpu + cs;
+	co_setcpu(cpu);
+	if (io_import(io, is))
+		printf("I/O devices in %s don't match, not loaded\n", fn);
+	memcpy(ram, io + is, 65536);
+#ifdef SNSIZE
+	snap_dirty();
+#endif
+	return(0);
+}
+
+/*
+ *	Load the CPU, the I/O devices and the memory from file fn
+ *
+ *	Output: 0 ok, 1 error
+ */
+int core_load(char *fn)
+{
+	struct stat st;
+	BYTE *p;
+	int fd, err;
+
+	if ((fd = open(fn, O_RDONLY)) == -1) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	if (fstat(fd, &st) == -1 || st.st_size < CORE_HDRSIZE ||
+	    (p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+	    == MAP_FAILED) {
+		printf("%s is not a core file\n", fn);
+		close(fd);
+		return(1);
+	}
+	close(fd);
+	err = core_restore(p, st.st_size, fn);
+	munmap(p, st.st_size);
+	return(err);
+}
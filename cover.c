@@ -0,0 +1,397 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module contains the code coverage. For all 64K of memory
+ *	bitmaps are kept for the bytes fetched as op-code, the bytes
+ *	used as operands and, at the address of a conditional JR, JP,
+ *	CALL, RET or DJNZ, for the branch taken and not taken.
+ *
+ *	The bitmaps are saved in a file, saving with merge ORs them
+ *	into the file under a lock, so that many simulations running
+ *	in parallel can collect into one file. Reports are written
+ *	plain, or in lcov format mapped back to the lines of an
+ *	assembler listing or to the symbols loaded.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include "config.h"
+#include "global.h"
+
+#ifdef WANT_COV
+
+#define C_OPC	0		/* bitmap op-code bytes */
+#define C_ARG	1		/* bitmap operand bytes */
+#define C_TAKEN	2		/* bitmap branches taken */
+#define C_NOT	3		/* bitmap branches not taken */
+#define C_NMAP	4
+
+#define C_MAGIC	"Z80COV01"
+
+#define C_SET(m, a)	(c_map[m][(a) >> 3] |= 1 << ((a) & 7))
+#define C_TST(m, a)	(c_map[m][(a) >> 3] & (1 << ((a) & 7)))
+
+static BYTE c_map[C_NMAP][8192];
+
+extern int opsize(unsigned char *, int);
+extern int load_test(WORD);
+
+/*
+ *	Length of a conditional branch op-code, 0 if the
+ *	op-code isn't one
+ */
+static int c_cond(BYTE op)
+{
+	switch (op) {
+	case 0x10:			/* DJNZ */
+	case 0x20:			/* JR cc */
+	case 0x28:
+	case 0x30:
+	case 0x38:
+		return(2);
+	}
+	switch (op & 0xc7) {
+	case 0xc0:			/* RET cc */
+		return(1);
+	case 0xc2:			/* JP cc */
+	case 0xc4:			/* CALL cc */
+		return(3);
+	}
+	return(0);
+}
+
+/*
+ *	Count the instruction at pc, called from the CPU emulation
+ *	after the execution, so that PC is the next instruction
+ */
+void cov_put(WORD pc)
+{
+	register int i, n;
+
+	if (!C_TST(C_OPC, pc)) {
+		C_SET(C_OPC, pc);
+		n = opsize(ram, pc);
+		for (i = 1; i < n; i++)
+			C_SET(C_ARG, (WORD) (pc + i));
+	}
+	if ((n = c_cond(ram[pc])) != 0) {
+		if (PC - ram == (WORD) (pc + n))
+			C_SET(C_NOT, pc);
+		else
+			C_SET(C_TAKEN, pc);
+	}
+}
+
+/*
+ *	Clear all bitmaps
+ */
+void cov_clear(void)
+{
+	memset(c_map, 0, sizeof(c_map));
+}
+
+static int c_count(int m)
+{
+	register int i, n = 0;
+
+	for (i = 0; i < 65536; i++)
+		if (C_TST(m, i))
+			n++;
+	return(n);
+}
+
+/*
+ *	Print a summary
+ */
+void cov_stat(void)
+{
+	register int i;
+	int both = 0, one = 0;
+
+	for (i = 0; i < 65536; i++) {
+		if (C_TST(C_TAKEN, i) && C_TST(C_NOT, i))
+			both++;
+		else if (C_TST(C_TAKEN, i) || C_TST(C_NOT, i))
+			one++;
+	}
+	printf("Op-code bytes: %d, operand bytes: %d\n", c_count(C_OPC),
+	       c_count(C_ARG));
+	printf("Conditional branches: %d both ways, %d one way only\n",
+	       both, one);
+}
+
+/*
+ *	Save the bitmaps into file fn, with merge set the
+ *	bitmaps already in the file are ORed in first
+ *
+ *	Output: 0 ok, 1 error
+ */
+int cov_save(char *fn, int merge)
+{
+	static BYTE buf[sizeof(c_map)];
+	char magic[8];
+	register int i, fd;
+	int err = 0;
+
+	if ((fd = open(fn, O_RDWR | O_CREAT, 0644)) == -1) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	flock(fd, LOCK_EX);
+	if (merge && read(fd, magic, 8) == 8 &&
+	    memcmp(magic, C_MAGIC, 8) == 0 &&
+	    read(fd, buf, sizeof(buf)) == sizeof(buf))
+		for (i = 0; i < sizeof(buf); i++)
+			buf[i] |= ((BYTE *) c_map)[i];
+	else
+		memcpy(buf, c_map, sizeof(buf));
+	if (lseek(fd, 0, SEEK_SET) != 0 || ftruncate(fd, 0) == -1 ||
+	    write(fd, C_MAGIC, 8) != 8 ||
+	    write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+		printf("can't write file %s\n", fn);
+		err = 1;
+	}
+	flock(fd, LOCK_UN);
+	close(fd);
+	return(err);
+}
+
+/*
+ *	OR the bitmaps of file fn into the bitmaps
+ *
+ *	Output: 0 ok, 1 error
+ */
+int cov_merge(char *fn)
+{
+	static BYTE buf[sizeof(c_map)];
+	char magic[8];
+	register int i, fd;
+	int err = 0;
+
+	if ((fd = open(fn, O_RDONLY)) == -1) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	flock(fd, LOCK_SH);
+	if (read(fd, magic, 8) != 8 || memcmp(magic, C_MAGIC, 8) != 0 ||
+	    read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+		printf("%s is not a coverage file\n", fn);
+		err = 1;
+	} else
+		for (i = 0; i < sizeof(buf); i++)
+			((BYTE *) c_map)[i] |= buf[i];
+	flock(fd, LOCK_UN);
+	close(fd);
+	return(err);
+}
+
+/*
+ *	Print the symbol of address adr
+ */
+static void c_sym(FILE *fp, WORD adr)
+{
+	char *s;
+	int off;
+
+	if ((s = sym_lookup(adr, &off)) != NULL) {
+		if (off)
+			fprintf(fp, "  %s+%x", s, off);
+		else
+			fprintf(fp, "  %s", s);
+	}
+}
+
+/*
+ *	Plain report: the ranges of executed code and the
+ *	conditional branches only taken in one direction
+ */
+static void c_plain(FILE *fp)
+{
+	register int i, j;
+
+	fprintf(fp, "Executed code:\n");
+	for (i = 0; i < 65536; i = j) {
+		if (!C_TST(C_OPC, i)) {
+			j = i + 1;
+			continue;
+		}
+		for (j = i + 1; j < 65536 && (C_TST(C_OPC, j) ||
+		     C_TST(C_ARG, j)); j++)
+			;
+		fprintf(fp, "%04x-%04x", i, j - 1);
+		c_sym(fp, i);
+		fputc('\n', fp);
+	}
+	fprintf(fp, "\nBranches taken one way only:\n");
+	for (i = 0; i < 65536; i++)
+		if (C_TST(C_TAKEN, i) != 0 && C_TST(C_NOT, i) == 0) {
+			fprintf(fp, "%04x", i);
+			c_sym(fp, i);
+			fprintf(fp, "  always taken\n");
+		} else if (C_TST(C_TAKEN, i) == 0 && C_TST(C_NOT, i) != 0) {
+			fprintf(fp, "%04x", i);
+			c_sym(fp, i);
+			fprintf(fp, "  never taken\n");
+		}
+}
+
+/*
+ *	Write the branch records of address adr in lcov format
+ */
+static void c_brda(FILE *fp, int line, WORD adr)
+{
+	if (!C_TST(C_OPC, adr) || !c_cond(ram[adr]))
+		return;
+	fprintf(fp, "BRDA:%d,0,0,%d\n", line, C_TST(C_TAKEN, adr) ? 1 : 0);
+	fprintf(fp, "BRDA:%d,0,1,%d\n", line, C_TST(C_NOT, adr) ? 1 : 0);
+}
+
+/*
+ *	lcov report for an assembler listing: every line which starts
+ *	with an address followed by object code is a source line
+ */
+static int c_lcov_lst(FILE *fp, char *lst)
+{
+	FILE *lp;
+	char line[LENCMD * 2], *p, *q;
+	register int n = 0, hit;
+	unsigned long adr;
+	int lf = 0, lh = 0;
+
+	if ((lp = fopen(lst, "r")) == NULL) {
+		printf("can't open file %s\n", lst);
+		return(1);
+	}
+	fprintf(fp, "TN:\nSF:%s\n", lst);
+	while (fgets(line, sizeof(line), lp) != NULL) {
+		n++;
+		p = line;
+		while (isspace((int)*p))
+			p++;
+		adr = strtoul(p, &q, 16);
+		if (q - p != 4 || adr > 0xffff)
+			continue;
+		if (*q == ':')
+			q++;
+		while (*q == ' ' || *q == '\t')
+			q++;
+		if (!isxdigit((int)q[0]) || !isxdigit((int)q[1]) ||
+		    isxdigit((int)q[2]))
+			continue;
+		hit = C_TST(C_OPC, adr) != 0;
+		if (!hit && C_TST(C_ARG, adr))	/* continued line */
+			continue;
+		fprintf(fp, "DA:%d,%d\n", n, hit);
+		c_brda(fp, n, adr);
+		lf++;
+		if (hit)
+			lh++;
+	}
+	fclose(lp);
+	fprintf(fp, "LF:%d\nLH:%d\nend_of_record\n", lf, lh);
+	return(0);
+}
+
+/*
+ *	lcov report without listing: the memory is the source file,
+ *	line n is address n-1, the symbols are the functions. Code
+ *	not executed are the loaded bytes, or without a file loaded
+ *	the bytes from the first symbol on, with one line for each
+ *	op-code, operands of it are skipped. If neither is known,
+ *	there are no lines, only the functions.
+ */
+static void c_lcov_mem(FILE *fp)
+{
+	register int i, j, hit;
+	char *s;
+	WORD adr, end;
+	long lim, code = 65536;
+	int lf = 0, lh = 0, fnf = 0, fnh = 0, ld = 0, len;
+
+	fprintf(fp, "TN:\nSF:z80sim\n");
+	for (i = 0; (s = sym_get(i, &adr)) != NULL; i++)
+		fprintf(fp, "FN:%d,%s\n", adr + 1, s);
+	for (i = 0; (s = sym_get(i, &adr)) != NULL; i++) {
+		if (i == 0)
+			code = adr;
+		lim = (sym_get(i + 1, &end) != NULL) ? end : 65536;
+		hit = 0;
+		for (j = adr; j < lim; j++)
+			if (C_TST(C_OPC, j)) {
+				hit = 1;
+				break;
+			}
+		fprintf(fp, "FNDA:%d,%s\n", hit, s);
+		fnf++;
+		if (hit)
+			fnh++;
+	}
+	fprintf(fp, "FNF:%d\nFNH:%d\n", fnf, fnh);
+	for (i = 0; i < 65536 && !ld; i++)
+		ld = load_test(i);
+	if (!ld && code == 65536) {
+		puts("no file loaded and no symbols, lcov report without lines");
+		fprintf(fp, "end_of_record\n");
+		return;
+	}
+	for (i = 0; i < 65536; i += len) {
+		len = 1;
+		if (C_TST(C_OPC, i))
+			hit = 1;
+		else if (C_TST(C_ARG, i) || (ld ? !load_test(i) : i < code))
+			continue;
+		else {			/* op-code not executed */
+			hit = 0;
+			for (len = opsize(ram, i), j = 1; j < len; j++)
+				if (i + j > 65535 || C_TST(C_OPC, i + j) ||
+				    C_TST(C_ARG, i + j))
+					break;
+			len = j;
+		}
+		fprintf(fp, "DA:%d,%d\n", i + 1, hit);
+		c_brda(fp, i + 1, i);
+		lf++;
+		if (hit)
+			lh++;
+	}
+	fprintf(fp, "LF:%d\nLH:%d\nend_of_record\n", lf, lh);
+}
+
+/*
+ *	Write a report into file fn, plain if lcov isn't set,
+ *	else in lcov format, with the lines from the assembler
+ *	listing lst if not NULL
+ *
+ *	Output: 0 ok, 1 error
+ */
+int cov_report(char *fn, int lcov, char *lst)
+{
+	FILE *fp;
+	int err = 0;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	if (!lcov)
+		c_plain(fp);
+	else if (lst != NULL)
+		err = c_lcov_lst(fp, lst);
+	else
+		c_lcov_mem(fp);
+	fclose(fp);
+	return(err);
+}
+
+#endif
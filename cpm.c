@@ -0,0 +1,172 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module runs CP/M COM files without CP/M, for instruction
+ *	exercisers like zexdoc and zexall. The COM file is loaded at
+ *	0100H, the BDOS entry at 0005H jumps to a trap at CP_BDOS and
+ *	the warm boot at 0000H is a trap, both are ED FF op-codes which
+ *	stop the CPU. The BDOS console functions 2 and 9 are done here,
+ *	the output goes to stdout. The word at 0006H is the top of the
+ *	memory, as in CP/M.
+ *
+ *	Every line of the output with OK or ERROR is the result of a
+ *	test group, it is shown with the time since the result before.
+ *	At the end the no. of passed and failed groups and the total
+ *	time are shown.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sysexits.h>
+#include "config.h"
+#include "global.h"
+
+#define CP_TPA		0x0100		/* load address of COM files */
+#define CP_BDOS		0xfe00		/* trap of the BDOS */
+#define CP_LINE		256		/* max. length of an output line */
+
+extern void cpu(void);
+
+static char cp_line[CP_LINE];		/* output line of the program */
+static int cp_pos;
+static int cp_ok, cp_err;		/* passed and failed test groups */
+static double cp_start, cp_last;	/* time of start and last result */
+
+static double cp_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*
+ *	Output of a character, at the end of a line check for a result
+ */
+static void cp_putc(int c)
+{
+	double t;
+
+	if (c == '\r')
+		return;
+	if (c != '\n') {
+		putchar(c);
+		if (cp_pos < CP_LINE - 1)
+			cp_line[cp_pos++] = c;
+		return;
+	}
+	cp_line[cp_pos] = '\0';
+	cp_pos = 0;
+	if (strstr(cp_line, "ERROR") != NULL || strstr(cp_line, "OK") != NULL) {
+		if (strstr(cp_line, "ERROR") != NULL)
+			cp_err++;
+		else
+			cp_ok++;
+		t = cp_secs();
+		printf("  (%.2f s)", t - cp_last);
+		cp_last = t;
+	}
+	putchar('\n');
+	fflush(stdout);
+}
+
+/*
+ *	BDOS function in C
+ *
+ *	Output: 0 ok, 1 unknown function
+ */
+static int cp_bdos(void)
+{
+	register WORD de = (D << 8) + E;
+	register int i;
+
+	switch (C) {
+	case 2:					/* console output */
+		cp_putc(E);
+		break;
+	case 9:					/* print string */
+		for (i = 0; i < 65536 && ram[de] != '$'; i++)
+			cp_putc(ram[de++]);
+		break;
+	default:
+		printf("\nBDOS function %d not supported\n", C);
+		return(1);
+	}
+	A = L = 0;				/* return like CP/M */
+	return(0);
+}
+
+/*
+ *	Load the COM file fn and run it until the warm boot
+ *
+ *	Output: exit code, 0 warm boot and no failed test group
+ */
+int cpm_run(char *fn)
+{
+	register FILE *fp;
+	register size_t n;
+	register WORD pc;
+	register double t;
+#ifdef WANT_TIM
+	unsigned long long steps = cpu_steps, ts = cpu_tstates;
+#endif
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		perror(fn);
+		return(EX_NOINPUT);
+	}
+	n = fread(ram + CP_TPA, 1, CP_BDOS - CP_TPA, fp);
+	fclose(fp);
+	printf("Loaded %s, %04lx bytes at %04x\n", fn, (unsigned long) n,
+	       CP_TPA);
+	ram[0x0000] = 0xed;			/* warm boot trap */
+	ram[0x0001] = 0xff;
+	ram[0x0005] = 0xc3;			/* JP CP_BDOS */
+	ram[0x0006] = CP_BDOS & 0xff;
+	ram[0x0007] = CP_BDOS >> 8;
+	ram[CP_BDOS] = 0xed;			/* BDOS trap */
+	ram[CP_BDOS + 1] = 0xff;
+	ram[CP_BDOS + 2] = 0xc9;		/* RET */
+	PC = ram + CP_TPA;
+	STACK = ram + CP_BDOS;
+	*--STACK = 0x00;			/* return to warm boot */
+	*--STACK = 0x00;
+	IFF = 0;
+	f_flag = 0;
+	cp_ok = cp_err = cp_pos = 0;
+	cp_start = cp_last = cp_secs();
+	for (;;) {
+		cpu_state = CONTIN_RUN;
+		cpu_error = NONE;
+		cpu();
+		pc = PC - ram;
+		if (cpu_error != OPTRAP2 || (pc != 0x0002 && pc != CP_BDOS + 2))
+			break;
+		if (pc == 0x0002 || C == 0 || cp_bdos())
+			break;
+	}
+	t = cp_secs() - cp_start;
+	if (cp_pos)
+		cp_putc('\n');
+	if (pc == CP_BDOS + 2 && cpu_error == OPTRAP2 && C == 0)
+		pc = 0x0002;			/* BDOS system reset */
+	else if (pc != 0x0002)
+		printf("\nStopped at %04x, CPU error %d\n", pc, cpu_error);
+	printf("\n%d test groups, %d OK, %d ERROR, %.2f s", cp_ok + cp_err,
+	       cp_ok, cp_err, t);
+#ifdef WANT_TIM
+	if (t > 0.0 && cpu_steps != steps)	/* variant with counting */
+		printf(", %llu instructions, %.2f MHz",
+		       cpu_steps - steps, (cpu_tstates - ts) / t / 1e6);
+#endif
+	putchar('\n');
+	return((cp_err || pc != 0x0002) ? 1 : 0);
+}
@@ -0,0 +1,1036 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module disassembles a whole image in the memory of the
+ *	CPU. Starting from the entry points the code is followed by
+ *	recursive descent: the targets of jumps and calls are queued
+ *	and disassembled in turn, a path ends at a RET, JP or JP (HL).
+ *	Bytes which are never reached are data. The result is a
+ *	listing with labels, followed by the call graph of the
+ *	subroutines.
+ *
+ *	The entry points are the start address of the loaded file,
+ *	the RST and NMI vectors if they were loaded, and the ones
+ *	given by the user. Only loaded bytes are disassembled, if
+ *	nothing was loaded, e.g. after a core file, the whole memory
+ *	is used, starting at PC.
+ *
+ *	The control flow of the op-codes is decoded with a table,
+ *	the listing is built in a large buffer and written with
+ *	write(). The simulator started as z80dis only disassembles.
+ *
+ *	z80dis also handles banked images, made from several files
+ *	or cut from one large file. Every bank has its own context,
+ *	the banks are disassembled by several threads, which take
+ *	the next bank with an atomic increment. Between the rounds
+ *	the targets outside of a bank are passed to the bank which
+ *	has the address, until no more code is found.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "global.h"
+
+extern int dis_r(unsigned char *, int, char *), opsize(unsigned char *, int);
+extern int load_file(char *), load_test(WORD), exatoi(char *);
+extern long load_entry(void);
+
+#define D_LOAD	1		/* byte is part of the image */
+#define D_CODE	2		/* first byte of an op-code */
+#define D_BODY	4		/* other bytes of an op-code */
+#define D_JUMP	8		/* target of a jump */
+#define D_CALL	16		/* target of a call, subroutine */
+#define D_ENTRY	32		/* entry point */
+#define D_BLOCK	64		/* first op-code of a basic block */
+#define D_QUEUE	128		/* queued for disassembly */
+
+#define F_NEXT	0		/* continue with the next op-code */
+#define F_JUMP	1		/* jump to target */
+#define F_CJUMP	2		/* jump to target or continue */
+#define F_CALL	3		/* call target and continue */
+#define F_END	4		/* RET, JP (HL), path ends */
+#define F_CRET	5		/* conditional RET */
+
+#define K_NN	0x10		/* target is the word after the op-code */
+#define K_REL	0x20		/* target is relative */
+#define K_RST	0x40		/* target is in the op-code */
+
+#define OBSIZE	(1024 * 1024)	/* size of the output buffer */
+#define NENTRY	64		/* max. no. of entry points */
+
+struct edge {			/* call from function to function */
+	WORD e_from, e_to;
+};
+
+struct dctx {
+	long d_lo, d_len;	/* addresses of the image */
+	BYTE *d_mem;		/* memory with the image */
+	BYTE *d_flag;		/* D_ flags of each address */
+	WORD *d_fn;		/* function of each op-code */
+	WORD *d_queue;
+	int d_nq;
+	BYTE d_xjump[8192];	/* bitmaps of the jump and call targets */
+	BYTE d_xcall[8192];	/* outside of the image */
+	struct edge *d_edge;
+	int d_nedge, d_maxedge;
+	char *d_ob;		/* output buffer, only while listing */
+	int d_olen, d_fd;
+	int d_bank;		/* no. of the bank, -1 if not banked */
+	long d_start;		/* start address of the file, -1 if none */
+	char *d_out;		/* output file, NULL for stdout */
+	char d_sum[LENCMD * 3];	/* summary of the listing */
+	int d_rc;		/* result of the listing by a thread */
+};
+
+/* address a is in the image of d */
+#define IN(d, a)	((unsigned long) ((a) - (d)->d_lo) < (d)->d_len)
+
+static BYTE flowtab[256];
+static struct dctx **da_ctx;	/* the banks */
+static int da_n, da_max;	/* no. of banks */
+static int da_owner[65536];	/* bank of each address, -1 none, -2 several */
+static int da_next;		/* next bank for the threads */
+static int da_phase;		/* 0 = walk, 1 = listing */
+static char hexdig[] = "0123456789ABCDEF";
+
+/*
+ *	Build the table with the control flow of the op-codes
+ */
+static void da_inittab(void)
+{
+	register int i;
+
+	for (i = 0; i < 256; i++) {
+		if (i == 0xc3)
+			flowtab[i] = F_JUMP | K_NN;		/* JP nn */
+		else if ((i & 0xc7) == 0xc2)
+			flowtab[i] = F_CJUMP | K_NN;		/* JP cc,nn */
+		else if (i == 0x18)
+			flowtab[i] = F_JUMP | K_REL;		/* JR e */
+		else if (i == 0x10 || (i & 0xe7) == 0x20)
+			flowtab[i] = F_CJUMP | K_REL;		/* DJNZ, JR cc */
+		else if (i == 0xcd || (i & 0xc7) == 0xc4)
+			flowtab[i] = F_CALL | K_NN;		/* CALL [cc,]nn */
+		else if ((i & 0xc7) == 0xc7)
+			flowtab[i] = F_CALL | K_RST;		/* RST n */
+		else if (i == 0xc9 || i == 0xe9)
+			flowtab[i] = F_END;			/* RET, JP (HL) */
+		else if ((i & 0xc7) == 0xc0)
+			flowtab[i] = F_CRET;			/* RET cc */
+		else
+			flowtab[i] = F_NEXT;
+	}
+}
+
+/*
+ *	Byte at adr, 0 outside of the image
+ */
+static BYTE da_mem(struct dctx *d, WORD adr)
+{
+	return(IN(d, adr) ? d->d_mem[adr - d->d_lo] : 0);
+}
+
+/*
+ *	D_ flags of adr, outside of the image only D_JUMP and D_CALL
+ */
+static int da_fl(struct dctx *d, WORD adr)
+{
+	if (IN(d, adr))
+		return(d->d_flag[adr - d->d_lo]);
+	return((d->d_xjump[adr >> 3] & (1 << (adr & 7)) ? D_JUMP : 0) |
+	       (d->d_xcall[adr >> 3] & (1 << (adr & 7)) ? D_CALL : 0));
+}
+
+/*
+ *	Control flow of the op-code at adr, the target of a
+ *	jump or call is returned in tgt
+ */
+static int da_flow(struct dctx *d, WORD adr, WORD *tgt)
+{
+	register BYTE op = da_mem(d, adr);
+	register int f = flowtab[op];
+	register BYTE b2 = da_mem(d, adr + 1);
+
+	switch (f & 0xf0) {
+	case K_NN:
+		*tgt = b2 + (da_mem(d, adr + 2) << 8);
+		break;
+	case K_REL:
+		*tgt = adr + 2 + (signed char) b2;
+		break;
+	case K_RST:
+		*tgt = op & 0x38;
+		break;
+	}
+	switch (op) {
+	case 0xed:			/* RETN, RETI */
+		if ((b2 & 0xc7) == 0x45)
+			return(F_END);
+		break;
+	case 0xdd:			/* JP (IX), JP (IY) */
+	case 0xfd:
+		if (b2 == 0xe9)
+			return(F_END);
+		break;
+	}
+	return(f & 0x0f);
+}
+
+/*
+ *	Mark adr as target with flags fl and queue it for
+ *	disassembly, fn is the function it belongs to. Targets
+ *	outside of the image are only marked.
+ */
+static void da_push(struct dctx *d, WORD adr, int fl, WORD fn)
+{
+	register BYTE *p;
+
+	if (!IN(d, adr)) {
+		if (fl & D_JUMP)
+			d->d_xjump[adr >> 3] |= 1 << (adr & 7);
+		if (fl & D_CALL)
+			d->d_xcall[adr >> 3] |= 1 << (adr & 7);
+		return;
+	}
+	p = d->d_flag + (adr - d->d_lo);
+	*p |= fl | D_BLOCK;
+	if (*p & D_QUEUE)
+		return;
+	*p |= D_QUEUE;
+	d->d_fn[adr - d->d_lo] = fn;
+	d->d_queue[d->d_nq++] = adr;
+}
+
+/*
+ *	Make room for more edges of the call graph
+ *
+ *	Output: 0 ok, 1 no memory
+ */
+static int da_grow(struct dctx *d)
+{
+	register struct edge *e;
+	register int n;
+
+	n = d->d_maxedge ? d->d_maxedge * 2 : 1024;
+	if ((e = realloc(d->d_edge, n * sizeof(struct edge))) == NULL)
+		return(1);
+	d->d_edge = e;
+	d->d_maxedge = n;
+	return(0);
+}
+
+/*
+ *	Follow all paths from the queued addresses
+ */
+static void da_walk(struct dctx *d)
+{
+	register BYTE *fl = d->d_flag;
+	register long lo = d->d_lo;
+	register int i, len, f;
+	WORD adr, fn, tgt;
+	BYTE op[4];
+
+	while (d->d_nq) {
+		adr = d->d_queue[--d->d_nq];
+		fn = d->d_fn[adr - lo];
+		for (;;) {
+			if (!IN(d, adr) ||
+			    (fl[adr - lo] & (D_LOAD | D_CODE | D_BODY)) != D_LOAD)
+				break;
+			if (fl[adr - lo] & (D_CALL | D_ENTRY))	/* runs into */
+				fn = adr;			/* next function */
+			for (i = 0; i < 4; i++)
+				op[i] = da_mem(d, adr + i);
+			len = opsize(op, 0);
+			for (i = 1; i < len; i++)
+				if (!IN(d, (WORD) (adr + i)) ||
+				    (fl[(WORD) (adr + i) - lo] &
+				     (D_LOAD | D_CODE | D_BODY)) != D_LOAD)
+					break;
+			if (i < len)		/* overlaps other op-code */
+				break;
+			fl[adr - lo] |= D_CODE;
+			d->d_fn[adr - lo] = fn;
+			for (i = 1; i < len; i++)
+				fl[(WORD) (adr + i) - lo] |= D_BODY;
+			switch (f = da_flow(d, adr, &tgt)) {
+			case F_JUMP:
+			case F_CJUMP:
+				da_push(d, tgt, D_JUMP, fn);
+				break;
+			case F_CALL:
+				da_push(d, tgt, D_CALL, tgt);
+				if (d->d_nedge == d->d_maxedge &&
+				    da_grow(d))
+					break;
+				d->d_edge[d->d_nedge].e_from = fn;
+				d->d_edge[d->d_nedge++].e_to = tgt;
+				break;
+			}
+			if (f == F_JUMP || f == F_END)
+				break;
+			adr += len;
+			if (f != F_NEXT && IN(d, adr))
+				fl[adr - lo] |= D_BLOCK;
+		}
+	}
+}
+
+/*
+ *	Functions for the output buffer
+ */
+static void ob_flush(struct dctx *d)
+{
+	register char *p = d->d_ob;
+	register int n;
+
+	while (d->d_olen > 0 && (n = write(d->d_fd, p, d->d_olen)) > 0) {
+		p += n;
+		d->d_olen -= n;
+	}
+	d->d_olen = 0;
+}
+
+static void ob_mem(struct dctx *d, const char *s, int n)
+{
+	if (d->d_olen + n > OBSIZE)
+		ob_flush(d);
+	memcpy(d->d_ob + d->d_olen, s, n);
+	d->d_olen += n;
+}
+
+static void ob_str(struct dctx *d, const char *s)
+{
+	ob_mem(d, s, strlen(s));
+}
+
+/*
+ *	Fill the line with tabs up to the comment column,
+ *	s is the text written after the first tab
+ */
+static void ob_col(struct dctx *d, char *s, int n)
+{
+	register int col = 8;
+
+	while (n--)
+		col = (*s++ == '\t') ? (col + 8) & ~7 : col + 1;
+	do {
+		ob_mem(d, "\t", 1);
+		col = (col + 8) & ~7;
+	} while (col < 32);
+}
+
+static void ob_hex(struct dctx *d, unsigned int v, int n)
+{
+	char buf[8];
+	register int i;
+
+	for (i = n - 1; i >= 0; i--, v >>= 4)
+		buf[i] = hexdig[v & 0xf];
+	ob_mem(d, buf, n);
+}
+
+/*
+ *	Name of the label at adr, the symbol if there is one,
+ *	else Snnnn for subroutines and entry points and Lnnnn
+ *	for other labels
+ */
+static char *da_label(struct dctx *d, WORD adr, char *buf)
+{
+	register int i;
+
+	if (*sym_str(adr, 0, buf, LENCMD))
+		return(buf);
+	buf[0] = (da_fl(d, adr) & (D_CALL | D_ENTRY)) ? 'S' : 'L';
+	for (i = 4; i > 0; i--, adr >>= 4)
+		buf[i] = hexdig[adr & 0xf];
+	buf[5] = '\0';
+	return(buf);
+}
+
+/*
+ *	Write the op-code at adr, the target address of jumps and
+ *	calls is replaced by the label
+ */
+static int da_code(struct dctx *d, WORD adr)
+{
+	char lab[LENCMD], line[DISLEN + LENCMD], str[DISLEN], hx[5];
+	register char *p, *e;
+	register int i, len;
+	BYTE op[4];
+	WORD tgt;
+
+	for (i = 0; i < 4; i++)
+		op[i] = da_mem(d, adr + i);
+	len = dis_r(op, adr, str);
+	e = strchr(str, '\n');
+	p = NULL;
+	switch (da_flow(d, adr, &tgt)) {
+	case F_JUMP:
+	case F_CJUMP:
+	case F_CALL:
+		if ((flowtab[*op] & K_RST) == 0) {
+			for (i = 3; i >= 0; i--)
+				hx[3 - i] = hexdig[(tgt >> (i * 4)) & 0xf];
+			hx[4] = '\0';
+			p = strstr(str, hx);
+		}
+		break;
+	}
+	if (p != NULL) {
+		if ((e = strstr(p, "\t;")) == NULL)
+			e = strchr(p, '\n');
+		i = p - str;
+		sprintf(line, "%.*s%s%.*s", i, str, da_label(d, tgt, lab),
+			(int) (e - p - 4), p + 4);
+	} else
+		sprintf(line, "%.*s", (int) (e - str), str);
+	ob_mem(d, "\t", 1);
+	ob_str(d, line);
+	ob_col(d, line, strlen(line));
+	ob_mem(d, "; ", 2);
+	ob_hex(d, adr, 4);
+	for (i = 0; i < len; i++) {
+		ob_mem(d, " ", 1);
+		ob_hex(d, op[i], 2);
+	}
+	ob_mem(d, "\n", 1);
+	return(len);
+}
+
+/*
+ *	Write up to 8 data bytes from adr, up to the next
+ *	op-code, label or byte not loaded
+ */
+static int da_data(struct dctx *d, WORD adr)
+{
+	char line[32];
+	register char *p;
+	register int i;
+	BYTE b;
+
+	strcpy(line, "DEFB\t");
+	p = line + 5;
+	for (i = 0; i < 8; i++) {
+		if (i && ((da_fl(d, adr + i) &
+			   (D_LOAD | D_CODE | D_BODY | D_JUMP | D_CALL |
+			    D_ENTRY)) !=
+			  D_LOAD || (WORD) (adr + i) == 0))
+			break;
+		if (i)
+			*p++ = ',';
+		b = da_mem(d, adr + i);
+		*p++ = hexdig[b >> 4];
+		*p++ = hexdig[b & 0xf];
+	}
+	ob_mem(d, "\t", 1);
+	ob_mem(d, line, p - line);
+	ob_col(d, line, p - line);
+	ob_mem(d, "; ", 2);
+	ob_hex(d, adr, 4);
+	ob_mem(d, "\n", 1);
+	return(i);
+}
+
+static int da_ecmp(const void *a, const void *b)
+{
+	register const struct edge *x = a, *y = b;
+
+	if (x->e_from != y->e_from)
+		return(x->e_from - y->e_from);
+	return(x->e_to - y->e_to);
+}
+
+/*
+ *	Write the call graph, one line for every function
+ *	with the functions it calls
+ */
+static void da_graph(struct dctx *d)
+{
+	char lab[LENCMD];
+	register struct edge *e = d->d_edge;
+	register int i;
+
+	if (d->d_nedge == 0)
+		return;
+	qsort(e, d->d_nedge, sizeof(struct edge), da_ecmp);
+	ob_str(d, "\n; Call graph\n");
+	for (i = 0; i < d->d_nedge; i++) {
+		if (i && e[i].e_from == e[i - 1].e_from) {
+			if (e[i].e_to == e[i - 1].e_to)
+				continue;
+			ob_mem(d, ", ", 2);
+		} else {
+			if (i)
+				ob_mem(d, "\n", 1);
+			ob_str(d, "; ");
+			ob_str(d, da_label(d, e[i].e_from, lab));
+			ob_str(d, " -> ");
+		}
+		ob_str(d, da_label(d, e[i].e_to, lab));
+	}
+	ob_mem(d, "\n", 1);
+}
+
+/*
+ *	Write references to addresses outside of the bank,
+ *	with the bank where the address is, if it is known
+ */
+static void da_extern(struct dctx *d)
+{
+	char lab[LENCMD];
+	register long i;
+	register int n, b;
+
+	if (d->d_bank < 0)
+		return;
+	for (i = 0, n = 0; i < 65536; i++) {
+		if ((da_fl(d, i) & (D_LOAD | D_JUMP | D_CALL)) <= D_LOAD)
+			continue;
+		if (n++ == 0)
+			ob_str(d, "\n; External references\n");
+		ob_str(d, "; ");
+		ob_str(d, da_label(d, i, lab));
+		if ((b = da_owner[i]) >= 0) {
+			sprintf(lab, " in bank %d\n", b);
+			ob_str(d, lab);
+		} else
+			ob_str(d, (b == -1) ? " not loaded\n" :
+					      " in several banks\n");
+	}
+}
+
+/*
+ *	Write the listing of a disassembled image, the summary for
+ *	the terminal is left in d_sum, the threads of z80dis don't
+ *	print it
+ *
+ *	Output: 0 ok, 1 error
+ */
+static int da_list(struct dctx *d)
+{
+	char lab[LENCMD], sum[LENCMD * 2];
+	register BYTE *fl = d->d_flag;
+	register long i, j;
+	long ninsn = 0, nblock = 0, nfunc = 0, ndata = 0, lo = -1, hi = 0;
+
+	d->d_sum[0] = '\0';
+	for (j = 0; j < d->d_len; j++) {
+		if (!(fl[j] & D_LOAD))
+			continue;
+		if (lo < 0)
+			lo = j;
+		hi = j;
+		if (fl[j] & D_CODE) {
+			ninsn++;
+			if (fl[j] & D_BLOCK)
+				nblock++;
+			if (fl[j] & (D_CALL | D_ENTRY))
+				nfunc++;
+		} else if (!(fl[j] & D_BODY))
+			ndata++;
+	}
+	if (lo < 0)
+		lo = 0;
+	if ((d->d_ob = malloc(OBSIZE)) == NULL) {
+		strcpy(d->d_sum, "not enough memory for the listing\n");
+		return(1);
+	}
+	d->d_olen = 0;
+	if (d->d_out == NULL)
+		d->d_fd = 1;
+	else if ((d->d_fd = open(d->d_out, O_WRONLY | O_CREAT | O_TRUNC,
+				 0644)) == -1) {
+		snprintf(d->d_sum, sizeof(d->d_sum), "can't create file %s\n",
+			 d->d_out);
+		free(d->d_ob);
+		d->d_ob = NULL;
+		return(1);
+	}
+	sprintf(sum, "%ld instructions, %ld basic blocks, %ld functions, %ld data bytes\n",
+		ninsn, nblock, nfunc, ndata);
+	if (d->d_bank >= 0) {
+		sprintf(lab, "; Bank %d\n", d->d_bank);
+		ob_str(d, lab);
+	}
+	ob_str(d, "; Disassembly of ");
+	ob_hex(d, d->d_lo + lo, 4);
+	ob_mem(d, "-", 1);
+	ob_hex(d, d->d_lo + hi, 4);
+	ob_str(d, "\n; ");
+	ob_str(d, sum);
+	for (j = lo; j <= hi;) {
+		i = d->d_lo + j;
+		if (!(fl[j] & D_LOAD)) {
+			j++;
+			continue;
+		}
+		if (j == lo || !(fl[j - 1] & D_LOAD)) {
+			ob_str(d, "\n\tORG\t");
+			ob_hex(d, i, 4);
+			ob_mem(d, "\n", 1);
+		}
+		if (fl[j] & (D_JUMP | D_CALL | D_ENTRY) && !(fl[j] & D_BODY)) {
+			if (fl[j] & (D_CALL | D_ENTRY))
+				ob_mem(d, "\n", 1);
+			ob_str(d, da_label(d, i, lab));
+			ob_str(d, ":\n");
+		}
+		if (fl[j] & D_CODE)
+			j += da_code(d, i);
+		else if (fl[j] & D_BODY)	/* jump into an op-code */
+			j++;
+		else
+			j += da_data(d, i);
+	}
+	da_graph(d);
+	da_extern(d);
+	ob_flush(d);
+	free(d->d_ob);
+	d->d_ob = NULL;
+	if (d->d_out != NULL) {
+		close(d->d_fd);
+		if (d->d_bank >= 0)
+			snprintf(d->d_sum, sizeof(d->d_sum), "%s: %s",
+				 d->d_out, sum);
+		else
+			strcpy(d->d_sum, sum);
+	}
+	return(0);
+}
+
+/*
+ *	Allocate the context for an image of len bytes from address lo
+ */
+static struct dctx *da_new(long lo, long len)
+{
+	register struct dctx *d;
+
+	if ((d = calloc(1, sizeof(struct dctx))) == NULL)
+		return(NULL);
+	d->d_lo = lo;
+	d->d_len = len;
+	if ((d->d_mem = calloc(len, 1)) == NULL ||
+	    (d->d_flag = calloc(len, 1)) == NULL ||
+	    (d->d_fn = malloc(len * sizeof(WORD))) == NULL ||
+	    (d->d_queue = malloc(len * sizeof(WORD))) == NULL) {
+		free(d->d_mem);
+		free(d->d_flag);
+		free(d->d_fn);
+		free(d);
+		return(NULL);
+	}
+	d->d_bank = -1;
+	return(d);
+}
+
+static void da_free(struct dctx *d)
+{
+	free(d->d_edge);
+	free(d->d_mem);
+	free(d->d_flag);
+	free(d->d_fn);
+	free(d->d_queue);
+	free(d);
+}
+
+/*
+ *	Queue the entry points which are in the image,
+ *	the start address and the user given addresses
+ */
+static void da_entry(struct dctx *d, long start, WORD *ent, int nent)
+{
+	register int i;
+
+	if (start >= 0 && (da_fl(d, start) & D_LOAD))
+		da_push(d, start, D_ENTRY, start);
+	for (i = 0; i < nent; i++)
+		if (da_fl(d, ent[i]) & D_LOAD)
+			da_push(d, ent[i], D_ENTRY, ent[i]);
+}
+
+/*
+ *	Queue the RST and NMI vectors, which are in the image
+ *	and not part of the code found so far
+ *
+ *	Output: no. of vectors queued
+ */
+static int da_vectors(struct dctx *d)
+{
+	static WORD vec[] = { 0x00, 0x08, 0x10, 0x18, 0x20, 0x28, 0x30,
+			      0x38, 0x66 };
+	register int i, n = 0;
+
+	for (i = 0; i < sizeof(vec) / sizeof(WORD); i++)
+		if ((da_fl(d, vec[i]) & (D_LOAD | D_CODE | D_BODY | D_QUEUE))
+		    == D_LOAD && da_mem(d, vec[i]) != 0xff) {
+			da_push(d, vec[i], D_ENTRY, vec[i]);
+			n++;
+		}
+	return(n);
+}
+
+/*
+ *	Disassemble the image in memory into file fn, stdout if
+ *	fn is NULL, ent are nent additional entry points
+ *
+ *	Output: 0 ok, 1 error
+ */
+int dasm_image(char *fn, WORD *ent, int nent)
+{
+	register struct dctx *d;
+	register long i;
+	long lo = -1, hi = 0;
+	int rc;
+
+	for (i = 0; i < 65536; i++)
+		if (load_test(i)) {
+			if (lo < 0)
+				lo = i;
+			hi = i;
+		}
+	if ((d = (lo < 0) ? da_new(0, 65536) : da_new(lo, hi - lo + 1))
+	    == NULL) {
+		puts("not enough memory for disassembler");
+		return(1);
+	}
+	if (flowtab[0xc3] == 0)
+		da_inittab();
+	memcpy(d->d_mem, ram + d->d_lo, d->d_len);
+	if (lo >= 0) {
+		for (i = lo; i <= hi; i++)
+			if (load_test(i))
+				d->d_flag[i - lo] = D_LOAD;
+		da_entry(d, load_entry(), ent, nent);
+	} else {			/* nothing loaded, all memory */
+		memset(d->d_flag, D_LOAD, 65536);
+		da_entry(d, PC - ram, ent, nent);
+	}
+	da_walk(d);
+	if (da_vectors(d))
+		da_walk(d);
+	d->d_out = fn;
+	fflush(stdout);
+	rc = da_list(d);
+	fputs(d->d_sum, stdout);
+	da_free(d);
+	return(rc);
+}
+
+/*
+ *	Thread for the banks, takes the next bank from da_next
+ *	with an atomic increment, so no locks are needed
+ */
+static void *da_worker(void *arg)
+{
+	register int i;
+
+	while ((i = __sync_fetch_and_add(&da_next, 1)) < da_n) {
+		if (da_phase == 0)
+			da_walk(da_ctx[i]);
+		else if (da_ctx[i]->d_out != NULL)
+			da_ctx[i]->d_rc = da_list(da_ctx[i]);
+	}
+	return(NULL);
+}
+
+/*
+ *	Run a phase for all banks with njobs threads
+ */
+static void da_run(int phase, int njobs)
+{
+	pthread_t tid[64];
+	register int i, n;
+
+	da_phase = phase;
+	da_next = 0;
+	for (n = 0; n < njobs - 1 && n < 64 && n < da_n - 1; n++)
+		if (pthread_create(&tid[n], NULL, da_worker, NULL))
+			break;
+	da_worker(NULL);
+	for (i = 0; i < n; i++)
+		pthread_join(tid[i], NULL);
+}
+
+/*
+ *	Pass the targets, which are outside of a bank and in exactly
+ *	one other bank, to that bank
+ *
+ *	Output: no. of targets passed
+ */
+static int da_merge(void)
+{
+	register struct dctx *d;
+	register long i;
+	register int k, b, n = 0;
+
+	for (k = 0; k < da_n; k++) {
+		d = da_ctx[k];
+		for (i = 0; i < 65536; i++) {
+			if ((da_fl(d, i) & (D_LOAD | D_JUMP | D_CALL)) <=
+			    D_LOAD)
+				continue;
+			if ((b = da_owner[i]) < 0 ||
+			    (da_fl(da_ctx[b], i) & D_QUEUE))
+				continue;
+			da_push(da_ctx[b], i, da_fl(d, i) & (D_JUMP | D_CALL),
+				i);
+			n++;
+		}
+	}
+	return(n);
+}
+
+/*
+ *	Add a bank of len bytes from address lo for z80dis
+ *
+ *	Output: the context of the bank, NULL if no memory
+ */
+static struct dctx *da_add(long lo, long len)
+{
+	register struct dctx **t, *d;
+
+	if (da_n == da_max) {
+		da_max = da_max ? da_max * 2 : 16;
+		if ((t = realloc(da_ctx, da_max * sizeof(struct dctx *)))
+		    == NULL)
+			return(NULL);
+		da_ctx = t;
+	}
+	if ((d = da_new(lo, len)) == NULL)
+		return(NULL);
+	d->d_bank = da_n;
+	d->d_start = -1;
+	da_ctx[da_n++] = d;
+	return(d);
+}
+
+/*
+ *	Load the banks for z80dis, every file is one bank. If size
+ *	is not 0 each file is cut into banks of size bytes, the first
+ *	one is loaded at 0, the others at address adr.
+ *
+ *	Output: 0 ok, 1 error
+ */
+static int da_load(char **files, int nfiles, long size, WORD adr)
+{
+	register struct dctx *d;
+	register long i, off, n;
+	long lo, hi;
+	struct stat st;
+	int fd, rc, f;
+	BYTE *buf;
+
+	for (f = 0; f < nfiles; f++) {
+		if (size == 0) {	/* one bank, with the loaders */
+			memset(ram, 0, 65536);
+			fflush(stdout);
+			fd = dup(1);
+			dup2(2, 1);	/* messages to stderr */
+			rc = load_file(files[f]);
+			fflush(stdout);
+			dup2(fd, 1);
+			close(fd);
+			if (rc)
+				return(1);
+			for (lo = -1, hi = 0, i = 0; i < 65536; i++)
+				if (load_test(i)) {
+					if (lo < 0)
+						lo = i;
+					hi = i;
+				}
+			if (lo < 0)
+				lo = 0;
+			if ((d = da_add(lo, hi - lo + 1)) == NULL)
+				return(1);
+			memcpy(d->d_mem, ram + lo, d->d_len);
+			for (i = lo; i <= hi; i++)
+				if (load_test(i))
+					d->d_flag[i - lo] = D_LOAD;
+			d->d_start = load_entry();
+			continue;
+		}
+		if ((fd = open(files[f], O_RDONLY)) == -1 ||
+		    fstat(fd, &st) == -1) {
+			fprintf(stderr, "can't open file %s\n", files[f]);
+			return(1);
+		}
+		if ((buf = malloc(st.st_size)) == NULL ||
+		    read(fd, buf, st.st_size) != st.st_size) {
+			fprintf(stderr, "can't read file %s\n", files[f]);
+			close(fd);
+			free(buf);
+			return(1);
+		}
+		close(fd);
+		for (off = 0; off < st.st_size; off += size) {
+			i = (off == 0) ? 0 : adr;
+			n = (st.st_size - off < size) ? st.st_size - off : size;
+			if (i + n > 65536)
+				n = 65536 - i;
+			if ((d = da_add(i, n)) == NULL) {
+				free(buf);
+				return(1);
+			}
+			memcpy(d->d_mem, buf + off, n);
+			memset(d->d_flag, D_LOAD, n);
+			if (off == 0)
+				d->d_start = 0;
+		}
+		free(buf);
+	}
+	return(0);
+}
+
+/*
+ *	Queue the first address of banks, where no code was found,
+ *	e.g. banks only called through a bank switch routine
+ *
+ *	Output: no. of banks
+ */
+static int da_nocode(void)
+{
+	register struct dctx *d;
+	register long i;
+	register int k, n = 0;
+
+	for (k = 0; k < da_n; k++) {
+		d = da_ctx[k];
+		for (i = 0; i < d->d_len; i++)
+			if (d->d_flag[i] & D_CODE)
+				break;
+		if (i < d->d_len)
+			continue;
+		for (i = 0; i < d->d_len && !(d->d_flag[i] & D_LOAD); i++)
+			;
+		if (i < d->d_len && !(d->d_flag[i] & D_QUEUE)) {
+			da_push(d, d->d_lo + i, D_ENTRY, d->d_lo + i);
+			n++;
+		}
+	}
+	return(n);
+}
+
+/*
+ *	main() for z80dis, usage:
+ *
+ *	z80dis [-y symbols] [-e address] [-o output] [-j threads]
+ *	       [-b size[,address]] file[,address] ...
+ *
+ *	Each file is a bank, with -b the files are cut into banks.
+ *	The banks are disassembled by threads, addresses outside of
+ *	a bank are passed to the bank which has them, until no new
+ *	code is found. The listing of bank n goes into output.n,
+ *	without -o all listings go to stdout.
+ */
+int dasm_main(int argc, char **argv)
+{
+	WORD ent[NENTRY];
+	register struct dctx *d;
+	register int k, n;
+	register long i;
+	int c, nent = 0, njobs, rc = 0;
+	long size = 0;
+	WORD adr = 0;
+	char *out = NULL, *p;
+
+	if ((njobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		njobs = 1;
+	while ((c = getopt(argc, argv, "y:e:o:j:b:")) != -1) {
+		switch (c) {
+		case 'y':
+			if (sym_load(optarg) < 0)
+				return(1);
+			break;
+		case 'e':
+			if (nent < NENTRY)
+				ent[nent++] = exatoi(optarg);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'j':
+			if ((njobs = atoi(optarg)) < 1)
+				njobs = 1;
+			break;
+		case 'b':
+			size = exatoi(optarg);
+			if ((p = strchr(optarg, ',')) != NULL)
+				adr = exatoi(p + 1);
+			break;
+		default:
+			optind = argc + 1;
+			break;
+		}
+	}
+	if (optind >= argc || size < 0 || size > 65536) {
+		fprintf(stderr, "usage: %s [-y symbols] [-e address] [-o output] [-j threads]\n\t[-b size[,address]] file[,address] ...\n",
+			argv[0]);
+		return(1);
+	}
+	da_inittab();
+	if (da_load(argv + optind, argc - optind, size, adr)) {
+		fputs("not enough memory for disassembler\n", stderr);
+		return(1);
+	}
+	if (da_n == 1)
+		da_ctx[0]->d_bank = -1;
+	for (i = 0; i < 65536; i++)
+		da_owner[i] = -1;
+	for (k = 0; k < da_n; k++) {
+		d = da_ctx[k];
+		for (i = 0; i < d->d_len; i++)
+			if (d->d_flag[i] & D_LOAD)
+				da_owner[d->d_lo + i] =
+				    (da_owner[d->d_lo + i] == -1) ? k : -2;
+	}
+	for (k = 0; k < da_n; k++)
+		da_entry(da_ctx[k], da_ctx[k]->d_start, ent, nent);
+	do {
+		da_run(0, njobs);
+		if ((n = da_merge()) == 0)
+			for (k = 0; k < da_n; k++)
+				n += da_vectors(da_ctx[k]);
+		if (n == 0)
+			n = da_nocode();
+	} while (n);
+
+	if (out == NULL || da_n == 1) {
+		for (k = 0; k < da_n; k++) {
+			da_ctx[k]->d_out = out;
+			rc |= da_list(da_ctx[k]);
+			fputs(da_ctx[k]->d_sum, stdout);
+		}
+	} else {
+		for (k = 0; k < da_n; k++) {
+			d = da_ctx[k];
+			if ((d->d_out = malloc(strlen(out) + 16)) == NULL)
+				return(1);
+			sprintf(d->d_out, "%s.%d", out, k);
+		}
+		da_run(1, njobs);
+		for (k = 0; k < da_n; k++) {	/* in the order of the banks */
+			fputs(da_ctx[k]->d_sum, stdout);
+			rc |= da_ctx[k]->d_rc;
+		}
+	}
+	for (k = 0; k < da_n; k++) {
+		if (da_ctx[k]->d_out != out)
+			free(da_ctx[k]->d_out);
+		da_free(da_ctx[k]);
+	}
+	free(da_ctx);
+	return(rc);
+}
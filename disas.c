@@ -30,18 +30,26 @@
 #include <string.h>
 #include "config.h"
 
+extern char *sym_str(WORD, int, char *, int);
+
+struct dis {			/* state of a disassembly */
+	int d_adr;		/* address of the op-code */
+	char *d_str;		/* output, DISLEN characters */
+};
+
 /*
  *	Forward	declarations
  */
-static int opout(char *, char **);
-static int nout(char *, unsigned char **);
-static int iout(char *, unsigned char **);
-static int rout(char *, char **);
-static int nnout(char *, unsigned char **);
-static int inout(char *, unsigned char **);
-static int cbop(char *, unsigned char **);
-static int edop(char *, unsigned char **);
-static int ddfd(char *, unsigned char **);
+static int opout(struct dis *, char *, char **);
+static int nout(struct dis *, char *, unsigned char **);
+static int iout(struct dis *, char *, unsigned char **);
+static int rout(struct dis *, char *, char **);
+static int nnout(struct dis *, char *, unsigned char **);
+static int inout(struct dis *, char *, unsigned char **);
+static int cbop(struct dis *, char *, unsigned char **);
+static int edop(struct dis *, char *, unsigned char **);
+static int ddfd(struct dis *, char *, unsigned char **);
+static void symout(struct dis *, int, int);
 
 /*
  *	Op-code	tables
@@ -310,7 +318,6 @@ static struct opt optab[256] = {
 	{ opout,  "RST\t38"		}	/* 0xff	*/
 };
 
-static int addr;
 static char *unkown = "???";
 static char *reg[] = { "B", "C", "D", "E", "H",	"L", "(HL)", "A" };
 static char *regix = "IX";
@@ -318,7 +325,7 @@ static char *regiy = "IY";
 
 /* globals for passing disassembled code to anyone else who's interested */
 
-char Disass_Str[64];
+char Disass_Str[DISLEN];
 char Opcode_Str[64];
 
 #ifdef WANT_GUI
@@ -357,6 +364,33 @@ void get_opcodes(unsigned char **p, int len)
 }
 #endif
 
+/*
+ *	Disassemble the op-code at p with the Z80 address adr
+ *	into buf, which has room for DISLEN characters. This is
+ *	re-entrant, so that several threads can disassemble.
+ *
+ *	Output: size of the op-code
+ */
+int dis_r(unsigned char *p, int adr, char *buf)
+{
+	struct dis ds;
+
+	ds.d_adr = adr;
+	ds.d_str = buf;
+	return((*optab[*p].fun) (&ds, optab[*p].text, &p));
+}
+
+/*
+ *	Disassemble the op-code at p into Disass_Str,
+ *	without printing it
+ *
+ *	Output: size of the op-code
+ */
+int dis_str(unsigned char *p, int adr)
+{
+	return(dis_r(p, adr, Disass_Str));
+}
+
 /*
  *	The function disass() is the only global function of
  *	this module. The first argument is a pointer to a
@@ -374,8 +408,7 @@ void disass(unsigned char **p, int adr)
 {
 	register int len;
 
-	addr = adr;
-	len = (*optab[**p].fun)	(optab[**p].text, p);
+	len = dis_str(*p, adr);
 #ifndef WANT_GUI
 	printf(Disass_Str);
 #endif
@@ -385,323 +418,411 @@ void disass(unsigned char **p, int adr)
 	*p += len;
 }
 
+/*
+ *	Table driven computation of the length of an op-code,
+ *	without disassembling it. The first argument points to
+ *	the 64KB memory of the Z80, the second argument is the
+ *	address of the op-code, wrapping around at 0xffff.
+ */
+static unsigned char oplen[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,	/* 0x00 */
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,	/* 0x10 */
+	2, 3, 3, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,	/* 0x20 */
+	2, 3, 3, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,	/* 0x30 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x40 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x50 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x60 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x70 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x80 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0x90 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xa0 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 0xb0 */
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,	/* 0xc0 */
+	1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 2, 2, 1,	/* 0xd0 */
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 2, 2, 1,	/* 0xe0 */
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 2, 2, 1	/* 0xf0 */
+};
+
+static unsigned char oplen_ddfd[256] = {
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,	/* 0x00 */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,	/* 0x10 */
+	2, 4, 4, 2, 2, 2, 3, 2, 2, 2, 4, 2, 2, 2, 3, 2,	/* 0x20 */
+	2, 2, 2, 2, 3, 3, 4, 2, 2, 2, 2, 2, 2, 2, 2, 2,	/* 0x30 */
+	2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0x40 */
+	2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0x50 */
+	2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0x60 */
+	3, 3, 3, 3, 3, 3, 2, 3, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0x70 */
+	2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0x80 */
+	2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0x90 */
+	2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0xa0 */
+	2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,	/* 0xb0 */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2,	/* 0xc0 */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,	/* 0xd0 */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,	/* 0xe0 */
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2	/* 0xf0 */
+};
+
+int opsize(unsigned char *mem, int adr)
+{
+	register int b2;
+
+	adr &= 0xffff;
+	switch (mem[adr]) {
+	case 0xcb:
+		return(2);
+	case 0xed:
+		b2 = mem[(adr + 1) & 0xffff];
+		return(((b2 & 0xc7) == 0x43) ? 4 : 2);
+	case 0xdd:
+	case 0xfd:
+		return(oplen_ddfd[mem[(adr + 1) & 0xffff]]);
+	default:
+		return(oplen[mem[adr]]);
+	}
+}
+
 /*
  *	disassemble 1 byte op-codes
  */
-static int opout(char *s, char **p)
+static int opout(struct dis *ds, char *s, char **p)
 {
-	sprintf(Disass_Str, "%s\n", s);
+	sprintf(ds->d_str, "%s\n", s);
 	return(1);
 }
 
 /*
  *	disassemble 2 byte op-codes of type "Op n"
  */
-static int nout(char *s, unsigned char **p)
+static int nout(struct dis *ds, char *s, unsigned char **p)
 {
-	sprintf(Disass_Str, "%s%02X\n", s, *(*p + 1));
+	sprintf(ds->d_str, "%s%02X\n", s, *(*p + 1));
 	return(2);
 }
 
 /*
  *	disassemble 2 byte op-codes with indirect addressing
  */
-static int iout(char *s, unsigned char **p)
+static int iout(struct dis *ds, char *s, unsigned char **p)
 {
-	sprintf(Disass_Str, s, *(*p + 1));
-	strcat(Disass_Str, "\n");
+	sprintf(ds->d_str, s, *(*p + 1));
+	strcat(ds->d_str, "\n");
 	return(2);
 }
 
 /*
  *	disassemble 2 byte op-codes with relative addressing
  */
-static int rout(char *s, char **p)
+static int rout(struct dis *ds, char *s, char **p)
 {
-	sprintf(Disass_Str, "%s%04X\n", s, addr + *(*p + 1) + 2);
+	sprintf(ds->d_str, "%s%04X\n", s, ds->d_adr + *(*p + 1) + 2);
+	symout(ds, ds->d_adr + *(*p + 1) + 2, 0xff);
 	return(2);
 }
 
 /*
  *	disassemble 3 byte op-codes of type "Op nn"
  */
-static int nnout(char *s, unsigned char **p)
+static int nnout(struct dis *ds, char *s, unsigned char **p)
 {
 	register int i;
 
 	i = *(*p + 1) +	(*(*p +	2) << 8);
-	sprintf(Disass_Str, "%s%04X\n", s, i);
+	sprintf(ds->d_str, "%s%04X\n", s, i);
+	symout(ds, i, (*s == 'J' || *s == 'C') ? 0xff : 0);
 	return(3);
 }
 
 /*
  *	disassemble 3 byte op-codes with indirect addressing
  */
-static int inout(char *s, unsigned char **p)
+static int inout(struct dis *ds, char *s, unsigned char **p)
 {
 	register int i;
 
 	i = *(*p + 1) +	(*(*p +	2) << 8);
-	sprintf(Disass_Str, s, i);
-	strcat(Disass_Str, "\n");
+	sprintf(ds->d_str, s, i);
+	strcat(ds->d_str, "\n");
+	symout(ds, i, 0);
 	return(3);
 }
 
+/*
+ *	Add the symbol for address adr as comment to the
+ *	disassembled op-code, up to offset max behind the symbol
+ */
+static void symout(struct dis *ds, int adr, int max)
+{
+	char buf[48];
+	register int len;
+
+	if (*sym_str(adr, max, buf, sizeof(buf)) == '\0')
+		return;
+	len = strlen(ds->d_str) - 1;
+	snprintf(ds->d_str + len, DISLEN - len, "\t; %s\n", buf);
+}
+
 /*
  *	disassemble multi byte op-codes with prefix 0xcb
  */
-static int cbop(char *s, unsigned char **p)
+static int cbop(struct dis *ds, char *s, unsigned char **p)
 {
 	register int b2;
 
+	ds->d_str[0] = 0;
 	b2 = *(*p + 1);
 	if (b2 >= 0x00 && b2 <=	0x07) {
-		sprintf(Disass_Str, "RLC\t%s\n",
+		sprintf(ds->d_str, "RLC\t%s\n",
 			reg[b2 & 7]);
 		return(2);
 	}
 	if (b2 >= 0x08 && b2 <=	0x0f) {
-		sprintf(Disass_Str, "RRC\t%s\n",
+		sprintf(ds->d_str, "RRC\t%s\n",
 			reg[b2 & 7]);
 		return(2);
 	}
 	if (b2 >= 0x10 && b2 <=	0x17) {
-		sprintf(Disass_Str, "RL\t%s\n",
+		sprintf(ds->d_str, "RL\t%s\n",
 			reg[b2 & 7]);
 		return(2);
 	}
 	if (b2 >= 0x18 && b2 <=	0x1f) {
-		sprintf(Disass_Str, "RR\t%s\n",
+		sprintf(ds->d_str, "RR\t%s\n",
 			reg[b2 & 7]);
 		return(2);
 	}
 	if (b2 >= 0x20 && b2 <=	0x27) {
-		sprintf(Disass_Str, "SLA\t%s\n",
+		sprintf(ds->d_str, "SLA\t%s\n",
 			reg[b2 & 7]);
 		return(2);
 	}
 	if (b2 >= 0x28 && b2 <=	0x2f) {
-		sprintf(Disass_Str, "SRA\t%s\n",
+		sprintf(ds->d_str, "SRA\t%s\n",
 			reg[b2 & 7]);
 		return(2);
 	}
 	if (b2 >= 0x38 && b2 <=	0x3f) {
-		sprintf(Disass_Str, "SRL\t%s\n",
+		sprintf(ds->d_str, "SRL\t%s\n",
 			reg[b2 & 7]);
 		return(2);
 	}
 	if (b2 >= 0x40 && b2 <=	0x7f) {
-		sprintf(Disass_Str, "BIT\t%c,%s\n",
+		sprintf(ds->d_str, "BIT\t%c,%s\n",
 			((b2 >> 3) & 7) + '0', reg[b2 &	7]);
 		return(2);
 	}
 	if (b2 >= 0x80 && b2 <=	0xbf) {
-		sprintf(Disass_Str, "RES\t%c,%s\n",
+		sprintf(ds->d_str, "RES\t%c,%s\n",
 			((b2 >> 3) & 7) + '0', reg[b2 &	7]);
 		return(2);
 	}
 	if (b2 >= 0xc0)	{
-		sprintf(Disass_Str, "SET\t%c,%s\n",
+		sprintf(ds->d_str, "SET\t%c,%s\n",
 			((b2 >> 3) & 7) + '0', reg[b2 &	7]);
 		return(2);
 	}
-	strcat(Disass_Str, unkown);
+	strcat(ds->d_str, unkown);
 	return(2);
 }
 
 /*
  *	disassemble multi byte op-codes with prefix 0xed
  */
-static int edop(char *s, unsigned char **p)
+static int edop(struct dis *ds, char *s, unsigned char **p)
 {
 	register int b2, i;
 	int len	= 2;
 
-	Disass_Str[0] = 0;
+	ds->d_str[0] = 0;
 	b2 = *(*p + 1);
 	switch (b2) {
 	case 0x40:
-		strcat(Disass_Str, "IN\tB,(C)\n");
+		strcat(ds->d_str, "IN\tB,(C)\n");
 		break;
 	case 0x41:
-		strcat(Disass_Str, "OUT\t(C),B\n");
+		strcat(ds->d_str, "OUT\t(C),B\n");
 		break;
 	case 0x42:
-		strcat(Disass_Str, "SBC\tHL,BC\n");
+		strcat(ds->d_str, "SBC\tHL,BC\n");
 		break;
 	case 0x43:
 		i = *(*p + 2) +	(*(*p +	3) << 8);
-		sprintf(Disass_Str, "LD\t(%04X),BC\n", i);
+		sprintf(ds->d_str, "LD\t(%04X),BC\n", i);
+		symout(ds, i, 0);
 		len = 4;
 		break;
 	case 0x44:
-		strcat(Disass_Str, "NEG\n");
+		strcat(ds->d_str, "NEG\n");
 		break;
 	case 0x45:
-		strcat(Disass_Str, "RETN\n");
+		strcat(ds->d_str, "RETN\n");
 		break;
 	case 0x46:
-		strcat(Disass_Str, "IM\t0\n");
+		strcat(ds->d_str, "IM\t0\n");
 		break;
 	case 0x47:
-		strcat(Disass_Str, "LD\tI,A\n");
+		strcat(ds->d_str, "LD\tI,A\n");
 		break;
 	case 0x48:
-		strcat(Disass_Str, "IN\tC,(C)\n");
+		strcat(ds->d_str, "IN\tC,(C)\n");
 		break;
 	case 0x49:
-		strcat(Disass_Str, "OUT\t(C),C\n");
+		strcat(ds->d_str, "OUT\t(C),C\n");
 		break;
 	case 0x4a:
-		strcat(Disass_Str, "ADC\tHL,BC\n");
+		strcat(ds->d_str, "ADC\tHL,BC\n");
 		break;
 	case 0x4b:
 		i = *(*p + 2) +	(*(*p +	3) << 8);
-		sprintf(Disass_Str, "LD\tBC,(%04X)\n", i);
+		sprintf(ds->d_str, "LD\tBC,(%04X)\n", i);
+		symout(ds, i, 0);
 		len = 4;
 		break;
 	case 0x4d:
-		strcat(Disass_Str, "RETI\n");
+		strcat(ds->d_str, "RETI\n");
 		break;
 	case 0x4f:
-		strcat(Disass_Str, "LD\tR,A\n");
+		strcat(ds->d_str, "LD\tR,A\n");
 		break;
 	case 0x50:
-		strcat(Disass_Str, "IN\tD,(C)\n");
+		strcat(ds->d_str, "IN\tD,(C)\n");
 		break;
 	case 0x51:
-		strcat(Disass_Str, "OUT\t(C),D\n");
+		strcat(ds->d_str, "OUT\t(C),D\n");
 		break;
 	case 0x52:
-		strcat(Disass_Str, "SBC\tHL,DE\n");
+		strcat(ds->d_str, "SBC\tHL,DE\n");
 		break;
 	case 0x53:
 		i = *(*p + 2) +	(*(*p +	3) << 8);
-		sprintf(Disass_Str, "LD\t(%04X),DE\n", i);
+		sprintf(ds->d_str, "LD\t(%04X),DE\n", i);
+		symout(ds, i, 0);
 		len = 4;
 		break;
 	case 0x56:
-		strcat(Disass_Str, "IM\t1\n");
+		strcat(ds->d_str, "IM\t1\n");
 		break;
 	case 0x57:
-		strcat(Disass_Str, "LD\tA,I\n");
+		strcat(ds->d_str, "LD\tA,I\n");
 		break;
 	case 0x58:
-		strcat(Disass_Str, "IN\tE,(C)\n");
+		strcat(ds->d_str, "IN\tE,(C)\n");
 		break;
 	case 0x59:
-		strcat(Disass_Str, "OUT\t(C),E\n");
+		strcat(ds->d_str, "OUT\t(C),E\n");
 		break;
 	case 0x5a:
-		strcat(Disass_Str, "ADC\tHL,DE\n");
+		strcat(ds->d_str, "ADC\tHL,DE\n");
 		break;
 	case 0x5b:
 		i = *(*p + 2) +	(*(*p +	3) << 8);
-		sprintf(Disass_Str, "LD\tDE,(%04X)\n", i);
+		sprintf(ds->d_str, "LD\tDE,(%04X)\n", i);
+		symout(ds, i, 0);
 		len = 4;
 		break;
 	case 0x5e:
-		strcat(Disass_Str, "IM\t2\n");
+		strcat(ds->d_str, "IM\t2\n");
 		break;
 	case 0x5f:
-		strcat(Disass_Str, "LD\tA,R\n");
+		strcat(ds->d_str, "LD\tA,R\n");
 		break;
 	case 0x60:
-		strcat(Disass_Str, "IN\tH,(C)\n");
+		strcat(ds->d_str, "IN\tH,(C)\n");
 		break;
 	case 0x61:
-		strcat(Disass_Str, "OUT\t(C),H\n");
+		strcat(ds->d_str, "OUT\t(C),H\n");
 		break;
 	case 0x62:
-		strcat(Disass_Str, "SBC\tHL,HL\n");
+		strcat(ds->d_str, "SBC\tHL,HL\n");
 		break;
 	case 0x67:
-		strcat(Disass_Str, "RRD\n");
+		strcat(ds->d_str, "RRD\n");
 		break;
 	case 0x68:
-		strcat(Disass_Str, "IN\tL,(C)\n");
+		strcat(ds->d_str, "IN\tL,(C)\n");
 		break;
 	case 0x69:
-		strcat(Disass_Str, "OUT\t(C),L\n");
+		strcat(ds->d_str, "OUT\t(C),L\n");
 		break;
 	case 0x6a:
-		strcat(Disass_Str, "ADC\tHL,HL\n");
+		strcat(ds->d_str, "ADC\tHL,HL\n");
 		break;
 	case 0x6f:
-		strcat(Disass_Str, "RLD\n");
+		strcat(ds->d_str, "RLD\n");
 		break;
 	case 0x72:
-		strcat(Disass_Str, "SBC\tHL,SP\n");
+		strcat(ds->d_str, "SBC\tHL,SP\n");
 		break;
 	case 0x73:
 		i = *(*p + 2) +	(*(*p +	3) << 8);
-		sprintf(Disass_Str, "LD\t(%04X),SP\n", i);
+		sprintf(ds->d_str, "LD\t(%04X),SP\n", i);
+		symout(ds, i, 0);
 		len = 4;
 		break;
 	case 0x78:
-		strcat(Disass_Str, "IN\tA,(C)\n");
+		strcat(ds->d_str, "IN\tA,(C)\n");
 		break;
 	case 0x79:
-		strcat(Disass_Str, "OUT\t(C),A\n");
+		strcat(ds->d_str, "OUT\t(C),A\n");
 		break;
 	case 0x7a:
-		strcat(Disass_Str, "ADC\tHL,SP\n");
+		strcat(ds->d_str, "ADC\tHL,SP\n");
 		break;
 	case 0x7b:
 		i = *(*p + 2) +	(*(*p +	3) << 8);
-		sprintf(Disass_Str, "LD\tSP,(%04X)\n", i);
+		sprintf(ds->d_str, "LD\tSP,(%04X)\n", i);
+		symout(ds, i, 0);
 		len = 4;
 		break;
 	case 0xa0:
-		strcat(Disass_Str, "LDI\n");
+		strcat(ds->d_str, "LDI\n");
 		break;
 	case 0xa1:
-		strcat(Disass_Str, "CPI\n");
+		strcat(ds->d_str, "CPI\n");
 		break;
 	case 0xa2:
-		strcat(Disass_Str, "INI\n");
+		strcat(ds->d_str, "INI\n");
 		break;
 	case 0xa3:
-		strcat(Disass_Str, "OUTI\n");
+		strcat(ds->d_str, "OUTI\n");
 		break;
 	case 0xa8:
-		strcat(Disass_Str, "LDD\n");
+		strcat(ds->d_str, "LDD\n");
 		break;
 	case 0xa9:
-		strcat(Disass_Str, "CPD\n");
+		strcat(ds->d_str, "CPD\n");
 		break;
 	case 0xaa:
-		strcat(Disass_Str, "IND\n");
+		strcat(ds->d_str, "IND\n");
 		break;
 	case 0xab:
-		strcat(Disass_Str, "OUTD\n");
+		strcat(ds->d_str, "OUTD\n");
 		break;
 	case 0xb0:
-		strcat(Disass_Str, "LDIR\n");
+		strcat(ds->d_str, "LDIR\n");
 		break;
 	case 0xb1:
-		strcat(Disass_Str, "CPIR\n");
+		strcat(ds->d_str, "CPIR\n");
 		break;
 	case 0xb2:
-		strcat(Disass_Str, "INIR\n");
+		strcat(ds->d_str, "INIR\n");
 		break;
 	case 0xb3:
-		strcat(Disass_Str, "OTIR\n");
+		strcat(ds->d_str, "OTIR\n");
 		break;
 	case 0xb8:
-		strcat(Disass_Str, "LDDR\n");
+		strcat(ds->d_str, "LDDR\n");
 		break;
 	case 0xb9:
-		strcat(Disass_Str, "CPDR\n");
+		strcat(ds->d_str, "CPDR\n");
 		break;
 	case 0xba:
-		strcat(Disass_Str, "INDR\n");
+		strcat(ds->d_str, "INDR\n");
 		break;
 	case 0xbb:
-		strcat(Disass_Str, "OTDR\n");
+		strcat(ds->d_str, "OTDR\n");
 		break;
 	default:
-		strcat(Disass_Str, unkown);
+		strcat(ds->d_str, unkown);
 	}
 	return(len);
 }
@@ -709,238 +830,242 @@ static int edop(char *s, unsigned char **p)
 /*
  *	disassemble multi byte op-codes with prefix 0xdd and 0xfd
  */
-static int ddfd(char *s, unsigned char **p)
+static int ddfd(struct dis *ds, char *s, unsigned char **p)
 {
 	register int b2;
 	register char *ireg;
 	int len	= 3;
 
+	ds->d_str[0] = 0;
 	if (**p	== 0xdd)
 		ireg = regix;
 	else
 		ireg = regiy;
 	b2 = *(*p + 1);
 	if (b2 >= 0x70 && b2 <=	0x77) {
-		sprintf(Disass_Str, "LD\t(%s+%02X),%s\n", ireg, *(*p	+ 2), reg[b2 & 7]);
+		sprintf(ds->d_str, "LD\t(%s+%02X),%s\n", ireg, *(*p	+ 2), reg[b2 & 7]);
 		return(3);
 	}
 	switch (b2) {
 	case 0x09:
-		sprintf(Disass_Str, "ADD\t%s,BC\n", ireg);
+		sprintf(ds->d_str, "ADD\t%s,BC\n", ireg);
 		len = 2;
 		break;
 	case 0x19:
-		sprintf(Disass_Str, "ADD\t%s,DE\n", ireg);
+		sprintf(ds->d_str, "ADD\t%s,DE\n", ireg);
 		len = 2;
 		break;
 	case 0x21:
-		sprintf(Disass_Str, "LD\t%s,%04X\n",	ireg, *(*p + 2)	+ (*(*p	+ 3) <<	8));
+		sprintf(ds->d_str, "LD\t%s,%04X\n",	ireg, *(*p + 2)	+ (*(*p	+ 3) <<	8));
+		symout(ds, *(*p + 2) + (*(*p + 3) << 8), 0);
 		len = 4;
 		break;
 	case 0x22:
-		sprintf(Disass_Str, "LD\t(%04X),%s\n", *(*p + 2) + (*(*p + 3) << 8),	ireg);
+		sprintf(ds->d_str, "LD\t(%04X),%s\n", *(*p + 2) + (*(*p + 3) << 8),	ireg);
+		symout(ds, *(*p + 2) + (*(*p + 3) << 8), 0);
 		len = 4;
 		break;
 	case 0x23:
-		sprintf(Disass_Str, "INC\t%s\n", ireg);
+		sprintf(ds->d_str, "INC\t%s\n", ireg);
 		len = 2;
 		break;
 	case 0x29:
 		if (**p	== 0xdd)
-			sprintf(Disass_Str, "ADD\tIX,IX\n");
+			sprintf(ds->d_str, "ADD\tIX,IX\n");
 		else
-			sprintf(Disass_Str, "ADD\tIY,IY\n");
+			sprintf(ds->d_str, "ADD\tIY,IY\n");
 		len = 2;
 		break;
 	case 0x2a:
-		sprintf(Disass_Str, "LD\t%s,(%04X)\n", ireg,	*(*p + 2) + (*(*p + 3) << 8));
+		sprintf(ds->d_str, "LD\t%s,(%04X)\n", ireg,	*(*p + 2) + (*(*p + 3) << 8));
+		symout(ds, *(*p + 2) + (*(*p + 3) << 8), 0);
 		len = 4;
 		break;
 	case 0x2b:
-		sprintf(Disass_Str, "DEC\t%s\n", ireg);
+		sprintf(ds->d_str, "DEC\t%s\n", ireg);
 		len = 2;
 		break;
 	case 0x34:
-		sprintf(Disass_Str, "INC\t(%s+%02X)\n", ireg, *(*p +	2));
+		sprintf(ds->d_str, "INC\t(%s+%02X)\n", ireg, *(*p +	2));
 		break;
 	case 0x35:
-		sprintf(Disass_Str, "DEC\t(%s+%02X)\n", ireg, *(*p +	2));
+		sprintf(ds->d_str, "DEC\t(%s+%02X)\n", ireg, *(*p +	2));
 		break;
 	case 0x36:
-		sprintf(Disass_Str, "LD\t(%s+%02X),%02X\n", ireg, *(*p + 2),	*(*p + 3));
+		sprintf(ds->d_str, "LD\t(%s+%02X),%02X\n", ireg, *(*p + 2),	*(*p + 3));
 		len = 4;
 		break;
 	case 0x39:
-		sprintf(Disass_Str, "ADD\t%s,SP\n", ireg);
+		sprintf(ds->d_str, "ADD\t%s,SP\n", ireg);
 		len = 2;
 		break;
 	case 0x46:
-		sprintf(Disass_Str, "LD\tB,(%s+%02X)\n", ireg, *(*p + 2));
+		sprintf(ds->d_str, "LD\tB,(%s+%02X)\n", ireg, *(*p + 2));
 		break;
 	case 0x4e:
-		sprintf(Disass_Str, "LD\tC,(%s+%02X)\n", ireg, *(*p + 2));
+		sprintf(ds->d_str, "LD\tC,(%s+%02X)\n", ireg, *(*p + 2));
 		break;
 	case 0x56:
-		sprintf(Disass_Str, "LD\tD,(%s+%02X)\n", ireg, *(*p + 2));
+		sprintf(ds->d_str, "LD\tD,(%s+%02X)\n", ireg, *(*p + 2));
 		break;
 	case 0x5e:
-		sprintf(Disass_Str, "LD\tE,(%s+%02X)\n", ireg, *(*p + 2));
+		sprintf(ds->d_str, "LD\tE,(%s+%02X)\n", ireg, *(*p + 2));
 		break;
 	case 0x66:
-		sprintf(Disass_Str, "LD\tH,(%s+%02X)\n", ireg, *(*p + 2));
+		sprintf(ds->d_str, "LD\tH,(%s+%02X)\n", ireg, *(*p + 2));
 		break;
 	case 0x6e:
-		sprintf(Disass_Str, "LD\tL,(%s+%02X)\n", ireg, *(*p + 2));
+		sprintf(ds->d_str, "LD\tL,(%s+%02X)\n", ireg, *(*p + 2));
 		break;
 	case 0x7e:
-		sprintf(Disass_Str, "LD\tA,(%s+%02X)\n", ireg, *(*p + 2));
+		sprintf(ds->d_str, "LD\tA,(%s+%02X)\n", ireg, *(*p + 2));
 		break;
 	case 0x86:
-		sprintf(Disass_Str, "ADD\tA,(%s+%02X)\n", ireg, *(*p	+ 2));
+		sprintf(ds->d_str, "ADD\tA,(%s+%02X)\n", ireg, *(*p	+ 2));
 		break;
 	case 0x8e:
-		sprintf(Disass_Str, "ADC\tA,(%s+%02X)\n", ireg, *(*p	+ 2));
+		sprintf(ds->d_str, "ADC\tA,(%s+%02X)\n", ireg, *(*p	+ 2));
 		break;
 	case 0x96:
-		sprintf(Disass_Str, "SUB\t(%s+%02X)\n", ireg, *(*p +	2));
+		sprintf(ds->d_str, "SUB\t(%s+%02X)\n", ireg, *(*p +	2));
 		break;
 	case 0x9e:
-		sprintf(Disass_Str, "SBC\tA,(%s+%02X)\n", ireg, *(*p	+ 2));
+		sprintf(ds->d_str, "SBC\tA,(%s+%02X)\n", ireg, *(*p	+ 2));
 		break;
 	case 0xa6:
-		sprintf(Disass_Str, "AND\t(%s+%02X)\n", ireg, *(*p +	2));
+		sprintf(ds->d_str, "AND\t(%s+%02X)\n", ireg, *(*p +	2));
 		break;
 	case 0xae:
-		sprintf(Disass_Str, "XOR\t(%s+%02X)\n", ireg, *(*p +	2));
+		sprintf(ds->d_str, "XOR\t(%s+%02X)\n", ireg, *(*p +	2));
 		break;
 	case 0xb6:
-		sprintf(Disass_Str, "OR\t(%s+%02X)\n", ireg,	*(*p + 2));
+		sprintf(ds->d_str, "OR\t(%s+%02X)\n", ireg,	*(*p + 2));
 		break;
 	case 0xbe:
-		sprintf(Disass_Str, "CP\t(%s+%02X)\n", ireg,	*(*p + 2));
+		sprintf(ds->d_str, "CP\t(%s+%02X)\n", ireg,	*(*p + 2));
 		break;
 	case 0xcb:
 		switch (*(*p + 3)) {
 		case 0x06:
-			sprintf(Disass_Str, "RLC\t(%s+%02X)\n", ireg, *(*p +	2));
+			sprintf(ds->d_str, "RLC\t(%s+%02X)\n", ireg, *(*p +	2));
 			break;
 		case 0x0e:
-			sprintf(Disass_Str, "RRC\t(%s+%02X)\n", ireg, *(*p +	2));
+			sprintf(ds->d_str, "RRC\t(%s+%02X)\n", ireg, *(*p +	2));
 			break;
 		case 0x16:
-			sprintf(Disass_Str, "RL\t(%s+%02X)\n", ireg,	*(*p + 2));
+			sprintf(ds->d_str, "RL\t(%s+%02X)\n", ireg,	*(*p + 2));
 			break;
 		case 0x1e:
-			sprintf(Disass_Str, "RR\t(%s+%02X)\n", ireg,	*(*p + 2));
+			sprintf(ds->d_str, "RR\t(%s+%02X)\n", ireg,	*(*p + 2));
 			break;
 		case 0x26:
-			sprintf(Disass_Str, "SLA\t(%s+%02X)\n", ireg, *(*p +	2));
+			sprintf(ds->d_str, "SLA\t(%s+%02X)\n", ireg, *(*p +	2));
 			break;
 		case 0x2e:
-			sprintf(Disass_Str, "SRA\t(%s+%02X)\n", ireg, *(*p +	2));
+			sprintf(ds->d_str, "SRA\t(%s+%02X)\n", ireg, *(*p +	2));
 			break;
 		case 0x3e:
-			sprintf(Disass_Str, "SRL\t(%s+%02X)\n", ireg, *(*p +	2));
+			sprintf(ds->d_str, "SRL\t(%s+%02X)\n", ireg, *(*p +	2));
 			break;
 		case 0x46:
-			sprintf(Disass_Str, "BIT\t0,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t0,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x4e:
-			sprintf(Disass_Str, "BIT\t1,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t1,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x56:
-			sprintf(Disass_Str, "BIT\t2,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t2,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x5e:
-			sprintf(Disass_Str, "BIT\t3,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t3,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x66:
-			sprintf(Disass_Str, "BIT\t4,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t4,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x6e:
-			sprintf(Disass_Str, "BIT\t5,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t5,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x76:
-			sprintf(Disass_Str, "BIT\t6,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t6,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x7e:
-			sprintf(Disass_Str, "BIT\t7,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "BIT\t7,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x86:
-			sprintf(Disass_Str, "RES\t0,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t0,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x8e:
-			sprintf(Disass_Str, "RES\t1,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t1,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x96:
-			sprintf(Disass_Str, "RES\t2,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t2,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0x9e:
-			sprintf(Disass_Str, "RES\t3,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t3,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xa6:
-			sprintf(Disass_Str, "RES\t4,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t4,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xae:
-			sprintf(Disass_Str, "RES\t5,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t5,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xb6:
-			sprintf(Disass_Str, "RES\t6,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t6,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xbe:
-			sprintf(Disass_Str, "RES\t7,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "RES\t7,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xc6:
-			sprintf(Disass_Str, "SET\t0,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t0,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xce:
-			sprintf(Disass_Str, "SET\t1,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t1,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xd6:
-			sprintf(Disass_Str, "SET\t2,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t2,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xde:
-			sprintf(Disass_Str, "SET\t3,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t3,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xe6:
-			sprintf(Disass_Str, "SET\t4,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t4,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xee:
-			sprintf(Disass_Str, "SET\t5,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t5,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xf6:
-			sprintf(Disass_Str, "SET\t6,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t6,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		case 0xfe:
-			sprintf(Disass_Str, "SET\t7,(%s+%02X)\n", ireg, *(*p	+ 2));
+			sprintf(ds->d_str, "SET\t7,(%s+%02X)\n", ireg, *(*p	+ 2));
 			break;
 		default:
-			strcat(Disass_Str, unkown);
+			strcat(ds->d_str, unkown);
 		}
 		len = 4;
 		break;
 	case 0xe1:
-		sprintf(Disass_Str, "POP\t%s\n", ireg);
+		sprintf(ds->d_str, "POP\t%s\n", ireg);
 		len = 2;
 		break;
 	case 0xe3:
-		sprintf(Disass_Str, "EX\t(SP),%s\n",	ireg);
+		sprintf(ds->d_str, "EX\t(SP),%s\n",	ireg);
 		len = 2;
 		break;
 	case 0xe5:
-		sprintf(Disass_Str, "PUSH\t%s\n", ireg);
+		sprintf(ds->d_str, "PUSH\t%s\n", ireg);
 		len = 2;
 		break;
 	case 0xe9:
-		sprintf(Disass_Str, "JP\t(%s)\n", ireg);
+		sprintf(ds->d_str, "JP\t(%s)\n", ireg);
 		len = 2;
 		break;
 	case 0xf9:
-		sprintf(Disass_Str, "LD\tSP,%s\n", ireg);
+		sprintf(ds->d_str, "LD\tSP,%s\n", ireg);
 		len = 2;
 		break;
 	default:
-		strcat(Disass_Str, unkown);
+		strcat(ds->d_str, unkown);
 	}
 	return(len);
 }
@@ -0,0 +1,663 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module is a stub for the gdb remote serial protocol, so
+ *	that gdb (or any other debugger which talks the protocol)
+ *	can debug the program in the simulator. The stub listens on
+ *	a local TCP port, or on a Unix domain socket if the argument
+ *	is no number:
+ *
+ *	z80sim -x prog.bin --gdb 1234
+ *	gdb -ex 'set architecture z80' -ex 'target remote :1234'
+ *
+ *	Breakpoints are bits in a bitmap which the CPU emulation tests
+ *	before an instruction, no op-codes are patched. Watchpoints
+ *	for writes use the decoded memory writes of the instruction,
+ *	the CPU stops after the instruction which wrote. Read and access
+ *	watchpoints are not supported, gdb tells the user so.
+ *
+ *	The registers are in the order of gdb's z80 target:
+ *	AF BC DE HL SP PC IX IY AF' BC' DE' HL' IR, 16 bit each.
+ *
+ *	One client is served at a time, the server ends with the
+ *	k packet.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "global.h"
+
+#define GDB_PKTSIZE	0x4000		/* max. size of a packet */
+#define GDB_WATCH	16		/* max. no. of watchpoints */
+#define GDB_NREGS	13		/* no. of registers for gdb */
+
+extern int mem_wrspan(WORD *, long *);
+
+static BYTE bp_sw[8192];		/* bitmaps of the breakpoints */
+static BYTE bp_hw[8192];
+static int bp_n;			/* no. of breakpoint addresses */
+static int bp_skip;			/* don't stop before the next op-code */
+
+static struct watch {			/* write watchpoints */
+	WORD w_adr;
+	int w_len;
+} wp[GDB_WATCH];
+static int wp_n;
+static int wp_hit;			/* address of the written watchpoint */
+
+static int gd_fd;			/* socket of the client */
+static int gd_noack;			/* no-ack mode */
+static int gd_quit;
+static BYTE gd_buf[GDB_PKTSIZE];	/* input buffer of the socket */
+static int gd_pos, gd_n;
+static char gd_pkt[GDB_PKTSIZE + 4];	/* received packet */
+static char gd_out[GDB_PKTSIZE + 4];	/* answer */
+static char gd_stop[64];		/* last stop reply */
+
+#define	BP(m, a)	(m[(a) >> 3] & (1 << ((a) & 7)))
+
+/*
+ *	Called from the CPU emulation before the instruction at PC
+ *	is executed, if bp_flag is set
+ *
+ *	Output: 1 stop at a breakpoint, 0 execute the instruction
+ */
+int bp_pre(void)
+{
+	register WORD pc = PC - ram;
+	register int i;
+	WORD adr;
+	long len;
+
+	wp_hit = -1;
+	if (bp_skip)
+		bp_skip = 0;
+	else if (BP(bp_sw, pc) || BP(bp_hw, pc)) {
+		cpu_error = BPTRAP;
+		cpu_state = STOPPED;
+		return(1);
+	}
+	if (wp_n && mem_wrspan(&adr, &len))
+		for (i = 0; i < wp_n; i++)
+			if ((WORD)(wp[i].w_adr - adr) < len
+			    || (WORD)(adr - wp[i].w_adr) < wp[i].w_len) {
+				wp_hit = wp[i].w_adr;
+				break;
+			}
+	return(0);
+}
+
+/*
+ *	Called from the CPU emulation after the instruction was
+ *	executed, if bp_flag is set
+ */
+void bp_post(void)
+{
+	if (wp_hit != -1) {
+		cpu_error = BPTRAP;
+		cpu_state = STOPPED;
+	}
+}
+
+static void bp_update(void)
+{
+	bp_flag = (bp_n || wp_n);
+}
+
+/*
+ *	Set or remove a breakpoint of the bitmap m at adr
+ */
+static void bp_set(BYTE *m, WORD adr, int set)
+{
+	register int was = BP(bp_sw, adr) || BP(bp_hw, adr);
+
+	if (set)
+		m[adr >> 3] |= 1 << (adr & 7);
+	else
+		m[adr >> 3] &= ~(1 << (adr & 7));
+	bp_n += (BP(bp_sw, adr) || BP(bp_hw, adr)) - was;
+	bp_update();
+}
+
+/*
+ *	Set or remove a write watchpoint
+ *
+ *	Output: 0 ok, 1 no free watchpoint or not found
+ */
+static int wp_set(WORD adr, int len, int set)
+{
+	register int i;
+
+	for (i = 0; i < wp_n; i++)
+		if (wp[i].w_adr == adr && wp[i].w_len == len)
+			break;
+	if (set) {
+		if (i == wp_n) {
+			if (wp_n == GDB_WATCH)
+				return(1);
+			wp[wp_n].w_adr = adr;
+			wp[wp_n++].w_len = len;
+		}
+	} else {
+		if (i == wp_n)
+			return(1);
+		wp[i] = wp[--wp_n];
+	}
+	bp_update();
+	return(0);
+}
+
+/*
+ *	gdb sends 0x03 to stop the running program, the socket
+ *	signals the input
+ */
+static void gd_sigio(int sig)
+{
+	cpu_state = STOPPED;
+	cpu_error = USERINT;
+}
+
+/*
+ *	Get the next byte from the socket
+ *
+ *	Output: the byte, -1 for end of connection
+ */
+static int gd_getc(void)
+{
+	register int n;
+
+	if (gd_pos == gd_n) {
+		do
+			n = read(gd_fd, gd_buf, sizeof(gd_buf));
+		while (n == -1 && errno == EINTR);
+		if (n <= 0)
+			return(-1);
+		gd_pos = 0;
+		gd_n = n;
+	}
+	return(gd_buf[gd_pos++]);
+}
+
+static void gd_write(char *p, int n)
+{
+	register int i;
+
+	while (n > 0) {
+		if ((i = send(gd_fd, p, n, MSG_NOSIGNAL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += i;
+		n -= i;
+	}
+}
+
+static int hexval(int c)
+{
+	if (isdigit(c))
+		return(c - '0');
+	if (c >= 'a' && c <= 'f')
+		return(c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return(c - 'A' + 10);
+	return(-1);
+}
+
+/*
+ *	Receive a packet into gd_pkt, bytes outside of packets
+ *	like the 0x03 of a stopped program are ignored
+ *
+ *	Output: length of the packet, -1 for end of connection
+ */
+static int gd_recv(void)
+{
+	register int c, n, sum;
+	int h, l;
+
+	for (;;) {
+		while ((c = gd_getc()) != '$')
+			if (c == -1)
+				return(-1);
+		n = sum = 0;
+		while ((c = gd_getc()) != '#') {
+			if (c == -1)
+				return(-1);
+			if (n < GDB_PKTSIZE)
+				gd_pkt[n++] = c;
+			sum += c;
+		}
+		if ((h = gd_getc()) == -1 || (l = gd_getc()) == -1)
+			return(-1);
+		if (gd_noack)
+			break;
+		if ((hexval(h) << 4) + hexval(l) == (sum & 0xff)) {
+			gd_write("+", 1);
+			break;
+		}
+		gd_write("-", 1);
+	}
+	gd_pkt[n] = '\0';
+	return(n);
+}
+
+/*
+ *	Send the packet s with n bytes, wait for the ack
+ */
+static void gd_send(char *s, int n)
+{
+	static char buf[GDB_PKTSIZE + 8];
+	register int i, sum = 0;
+	register int c;
+
+	buf[0] = '$';
+	for (i = 0; i < n; i++) {
+		buf[i + 1] = s[i];
+		sum += (BYTE) s[i];
+	}
+	sprintf(buf + n + 1, "#%02x", sum & 0xff);
+	do {
+		gd_write(buf, n + 4);
+		if (gd_noack)
+			return;
+		while ((c = gd_getc()) != '+' && c != '-')
+			if (c == -1)
+				return;
+	} while (c == '-');
+}
+
+static void gd_puts(char *s)
+{
+	gd_send(s, strlen(s));
+}
+
+/*
+ *	Parse a hex number at *s, advance *s behind it
+ */
+static unsigned long gd_hex(char **s)
+{
+	register unsigned long v = 0;
+	register int h;
+
+	while ((h = hexval(**s)) != -1) {
+		v = (v << 4) + h;
+		(*s)++;
+	}
+	return(v);
+}
+
+/*
+ *	The registers in the order of gdb
+ */
+static void gd_getregs(WORD *r)
+{
+	r[0] = (A << 8) + (F & 0xff);
+	r[1] = (B << 8) + C;
+	r[2] = (D << 8) + E;
+	r[3] = (H << 8) + L;
+	r[4] = STACK - ram;
+	r[5] = PC - ram;
+	r[6] = IX;
+	r[7] = IY;
+	r[8] = (A_ << 8) + (F_ & 0xff);
+	r[9] = (B_ << 8) + C_;
+	r[10] = (D_ << 8) + E_;
+	r[11] = (H_ << 8) + L_;
+	r[12] = (I << 8) + (R & 0xff);
+}
+
+static void gd_setregs(WORD *r)
+{
+	A = r[0] >> 8;
+	F = r[0] & 0xff;
+	B = r[1] >> 8;
+	C = r[1];
+	D = r[2] >> 8;
+	E = r[2];
+	H = r[3] >> 8;
+	L = r[3];
+	STACK = ram + r[4];
+	PC = ram + r[5];
+	IX = r[6];
+	IY = r[7];
+	A_ = r[8] >> 8;
+	F_ = r[8] & 0xff;
+	B_ = r[9] >> 8;
+	C_ = r[9];
+	D_ = r[10] >> 8;
+	E_ = r[10];
+	H_ = r[11] >> 8;
+	L_ = r[11];
+	I = r[12] >> 8;
+	R = r[12] & 0xff;
+}
+
+/*
+ *	Make the stop reply from cpu_error
+ */
+static void gd_stopped(void)
+{
+	register WORD pc = PC - ram;
+
+	switch (cpu_error) {
+	case BPTRAP:
+		if (wp_hit != -1)
+			sprintf(gd_stop, "T05watch:%04x;", wp_hit);
+		else
+			strcpy(gd_stop, BP(bp_hw, pc) ? "T05hwbreak:;" :
+			       "T05swbreak:;");
+		break;
+	case USERINT:
+		strcpy(gd_stop, "S02");		/* SIGINT */
+		break;
+	case IOTRAP:
+	case IOERROR:
+		strcpy(gd_stop, "S0a");		/* SIGBUS */
+		break;
+	case OPTRAP1:
+	case OPTRAP2:
+	case OPTRAP4:
+		strcpy(gd_stop, "S04");		/* SIGILL */
+		break;
+	case POWEROFF:
+		strcpy(gd_stop, "W00");
+		break;
+	default:				/* step, HALT */
+		strcpy(gd_stop, "S05");		/* SIGTRAP */
+		break;
+	}
+}
+
+/*
+ *	Continue or single step, a breakpoint at PC is passed
+ */
+static void gd_run(int step)
+{
+	struct sigaction sa, old;
+	register int fl;
+
+	wp_hit = -1;
+	bp_skip = 1;
+	mon_step();
+	if (!step && cpu_error == NONE) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = gd_sigio;
+		sigaction(SIGIO, &sa, &old);
+		fcntl(gd_fd, F_SETOWN, getpid());
+		fl = fcntl(gd_fd, F_GETFL);
+		fcntl(gd_fd, F_SETFL, fl | O_ASYNC);
+		mon_go();
+		fcntl(gd_fd, F_SETFL, fl);
+		sigaction(SIGIO, &old, NULL);
+	}
+	bp_skip = 0;
+	gd_stopped();
+	gd_puts(gd_stop);
+}
+
+/*
+ *	Execute a packet and send the answer
+ */
+static void gd_packet(int len)
+{
+	WORD r[GDB_NREGS];
+	char *s = gd_pkt + 1;
+	register char *o = gd_out;
+	register int i, n;
+	unsigned long adr, cnt, v;
+
+	switch (*gd_pkt) {
+	case '?':
+		gd_puts(gd_stop);
+		return;
+	case 'g':
+		gd_getregs(r);
+		for (i = 0; i < GDB_NREGS; i++)
+			o += sprintf(o, "%02x%02x", r[i] & 0xff, r[i] >> 8);
+		gd_puts(gd_out);
+		return;
+	case 'G':
+		gd_getregs(r);
+		for (i = 0; i < GDB_NREGS && strlen(s) >= 4; i++, s += 4)
+			r[i] = (hexval(s[0]) << 4) + hexval(s[1])
+			     + (hexval(s[2]) << 12) + (hexval(s[3]) << 8);
+		gd_setregs(r);
+		break;
+	case 'p':
+		if ((n = gd_hex(&s)) >= GDB_NREGS) {
+			gd_puts("E01");
+			return;
+		}
+		gd_getregs(r);
+		sprintf(gd_out, "%02x%02x", r[n] & 0xff, r[n] >> 8);
+		gd_puts(gd_out);
+		return;
+	case 'P':
+		n = gd_hex(&s);
+		if (n >= GDB_NREGS || *s++ != '=' || strlen(s) < 4) {
+			gd_puts("E01");
+			return;
+		}
+		gd_getregs(r);
+		r[n] = (hexval(s[0]) << 4) + hexval(s[1])
+		     + (hexval(s[2]) << 12) + (hexval(s[3]) << 8);
+		gd_setregs(r);
+		break;
+	case 'm':
+		adr = gd_hex(&s);
+		s++;
+		if ((cnt = gd_hex(&s)) > GDB_PKTSIZE / 2)
+			cnt = GDB_PKTSIZE / 2;
+		for (i = 0; i < cnt; i++)
+			o += sprintf(o, "%02x", ram[(WORD)(adr + i)]);
+		gd_puts(gd_out);
+		return;
+	case 'M':
+		adr = gd_hex(&s);
+		s++;
+		cnt = gd_hex(&s);
+		if (*s++ != ':' || strlen(s) < cnt * 2) {
+			gd_puts("E01");
+			return;
+		}
+		for (i = 0; i < cnt; i++, s += 2)
+			ram[(WORD)(adr + i)] = (hexval(s[0]) << 4) + hexval(s[1]);
+#ifdef SNSIZE
+		snap_dirty();
+#endif
+		break;
+	case 'X':			/* binary, 0x7d escapes the next byte */
+		adr = gd_hex(&s);
+		s++;
+		cnt = gd_hex(&s);
+		if (*s++ != ':') {
+			gd_puts("E01");
+			return;
+		}
+		for (i = 0; i < cnt && s < gd_pkt + len; i++) {
+			if (*s == 0x7d)
+				v = *++s ^ 0x20;
+			else
+				v = *s;
+			s++;
+			ram[(WORD)(adr + i)] = v;
+		}
+#ifdef SNSIZE
+		snap_dirty();
+#endif
+		break;
+	case 'c':
+	case 's':
+		if (*s)
+			PC = ram + (WORD) gd_hex(&s);
+		gd_run(*gd_pkt == 's');
+		return;
+	case 'Z':
+	case 'z':
+		n = gd_hex(&s);
+		s++;
+		adr = gd_hex(&s);
+		s++;
+		cnt = gd_hex(&s);
+		switch (n) {
+		case 0:
+		case 1:
+			bp_set(n ? bp_hw : bp_sw, adr, *gd_pkt == 'Z');
+			break;
+		case 2:
+			if (wp_set(adr, cnt ? cnt : 1, *gd_pkt == 'Z')) {
+				gd_puts("E01");
+				return;
+			}
+			break;
+		default:		/* read and access watchpoints */
+			gd_puts("");
+			return;
+		}
+		break;
+	case 'q':
+		if (strncmp(s, "Supported", 9) == 0) {
+			sprintf(gd_out, "PacketSize=%x;QStartNoAckMode+;"
+				"swbreak+;hwbreak+", GDB_PKTSIZE);
+			gd_puts(gd_out);
+		} else if (strcmp(s, "Attached") == 0)
+			gd_puts("1");
+		else if (strcmp(s, "C") == 0)
+			gd_puts("QC1");
+		else
+			gd_puts("");
+		return;
+	case 'Q':
+		if (strcmp(s, "StartNoAckMode") == 0) {
+			gd_puts("OK");
+			gd_noack = 1;
+		} else
+			gd_puts("");
+		return;
+	case 'H':
+		break;
+	case 'k':
+		gd_quit = 1;
+		return;
+	case 'D':
+		gd_puts("OK");
+		close(gd_fd);
+		gd_fd = -1;
+		return;
+	default:
+		gd_puts("");
+		return;
+	}
+	gd_puts("OK");
+}
+
+/*
+ *	Open the listening socket, a local TCP port if arg is a number,
+ *	else a Unix domain socket
+ *
+ *	Output: socket, -1 for error
+ */
+static int gd_listen(char *arg)
+{
+	struct sockaddr_in si;
+	struct sockaddr_un su;
+	register int s;
+	int on = 1;
+
+	if (*arg == ':')
+		arg++;
+	if (isdigit((int)*arg)) {
+		if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+			perror("socket");
+			return(-1);
+		}
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		memset(&si, 0, sizeof(si));
+		si.sin_family = AF_INET;
+		si.sin_port = htons(atoi(arg));
+		si.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(s, (struct sockaddr *) &si, sizeof(si)) == -1)
+			goto err;
+	} else {
+		if (strlen(arg) >= sizeof(su.sun_path)) {
+			printf("socket name %s too long\n", arg);
+			return(-1);
+		}
+		if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+			perror("socket");
+			return(-1);
+		}
+		memset(&su, 0, sizeof(su));
+		su.sun_family = AF_UNIX;
+		strcpy(su.sun_path, arg);
+		unlink(arg);
+		if (bind(s, (struct sockaddr *) &su, sizeof(su)) == -1)
+			goto err;
+	}
+	if (listen(s, 1) == -1)
+		goto err;
+	return(s);
+
+	err:
+	perror(arg);
+	close(s);
+	return(-1);
+}
+
+/*
+ *	Serve gdb on the local TCP port or Unix domain socket arg,
+ *	until gdb kills the program
+ *
+ *	Output: 0 ok, 1 error
+ */
+int gdb_serve(char *arg)
+{
+	register int s, n;
+
+	if ((s = gd_listen(arg)) == -1)
+		return(1);
+	printf("gdb remote on %s\n", arg);
+	fflush(stdout);
+	strcpy(gd_stop, "S05");
+	gd_quit = 0;
+	while (!gd_quit) {
+		if ((gd_fd = accept(s, NULL, NULL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			break;
+		}
+		gd_pos = gd_n = 0;
+		gd_noack = 0;
+		while (!gd_quit && gd_fd != -1 && (n = gd_recv()) != -1)
+			gd_packet(n);
+		if (gd_fd != -1)
+			close(gd_fd);
+	}
+	close(s);
+	if (!isdigit((int)*arg) && *arg != ':')
+		unlink(arg);
+	memset(bp_sw, 0, sizeof(bp_sw));
+	memset(bp_hw, 0, sizeof(bp_hw));
+	bp_n = wp_n = 0;
+	bp_update();
+	return(0);
+}
@@ -56,6 +56,7 @@ BYTE cpu_bus;
 #endif
 
 BYTE mem_wp;			/* memory write-protect flag */
+BYTE bp_flag;			/* gdb breakpoints or watchpoints set */
 
 /*
  *	Variables for memory of the emulated CPU
@@ -67,9 +68,30 @@ BYTE *wrk_ram;			/* workpointer into memory for dump etc. */
  *	Variables for history memory
  */
 #ifdef HISIZE
-struct history his[HISIZE];	/* memory to hold trace informations */
-int h_next;			/* index into trace memory */
-int h_flag;			/* flag for trace memory overrun */
+long h_size = HISIZE;		/* no. of entrys in history, option -H */
+int h_flag;			/* flag, 1 = history on, 0 = off */
+#endif
+
+/*
+ *	Variables for instruction trace
+ */
+#ifdef WANT_TRACE
+int tr_flag;			/* flag, 1 = trace on, 0 = off */
+#endif
+
+/*
+ *	Variables for the profiler
+ */
+#ifdef WANT_PROF
+int p_flag;			/* flag, 1 = profiler on, 0 = off */
+int cg_flag;			/* flag, 1 = call graph on, 0 = off */
+#endif
+
+/*
+ *	Variables for the code coverage
+ */
+#ifdef WANT_COV
+int cov_flag;			/* flag, 1 = coverage on, 0 = off */
 #endif
 
 /*
@@ -88,6 +110,19 @@ long t_states;			/* number of counted T states */
 int t_flag;			/* flag, 1 = on, 0 = off */
 BYTE *t_start =	ram + 65535;	/* start address for measurement */
 BYTE *t_end = ram + 65535;	/* end address for measurement */
+unsigned long long cpu_steps;	/* no. of executed instructions */
+unsigned long long cpu_tstates;	/* no. of executed T states */
+unsigned long long cpu_tstop = ~0ULL;	/* stop CPU at cpu_tstates, z80_run() */
+int cpu_halt;			/* flag, 1 = in HALT until an interrupt */
+#endif
+
+/*
+ *	Variables for snapshots
+ */
+#ifdef SNSIZE
+unsigned long long sn_stop = ~0ULL;	/* stop CPU at cpu_steps */
+unsigned long long sn_tev = ~0ULL;	/* call snap_event() at cpu_tstates */
+int sn_wflag;			/* flag, 1 = track memory pages written */
 #endif
 
 /*
@@ -112,7 +147,21 @@ int f_flag;			/* flag for -f option */
 int z_flag;			/* flag for -z option */
 #endif
 int q_flag;			/* flag for -q option */
+int r_flag;			/* flag for --restore option */
+int b_flag;			/* flag for batch mode, --script or no tty */
 char xfn[LENCMD];		/* buffer for filename (option -x) */
+char *sa_arg;			/* argument of --snapshot-at option */
+char *ru_arg;			/* argument of --run-until option */
+char *b_file;			/* script file of --script option */
+char *rpc_path;			/* socket of --rpc option */
+char *gdb_arg;			/* port or socket of --gdb option */
+char *bn_arg;			/* seconds and file of --bench option */
+char *ob_arg;			/* count and file of --opbench option */
+char *ls_arg;			/* peer and block size of --lockstep option */
+char *fz_arg;			/* cases and seed of --fuzz option */
+int pe_flag;			/* serve as peer of --lockstep */
+char *cp_arg;			/* COM file of --cpm option */
+int tc_flag;			/* instructions and T-states must be counted */
 BYTE cpu_state;			/* status of CPU emulation */
 int cpu_error;			/* error status of CPU emulation */
 int int_type;			/* type	of interrupt */
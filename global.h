@@ -34,7 +34,10 @@ extern BYTE	A, B, C, D, E, H, L, A_, B_, C_, D_, E_, H_, L_,
 extern WORD	IX, IY;
 extern int	F, F_;
 extern long	R;
-extern BYTE	mem_wp;
+extern BYTE	mem_wp, bp_flag;
+extern void	rom_set(WORD, long), rom_clear(void), rom_pre(void), rom_post(void);
+extern void	mem_map(WORD, long, int, int), mem_hook(void (*)(WORD, BYTE));
+extern int	rom_test(WORD);
 
 #ifdef BUS_8080
 extern BYTE	cpu_bus;
@@ -42,7 +45,7 @@ extern BYTE	cpu_bus;
 
 extern BYTE	ram[],*wrk_ram, cpu_state;
 
-extern int	s_flag, l_flag, m_flag, x_flag, break_flag, i_flag, f_flag, q_flag,
+extern int	s_flag, l_flag, m_flag, x_flag, break_flag, i_flag, f_flag, q_flag, r_flag, b_flag,
 		cpu_error, int_type, int_mode, int_lsb, int_vect, cntl_c, cntl_bs,
 		parrity[], sb_next;
 
@@ -53,13 +56,61 @@ extern int	z_flag;
 extern int	tmax;
 extern int	busy_loop_cnt[];
 
-extern char	xfn[];
+extern char	xfn[], *sa_arg, *ru_arg, *b_file, *rpc_path, *gdb_arg, *bn_arg, *ob_arg,
+		*ls_arg, *fz_arg, *cp_arg;
+extern int	pe_flag, tc_flag;
 
 #ifdef HISIZE
-extern struct	history	his[];
-extern int	h_next,	h_flag;
+extern int	h_flag;
+extern long	h_size;
+extern int	hist_init(long), hist_first(struct histit *);
+extern int	hist_next(struct histit *, struct history *);
+extern void	hist_put(void), hist_undo(void), hist_clear(void);
+extern unsigned long hist_size(void);
 #endif
 
+#ifdef WANT_TRACE
+extern int	tr_flag;
+extern int	trace_open(char *, int), trace_dump(char *, unsigned long long);
+extern void	trace_close(void), trace_stat(void), trace_undo(void);
+extern void	trace_pre(void), trace_post(int), trace_int(BYTE *);
+extern void	trace_io(int, BYTE, BYTE);
+#endif
+
+#ifdef WANT_PROF
+extern int	p_flag;
+extern void	prof_put(WORD, int), prof_clear(void);
+extern int	prof_write(char *);
+extern int	cg_flag;
+extern void	cg_call(WORD, int), cg_ret(int), cg_clear(void);
+extern void	cg_print(int);
+extern int	cg_write(char *, int);
+#endif
+
+#ifdef WANT_COV
+extern int	cov_flag;
+extern void	cov_put(WORD), cov_clear(void), cov_stat(void);
+extern int	cov_save(char *, int), cov_merge(char *);
+extern int	cov_report(char *, int, char *);
+#endif
+
+extern int	core_save(char *), core_load(char *);
+extern int	clone_run(int, char *, char *, int);
+extern int	dasm_image(char *, WORD *, int);
+extern int	run_until(char *), mon_step(void), mon_go(void);
+extern int	mon_break(WORD, int), mon_clear(WORD);
+extern int	rpc_serve(char *), gdb_serve(char *), bench_run(char *);
+extern int	opbench_run(char *), lockstep_run(char *, char *), lockstep_peer(void);
+extern int	cpm_run(char *), core_set(char *);
+extern char	*core_name(int *), *core_why(void);
+extern int	bp_pre(void);
+extern void	bp_post(void);
+
+extern int	sym_load(char *), sym_count(void);
+extern char	*sym_lookup(WORD, int *), *sym_get(int, WORD *);
+extern char	*sym_str(WORD, int, char *, int);
+extern void	sym_clear(void);
+
 #ifdef SBSIZE
 extern struct	softbreak soft[];
 #endif
@@ -68,6 +119,20 @@ extern struct	softbreak soft[];
 extern long	t_states;
 extern int	t_flag;
 extern BYTE	*t_start, *t_end;
+extern unsigned long long cpu_steps, cpu_tstates, cpu_tstop;
+extern int	cpu_halt;
+#endif
+
+#ifdef SNSIZE
+extern unsigned long long sn_stop, sn_tev;
+extern int	sn_wflag;
+extern void	snap_wr(WORD, long);
+extern void	snap_event(void), snap_sync(void), snap_dirty(void);
+extern void	snap_clear(void), snap_stat(void), snap_setint(long);
+extern void	snap_putin(int, BYTE *, int);
+extern int	snap_isdirty(void), snap_replay(void), snap_getin(int, BYTE *);
+extern int	snap_rstep(unsigned long long), snap_tgoto(unsigned long long);
+extern int	snap_rcont(void), snap_on(void);
 #endif
 
 #ifdef FRONTPANEL
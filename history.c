@@ -0,0 +1,237 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module contains the history memory of the CPU emulation.
+ *
+ *	The history is a ring buffer of bytes, its size is a power
+ *	of two, so that all indexing is done with a mask. Every
+ *	executed instruction stores one record:
+ *
+ *		mask	one byte, bit 0-6 = AF BC DE HL IX IY SP follow,
+ *			bit 7 = key record, all registers follow
+ *		adr	address of execution, low byte first
+ *		regs	the registers flagged in mask, low byte first
+ *
+ *	Only the registers which changed since the record before
+ *	are stored, so a typical record has 5 bytes. Every h_keyint
+ *	records a key record with all registers is written, decoding
+ *	of the ring starts at the oldest key record still in memory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "global.h"
+
+#ifdef HISIZE
+
+#define H_AVGREC	8	/* bytes reserved for each history entry */
+#define H_KEYINT	64	/* records between two key records */
+#define H_NREG		7	/* no. of registers in a record */
+#define H_MAXREC	(3 + 2 * H_NREG) /* size of a key record */
+#define H_KEY		0x80	/* mask bit for key records */
+
+static BYTE *h_buf;			/* ring buffer for the records */
+static unsigned long h_mask;		/* size of h_buf - 1 */
+static unsigned long long h_wr;		/* absolute write offset */
+static unsigned long long h_last;	/* offset of the last record */
+static unsigned long long *h_key;	/* offsets of the key records */
+static unsigned long h_kmask;		/* size of h_key - 1 */
+static unsigned long long h_nkey;	/* no. of key records written */
+static int h_cnt;			/* records since last key record */
+static int h_keyint;			/* records between two key records */
+static WORD h_prev[H_NREG];		/* registers of the last record */
+static WORD h_undo[H_NREG];		/* registers before the last record */
+
+/*
+ *	Round up to the next power of two
+ */
+static unsigned long pow2(unsigned long n)
+{
+	unsigned long p = 1;
+
+	while (p < n)
+		p <<= 1;
+	return(p);
+}
+
+/*
+ *	Allocate history memory for about n instructions,
+ *	n = 0 releases the memory and switches the history off.
+ *
+ *	Output: 0 ok, 1 not enough memory
+ */
+int hist_init(long n)
+{
+	free(h_buf);
+	free(h_key);
+	h_buf = NULL;
+	h_key = NULL;
+	h_mask = h_kmask = 0;
+	h_flag = 0;
+	if (n <= 0)
+		return(0);
+	h_mask = pow2(n * H_AVGREC) - 1;
+	/* small rings need more key records to find a start point */
+	h_keyint = (h_mask + 1) / (2 * H_MAXREC);
+	if (h_keyint > H_KEYINT)
+		h_keyint = H_KEYINT;
+	if (h_keyint < 1)
+		h_keyint = 1;
+	h_kmask = pow2((h_mask + 1) / (h_keyint * 3) + 2) - 1;
+	if ((h_buf = malloc(h_mask + 1)) == NULL ||
+	    (h_key = malloc((h_kmask + 1) * sizeof(*h_key))) == NULL) {
+		free(h_buf);
+		h_buf = NULL;
+		h_mask = h_kmask = 0;
+		return(1);
+	}
+	hist_clear();
+	h_flag = 1;
+	return(0);
+}
+
+/*
+ *	Size of the history memory in bytes
+ */
+unsigned long hist_size(void)
+{
+	return(h_buf ? h_mask + 1 : 0);
+}
+
+/*
+ *	Clear the history memory
+ */
+void hist_clear(void)
+{
+	h_wr = h_last = 0;
+	h_nkey = 0;
+	h_cnt = 0;
+}
+
+/*
+ *	Write a history record for the instruction PC points to,
+ *	called from the CPU emulation before the instruction
+ *	is executed.
+ */
+void hist_put(void)
+{
+	register unsigned long long w = h_wr;
+	register int i, m;
+	WORD r[H_NREG];
+
+	r[0] = (A << 8) + F;
+	r[1] = (B << 8) + C;
+	r[2] = (D << 8) + E;
+	r[3] = (H << 8) + L;
+	r[4] = IX;
+	r[5] = IY;
+	r[6] = STACK - ram;
+
+	memcpy(h_undo, h_prev, sizeof(h_prev));
+	h_last = w;
+
+	if (h_cnt == 0) {
+		m = H_KEY | ((1 << H_NREG) - 1);
+		h_key[h_nkey++ & h_kmask] = w;
+	} else {
+		m = 0;
+		for (i = 0; i < H_NREG; i++)
+			if (r[i] != h_prev[i])
+				m |= 1 << i;
+	}
+	if (++h_cnt == h_keyint)
+		h_cnt = 0;
+
+	h_buf[w++ & h_mask] = m;
+	h_buf[w++ & h_mask] = PC - ram;
+	h_buf[w++ & h_mask] = (PC - ram) >> 8;
+	for (i = 0; i < H_NREG; i++)
+		if (m & (1 << i)) {
+			h_buf[w++ & h_mask] = r[i];
+			h_buf[w++ & h_mask] = r[i] >> 8;
+			h_prev[i] = r[i];
+		}
+	h_wr = w;
+}
+
+/*
+ *	Remove the last record from the history, used if a
+ *	software breakpoint was hit and the original op-code
+ *	is executed again. Only the last record can be removed.
+ */
+void hist_undo(void)
+{
+	if (h_wr == h_last)
+		return;
+	if ((h_buf[h_last & h_mask] & H_KEY) && h_nkey) {
+		h_nkey--;
+		h_cnt = 0;
+	} else if (h_cnt)
+		h_cnt--;
+	else
+		h_cnt = h_keyint - 1;
+	memcpy(h_prev, h_undo, sizeof(h_prev));
+	h_wr = h_last;		/* only one record can be removed */
+}
+
+/*
+ *	Start iteration over the history memory at the oldest
+ *	record which can be decoded.
+ *
+ *	Output: 0 ok, 1 history empty
+ */
+int hist_first(struct histit *it)
+{
+	register unsigned long long k, first;
+
+	if (h_buf == NULL || h_nkey == 0)
+		return(1);
+	first = (h_wr > h_mask) ? h_wr - h_mask - 1 : 0;
+	k = (h_nkey > h_kmask) ? h_nkey - h_kmask - 1 : 0;
+	while (k < h_nkey && h_key[k & h_kmask] < first)
+		k++;
+	if (k == h_nkey)
+		return(1);
+	it->hi_off = h_key[k & h_kmask];
+	return(0);
+}
+
+/*
+ *	Decode the next record from the history memory
+ *
+ *	Output: 0 ok, 1 no more records
+ */
+int hist_next(struct histit *it, struct history *h)
+{
+	register unsigned long long r = it->hi_off;
+	register int i, m;
+
+	if (r >= h_wr)
+		return(1);
+	m = h_buf[r++ & h_mask];
+	h->h_adr = h_buf[r++ & h_mask];
+	h->h_adr += h_buf[r++ & h_mask] << 8;
+	for (i = 0; i < H_NREG; i++)
+		if (m & (1 << i)) {
+			it->hi_reg[i] = h_buf[r++ & h_mask];
+			it->hi_reg[i] += h_buf[r++ & h_mask] << 8;
+		}
+	h->h_af = it->hi_reg[0];
+	h->h_bc = it->hi_reg[1];
+	h->h_de = it->hi_reg[2];
+	h->h_hl = it->hi_reg[3];
+	h->h_ix = it->hi_reg[4];
+	h->h_iy = it->hi_reg[5];
+	h->h_sp = it->hi_reg[6];
+	it->hi_off = r;
+	return(0);
+}
+
+#endif
@@ -32,6 +32,7 @@
 
 #include "config.h"
 #include "global.h"
+#include "variant.h"
 
 #ifdef FRONTPANEL
 #include "../../frontpanel/frontpanel.h"
@@ -61,7 +62,7 @@ static int op_undoc_ldixl(void);
 static int op_undoc_cpixl(void);
 #endif
 
-long op_dd_handel(void)
+int op_dd_handel(void)
 {
 	register int t;
 
@@ -333,11 +334,7 @@ long op_dd_handel(void)
 	};
 
 
-#ifdef WANT_TIM
 	t = (*op_dd[*PC++]) ();		/* execute next opcode */
-#else
-	(*op_dd[*PC++]) ();
-#endif
 
 #ifdef WANT_PCC
 		if (PC > ram + 65535)	/* correct PC overrun */
@@ -32,6 +32,7 @@
 
 #include "config.h"
 #include "global.h"
+#include "variant.h"
 
 #ifdef FRONTPANEL
 #include "../../frontpanel/frontpanel.h"
@@ -321,11 +322,7 @@ int op_ed_handel(void)
 		trap_ed				/* 0xff	*/
 	};
 
-#ifdef WANT_TIM
 	t = (*op_ed[*PC++]) ();		/* execute next opcode */
-#else
-	(*op_ed[*PC++]) ();
-#endif
 
 #ifdef WANT_PCC
 		if (PC > ram + 65535)	/* correct PC overrun */
@@ -385,6 +382,10 @@ static int op_reti(void)		/* RETI */
 		STACK =	ram;
 #endif
 	PC = ram + i;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_ret(14);
+#endif
 	return(14);
 }
 
@@ -409,6 +410,10 @@ static int op_retn(void)		/* RETN */
 		STACK =	ram;
 #endif
 	PC = ram + i;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_ret(14);
+#endif
 	if (IFF & 2)
 		IFF |= 1;
 	return(14);
@@ -772,7 +777,7 @@ static int op_outi(void)		/* OUTI */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	io_out(C, *(ram	+ (H <<	8) * L));
+	io_out(C, *(ram	+ (H <<	8) + L));
 #ifdef BUS_8080
 	cpu_bus = CPU_OUT;
 #endif
@@ -828,7 +833,7 @@ static int op_outd(void)		/* OUTD */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	io_out(C, *(ram	+ (H <<	8) * L));
+	io_out(C, *(ram	+ (H <<	8) + L));
 #ifdef BUS_8080
 	cpu_bus = CPU_OUT;
 #endif
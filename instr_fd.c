@@ -32,6 +32,7 @@
 
 #include "config.h"
 #include "global.h"
+#include "variant.h"
 
 #ifdef FRONTPANEL
 #include "../../frontpanel/frontpanel.h"
@@ -321,11 +322,7 @@ int op_fd_handel(void)
 		trap_fd				/* 0xff	*/
 	};
 
-#ifdef WANT_TIM
 	t = (*op_fd[*PC++]) ();		/* execute next opcode */
-#else
-	(*op_fd[*PC++]) ();
-#endif
 
 #ifdef WANT_PCC
 		if (PC > ram + 65535)	/* correct PC overrun */
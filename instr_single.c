@@ -30,6 +30,7 @@
 #include <time.h>
 #include "config.h"
 #include "global.h"
+#include "variant.h"
 
 #ifdef FRONTPANEL
 #include "../../frontpanel/frontpanel.h"
@@ -42,6 +43,9 @@ void check_gui_break(void);
 #ifdef WANT_COUNTERS
 extern void run_counters(void);
 #endif
+#ifdef SNSIZE
+extern int mem_wrspan(WORD *, long *);
+#endif
 
 //static int op_notimpl(void);
 static int op_nop(void), op_halt(void), op_scf(void);
@@ -389,14 +393,32 @@ void cpu(void)
 
 #ifdef WANT_TIM
 	register int t = 0;
-	struct timespec timer;
-#ifdef FRONTPANEL
 	register int states;
+	struct timespec timer;
+#endif
+#ifdef WANT_INT
+#if defined(WANT_TRACE) || defined(WANT_PROF) || defined(SNSIZE)
+	BYTE *int_pc;
 #endif
+#endif
+#ifdef SNSIZE
+	WORD wr_adr;
+	long wr_len;
+#endif
+#if defined(WANT_PROF) || defined(WANT_COV)
+	BYTE *op_pc;
+#endif
+
+#ifdef SNSIZE		/* state was modified, new timeline for snapshots */
+	if (snap_isdirty())
+		snap_sync();
 #endif
 
 	do {
 
+		if (bp_flag && bp_pre())	/* gdb breakpoint at PC */
+			break;
+
 #ifdef FRONTPANEL	/* update frontpanel */
 		fp_led_address = PC - ram;
 		fp_led_data = *PC;
@@ -412,19 +434,8 @@ void cpu(void)
 #endif
 
 #ifdef HISIZE		/* write history */
-		his[h_next].h_adr = PC - ram;
-		his[h_next].h_af = (A << 8) + F;
-		his[h_next].h_bc = (B << 8) + C;
-		his[h_next].h_de = (D << 8) + E;
-		his[h_next].h_hl = (H << 8) + L;
-		his[h_next].h_ix = IX;
-		his[h_next].h_iy = IY;
-		his[h_next].h_sp = STACK - ram;
-		h_next++;
-		if (h_next == HISIZE) {
-			h_flag = 1;
-			h_next = 0;
-		}
+		if (h_flag)
+			hist_put();
 #endif
 
 #ifdef WANT_TIM		/* check for start address of runtime measurement */
@@ -439,6 +450,9 @@ void cpu(void)
 #endif
 
 #ifdef WANT_INT		/* CPU interrupt handling */
+#if defined(WANT_TRACE) || defined(WANT_PROF) || defined(SNSIZE)
+		int_pc = PC;
+#endif
 		if (int_type) // if there is an interrupt available to handle
 			// TODO: this could be reworked to be cleaner
 			// source info: http://www.z80.info/interrup.htm
@@ -447,6 +461,9 @@ void cpu(void)
 			case INT_NMI: // NMIs	
 				int_type = INT_NONE; // ack the interrupt
 				IFF &= 0x02; // clear IFF1 
+#ifdef WANT_TIM
+				cpu_halt = 0; // leave HALT, PC is past it
+#endif
 
 				// this block stores the current execution address on the stack
 #ifdef WANT_SPC
@@ -469,6 +486,9 @@ void cpu(void)
 			case INT_INT:	// maskable ints
 				if (!(IFF&0x01)) break; // ints only accepted if IFF1 is set
 				IFF=0x00; // if the interrupt is accepted, IFF1 and 2 are cleared 
+#ifdef WANT_TIM
+				cpu_halt = 0; // leave HALT, PC is past it
+#endif
 	
 				switch (int_mode) {
 					case 0: // TODO
@@ -513,15 +533,43 @@ void cpu(void)
 				}
 				break;
 			}
+#ifdef WANT_TRACE
+		if (tr_flag && PC != int_pc)
+			trace_int(int_pc);
+#endif
+#ifdef WANT_PROF
+		if (cg_flag && PC != int_pc)
+			cg_call(PC - ram, 0);
+#endif
+#ifdef SNSIZE
+		if (sn_wflag && PC != int_pc)
+			snap_wr(STACK - ram, 2);
+#endif
+#endif
+
+#ifdef WANT_TRACE	/* write trace record of the op-code */
+		if (tr_flag)
+			trace_pre();
+#endif
+#if defined(WANT_PROF) || defined(WANT_COV)
+		op_pc = PC;
+#endif
+#ifdef SNSIZE		/* memory pages written, for snapshots */
+		if (sn_wflag && mem_wrspan(&wr_adr, &wr_len))
+			snap_wr(wr_adr, wr_len);
 #endif
 
+		if (mem_wp)		/* save ROM the op-code writes */
+			rom_pre();
+
 #ifdef WANT_TIM
-#ifdef FRONTPANEL
-		states = (*op_sim[*PC++]) ();	/* execute next opcode */
+		if (cpu_halt)			/* in HALT, NOPs until an */
+			states = 4;		/* interrupt is accepted */
+		else
+			states = (*op_sim[*PC++]) ();	/* execute next opcode */
 		t += states;
+#ifdef FRONTPANEL
 		fp_clock += states;
-#else
-		t += (*op_sim[*PC++]) ();
 #endif
 		if (f_flag) {		/* adjust CPU speed */
 			if (t > tmax) {
@@ -535,16 +583,49 @@ void cpu(void)
 		(*op_sim[*PC++]) ();
 #endif
 
+		if (mem_wp)		/* undo writes into ROM */
+			rom_post();
+
 #ifdef WANT_PCC
-		if (PC > ram + 65535)	/* check for PC overrun */
-			PC = ram;
+		if (PC > ram + 65535 || PC < ram)	/* check for PC over-/underrun */
+			PC = ram + (WORD) (PC - ram);
 #endif
 
 		R++;			/* increment refresh register */
 
+#ifdef WANT_TIM		/* count instructions and T-states */
+		cpu_steps++;
+		cpu_tstates += states;
+		if (cpu_tstates >= cpu_tstop)	/* end of z80_run() */
+			cpu_state = STOPPED;
+#ifdef SNSIZE
+		if (cpu_steps >= sn_stop || cpu_tstates >= sn_tev)
+			snap_event();
+#endif
+#endif
+
+#ifdef WANT_PROF	/* count execution and T-states for profile */
+		if (p_flag)
+			prof_put(op_pc - ram, states);
+#endif
+
+#ifdef WANT_COV		/* mark op-code and branch in coverage */
+		if (cov_flag)
+			cov_put(op_pc - ram);
+#endif
+
+#ifdef WANT_TRACE	/* write trace record of the results */
+		if (tr_flag)
+#ifdef WANT_TIM
+			trace_post(states);
+#else
+			trace_post(0);
+#endif
+#endif
+
 #ifdef WANT_TIM				/* do runtime measurement */
 		if (t_flag) {
-			t_states += t;	/* add T-states for this opcode */
+			t_states += states; /* add T-states for this opcode */
 			if (PC == t_end) /* check for end address */
 				t_flag = 0; /* if reached, switch off */
 		}
@@ -554,6 +635,9 @@ void cpu(void)
                 check_gui_break();
 #endif
 
+		if (bp_flag)		/* gdb watchpoint written */
+			bp_post();
+
 	} while	(cpu_state == CONTIN_RUN);
 
 #ifdef BUS_8080
@@ -577,6 +661,22 @@ static int op_nop(void)			/* NOP */
 	return(4);
 }
 
+/*
+ *	HALT at PC - 1 is a software breakpoint, which stops the CPU
+ *	also with interrupts enabled
+ */
+static int op_isbreak(void)
+{
+#ifdef SBSIZE
+	register int i;
+
+	for (i = 0; i < SBSIZE; i++)
+		if (soft[i].sb_pass && soft[i].sb_adr == PC - ram - 1)
+			return(1);
+#endif
+	return(0);
+}
+
 static int op_halt(void)		/* HALT */
 {
 	extern int busy_loop_cnt[];
@@ -586,8 +686,15 @@ static int op_halt(void)		/* HALT */
 	cpu_bus = CPU_WO | CPU_HLTA | CPU_MEMR;
 #endif
 
+#ifdef WANT_TIM
+	if (cpu_tstop != ~0ULL && IFF != 0 && !op_isbreak()) {
+		cpu_halt = 1;			/* z80_run(), wait for an */
+		return(4);			/* interrupt in emulated time */
+	}
+#endif
+
 #ifndef FRONTPANEL
-	if (IFF == 0)	{
+	if (IFF == 0 || op_isbreak())	{
 		cpu_error = OPHALT;
 		cpu_state = STOPPED;
 	} else
@@ -3147,6 +3254,10 @@ static int op_call(void)		/* CALL */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + i;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(i, 17);
+#endif
 	return(17);
 }
 
@@ -3171,6 +3282,10 @@ static int op_ret(void)			/* RET */
 		STACK =	ram;
 #endif
 	PC = ram + i;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_ret(10);
+#endif
 	return(10);
 }
 
@@ -3356,6 +3471,10 @@ static int op_calz(void)		/* CALL Z,nn */
 		fp_sampleLightGroup(0, 0);
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3393,6 +3512,10 @@ static int op_calnz(void)		/* CALL NZ,nn */
 		fp_sampleLightGroup(0, 0);
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3430,6 +3553,10 @@ static int op_calc(void)		/* CALL C,nn */
 		fp_sampleLightGroup(0, 0);
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3467,6 +3594,10 @@ static int op_calnc(void)		/* CALL NC,nn */
 #endif
 		*--STACK = (PC - ram);
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3504,6 +3635,10 @@ static int op_calpe(void)		/* CALL PE,nn */
 		fp_sampleLightGroup(0, 0);
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3541,6 +3676,10 @@ static int op_calpo(void)		/* CALL PO,nn */
 		fp_sampleLightGroup(0, 0);
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3578,6 +3717,10 @@ static int op_calm(void)		/* CALL M,nn */
 		fp_sampleLightGroup(0, 0);
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3615,6 +3758,10 @@ static int op_calp(void)		/* CALL P,nn */
 		fp_sampleLightGroup(0, 0);
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_call(i, 17);
+#endif
 		return(17);
 	} else {
 		PC += 2;
@@ -3644,6 +3791,10 @@ static int op_retz(void)		/* RET Z */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3672,6 +3823,10 @@ static int op_retnz(void)		/* RET NZ */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3700,6 +3855,10 @@ static int op_retc(void)		/* RET C */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3728,6 +3887,10 @@ static int op_retnc(void)		/* RET NC */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3756,6 +3919,10 @@ static int op_retpe(void)		/* RET PE */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3784,6 +3951,10 @@ static int op_retpo(void)		/* RET PO */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3812,6 +3983,10 @@ static int op_retm(void)		/* RET M */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3840,6 +4015,10 @@ static int op_retp(void)		/* RET P */
 			STACK =	ram;
 #endif
 		PC = ram + i;
+#ifdef WANT_PROF
+		if (cg_flag)
+			cg_ret(11);
+#endif
 		return(11);
 	} else {
 		return(5);
@@ -3933,6 +4112,10 @@ static int op_rst00(void)		/* RST 00 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x00, 11);
+#endif
 	return(11);
 }
 
@@ -3955,6 +4138,10 @@ static int op_rst08(void)		/* RST 08 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + 0x08;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x08, 11);
+#endif
 	return(11);
 }
 
@@ -3977,6 +4164,10 @@ static int op_rst10(void)		/* RST 10 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + 0x10;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x10, 11);
+#endif
 	return(11);
 }
 
@@ -3999,6 +4190,10 @@ static int op_rst18(void)		/* RST 18 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + 0x18;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x18, 11);
+#endif
 	return(11);
 }
 
@@ -4021,6 +4216,10 @@ static int op_rst20(void)		/* RST 20 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + 0x20;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x20, 11);
+#endif
 	return(11);
 }
 
@@ -4043,6 +4242,10 @@ static int op_rst28(void)		/* RST 28 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + 0x28;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x28, 11);
+#endif
 	return(11);
 }
 
@@ -4065,6 +4268,10 @@ static int op_rst30(void)		/* RST 30 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + 0x30;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x30, 11);
+#endif
 	return(11);
 }
 
@@ -4087,5 +4294,9 @@ static int op_rst38(void)		/* RST 38 */
 #endif
 	*--STACK = (PC - ram);
 	PC = ram + 0x38;
+#ifdef WANT_PROF
+	if (cg_flag)
+		cg_call(0x38, 11);
+#endif
 	return(11);
 }
@@ -93,7 +93,8 @@ static void term_int(int sig)
 {
 	exit_io();
 	int_off();
-	tcsetattr(0, TCSADRAIN, &old_term);
+	if (!b_flag)		/* terminal settings only without batch mode */
+		tcsetattr(0, TCSADRAIN, &old_term);
 	puts("\nKilled by user");
-	exit(0);
+	exit(128 + sig);
 }
@@ -63,6 +63,12 @@ static pio_state pio;  // called pio for var name compliance, but in my applicat
 											 // it is in fact an 82c55
 static ctc_state ctc[4];
 static dart_state dart[2]; // 0=chan A, 1=chan B
+static int dart_in[2]={-1,-1};  // files used instead of the sockets, -1 = none
+static int dart_out[2]={-1,-1};
+static BYTE dart_inj[2][DART_INJSIZE]; // bytes injected by the control socket
+static int dart_ninj[2];
+static int (*hook_in)(BYTE);        // ports of an embedding program, see io_hook()
+static int (*hook_out)(BYTE,BYTE);
 
 void init_io(void) { // called at start to init all ports
 	int i;
@@ -117,6 +123,113 @@ void exit_io(void) { // called at exit
 	close(dart[1].sock);
 }
 
+// connects DART channel chan to files instead of its socket: input is
+// read from fd in, output is written to fd out. -1 switches back to the socket.
+void dart_files(int chan, int in, int out) {
+	dart_in[chan&0x01]=in;
+	dart_out[chan&0x01]=out;
+}
+
+// ports handled by an embedding program (api.c) before the devices here:
+// in returns the byte read, out 0, both return -1 for ports left to the devices.
+// NULL switches a hook off.
+void io_hook(int (*in)(BYTE), int (*out)(BYTE,BYTE)) {
+	hook_in=in;
+	hook_out=out;
+}
+
+// size of the device states saved with io_save()
+size_t io_size(void) {
+	return sizeof(pio)+sizeof(ctc)+sizeof(dart);
+}
+
+// copies the device states into p, for snapshots
+void io_save(void *p) {
+	BYTE *b=p;
+
+	memcpy(b,&pio,sizeof(pio)); b+=sizeof(pio);
+	memcpy(b,ctc,sizeof(ctc)); b+=sizeof(ctc);
+	memcpy(b,dart,sizeof(dart));
+}
+
+// restores the device states saved with io_save(). the sockets and
+// the client addresses stay as they are.
+void io_restore(void *p) {
+	BYTE *b=p;
+	dart_state d[2];
+	int i;
+
+	memcpy(&pio,b,sizeof(pio)); b+=sizeof(pio);
+	memcpy(ctc,b,sizeof(ctc)); b+=sizeof(ctc);
+	memcpy(d,b,sizeof(d));
+	for (i=0;i<2;i++) {
+		d[i].ouraddr=dart[i].ouraddr;
+		d[i].remaddr=dart[i].remaddr;
+		d[i].addrlen=dart[i].addrlen;
+		d[i].sock=dart[i].sock;
+		d[i].have_client=dart[i].have_client;
+	}
+	memcpy(dart,d,sizeof(d));
+}
+
+// writes the device states in a portable byte layout into p, for
+// core files. returns the no. of bytes, with p NULL only the size.
+size_t io_export(BYTE *p) {
+	BYTE b[IO_EXPSIZE];
+	BYTE *q=b;
+	int i;
+
+	*q++=pio.port_a; *q++=pio.port_b; *q++=pio.port_c; *q++=pio.control;
+	*q++=pio.conf_port_a; *q++=pio.conf_port_b;
+	*q++=pio.conf_port_c_lower; *q++=pio.conf_port_c_upper;
+	for (i=0;i<4;i++) {
+		*q++=ctc[i].ints_enabled; *q++=ctc[i].tc_next; *q++=ctc[i].tc;
+		*q++=ctc[i].ivector; *q++=ctc[i].c_val; *q++=ctc[i].prescaler;
+		*q++=ctc[i].p_val;
+	}
+	for (i=0;i<2;i++) {
+		*q++=dart[i].clk_prescale; *q++=dart[i].rx_bits; *q++=dart[i].tx_bits;
+		*q++=dart[i].rx_enabled; *q++=dart[i].tx_enabled;
+		*q++=dart[i].stopbits; *q++=dart[i].parity;
+		*q++=dart[i].interrupt_mode; *q++=dart[i].reg_ptr;
+		*q++=dart[i].tx_buf_empty; *q++=dart[i].rx_char_avail;
+		*q++=dart[i].all_sent; *q++=dart[i].rx_buf_overrun;
+		*q++=dart[i].rts_; *q++=dart[i].dtr_; *q++=dart[i].cts_; *q++=dart[i].dcd_;
+		*q++=dart[i].cbhead; *q++=dart[i].cbtail; *q++=dart[i].cbused;
+		memcpy(q,dart[i].rx_fifo,DART_BUFSIZE); q+=DART_BUFSIZE;
+	}
+	if (p!=NULL) memcpy(p,b,q-b);
+	return q-b;
+}
+
+// restores the device states written by io_export(), n is the
+// no. of bytes in p. returns 0 if ok, 1 if the layout doesn't match.
+int io_import(BYTE *p, size_t n) {
+	int i;
+
+	if (n!=io_export(NULL)) return 1;
+	pio.port_a=*p++; pio.port_b=*p++; pio.port_c=*p++; pio.control=*p++;
+	pio.conf_port_a=*p++; pio.conf_port_b=*p++;
+	pio.conf_port_c_lower=*p++; pio.conf_port_c_upper=*p++;
+	for (i=0;i<4;i++) {
+		ctc[i].ints_enabled=*p++; ctc[i].tc_next=*p++; ctc[i].tc=*p++;
+		ctc[i].ivector=*p++; ctc[i].c_val=*p++; ctc[i].prescaler=*p++;
+		ctc[i].p_val=*p++;
+	}
+	for (i=0;i<2;i++) {
+		dart[i].clk_prescale=*p++; dart[i].rx_bits=*p++; dart[i].tx_bits=*p++;
+		dart[i].rx_enabled=*p++; dart[i].tx_enabled=*p++;
+		dart[i].stopbits=*p++; dart[i].parity=*p++;
+		dart[i].interrupt_mode=*p++; dart[i].reg_ptr=*p++;
+		dart[i].tx_buf_empty=*p++; dart[i].rx_char_avail=*p++;
+		dart[i].all_sent=*p++; dart[i].rx_buf_overrun=*p++;
+		dart[i].rts_=*p++; dart[i].dtr_=*p++; dart[i].cts_=*p++; dart[i].dcd_=*p++;
+		dart[i].cbhead=*p++; dart[i].cbtail=*p++; dart[i].cbused=*p++;
+		memcpy(dart[i].rx_fifo,p,DART_BUFSIZE); p+=DART_BUFSIZE;
+	}
+	return 0;
+}
+
 // this is written to emulate CTC funtionality if run once per clock - 
 //		however, it is currently called from the cpu wrapper and thus only 
 //		runs once per instruction, and is as such 4-8x slower than realtime.
@@ -146,18 +259,29 @@ void run_counters(void) {
 
 // handles all IN opcodes
 BYTE io_in(BYTE adr) {
-	switch (adr&0xfc) { // zero the last two bits since they arent relevant
-		case ADDR_8255: return p_8255_in(adr);
-		case ADDR_CTC:	return p_ctc_in(adr);
-		case ADDR_DART:	return p_dart_in(adr);
+	BYTE data=0;
+	int r;
+
+	if (hook_in!=NULL && (r=(*hook_in)(adr))>=0) data=r;
+	else switch (adr&0xfc) { // zero the last two bits since they arent relevant
+		case ADDR_8255: data=p_8255_in(adr); break;
+		case ADDR_CTC:	data=p_ctc_in(adr); break;
+		case ADDR_DART:	data=p_dart_in(adr); break;
 		default:				io_trap(adr);
 	}
 
-	return 0;
+#ifdef WANT_TRACE
+	if (tr_flag) trace_io(0,adr,data);
+#endif
+	return data;
 }
 
 // handles all OUT opcodes
 void io_out(BYTE adr, BYTE data) {
+#ifdef WANT_TRACE
+	if (tr_flag) trace_io(1,adr,data);
+#endif
+	if (hook_out!=NULL && (*hook_out)(adr,data)>=0) return;
 	switch (adr&0xfc) {
 		case ADDR_8255: return p_8255_out(adr,data);
     case ADDR_CTC:  return p_ctc_out(adr,data);
@@ -315,8 +439,7 @@ static BYTE p_dart_in(BYTE port) {
 				// check the socket before we can respond
 
 				// TODO: read directly into cb
-				thisdart->recvlen=recvfrom(thisdart->sock,thisdart->rx_buf,DART_BUFSIZE,MSG_DONTWAIT,
-					(struct sockaddr *)&(thisdart->remaddr),&(thisdart->addrlen));
+				thisdart->recvlen=dart_recv(port&0x01);
 
 				if (iodebug.dart>=D_ALL) printf("!-- DART %c sock read, %d bytes returned from %s.\n",
 					chan,thisdart->recvlen,inet_ntoa(thisdart->remaddr.sin_addr));
@@ -520,7 +643,12 @@ static void p_dart_out(BYTE port,BYTE data) {
 
 		if (iodebug.dart>=D_RWOPS) printf("%s write: 0x%02x.\n",pre,data);
 
-		if (thisdart->have_client) {
+#ifdef SNSIZE
+		if (snap_replay()) return; // was sent already, before going back in time
+#endif
+		if (dart_out[port&0x01]>=0) {
+			if (1!=write(dart_out[port&0x01],&data,1)) perror("write");
+		} else if (thisdart->have_client) {
 	   	if (0>sendto(thisdart->sock,&data,1,0,(struct sockaddr *)&(thisdart->remaddr),
 				thisdart->addrlen)) 
 				perror("sendto");
@@ -534,6 +662,40 @@ static void p_dart_out(BYTE port,BYTE data) {
 	}*/
 }
 
+// queues bytes for channel chan, they are received before the socket
+// or file input. returns the no. of bytes queued.
+int dart_inject(int chan, BYTE *p, int n) {
+	chan&=0x01;
+	if (n>DART_INJSIZE-dart_ninj[chan]) n=DART_INJSIZE-dart_ninj[chan];
+	memcpy(dart_inj[chan]+dart_ninj[chan],p,n);
+	dart_ninj[chan]+=n;
+	return n;
+}
+
+// receives from the socket of a channel. when instructions are executed
+// again after going back to a snapshot, the bytes come from the input log.
+static int dart_recv(int i) {
+	int n;
+
+#ifdef SNSIZE
+	if (snap_replay()) return snap_getin(i,dart[i].rx_buf);
+#endif
+	if (dart_ninj[i]) { // injected bytes, never more than fits into the fifo
+		n=DART_BUFSIZE-dart[i].cbused;
+		if (n>dart_ninj[i]) n=dart_ninj[i];
+		memcpy(dart[i].rx_buf,dart_inj[i],n);
+		memmove(dart_inj[i],dart_inj[i]+n,dart_ninj[i]-n);
+		dart_ninj[i]-=n;
+	} else if (dart_in[i]>=0) // input script, never more than fits into the fifo
+		n=read(dart_in[i],dart[i].rx_buf,DART_BUFSIZE-dart[i].cbused);
+	else n=recvfrom(dart[i].sock,dart[i].rx_buf,DART_BUFSIZE,MSG_DONTWAIT,
+		(struct sockaddr *)&(dart[i].remaddr),&(dart[i].addrlen));
+#ifdef SNSIZE
+	snap_putin(i,dart[i].rx_buf,n);
+#endif
+	return n;
+}
+
 static void dart_reset(dart_state *dart) {
 	dart->clk_prescale=0;
   dart->rx_bits=0;
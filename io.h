@@ -76,6 +76,20 @@ typedef struct { // see note in io.c about compatibility
 
 void init_io(void);
 void exit_io(void);
+size_t io_size(void);
+void io_save(void *);
+void io_restore(void *);
+
+// max. no. of bytes queued by dart_inject()
+#define DART_INJSIZE 4096
+
+// size of the portable device state of io_export()
+#define IO_EXPSIZE (8+4*7+2*(20+DART_BUFSIZE))
+size_t io_export(BYTE *);
+int io_import(BYTE *, size_t);
+void dart_files(int, int, int);
+void io_hook(int (*)(BYTE), int (*)(BYTE,BYTE));
+int dart_inject(int, BYTE *, int);
 
 void run_counters(void);
 
@@ -91,5 +105,6 @@ static void p_ctc_out(BYTE,BYTE);
 
 static BYTE p_dart_in(BYTE);
 static void p_dart_out(BYTE,BYTE);
+static int dart_recv(int);
 static void dart_reset(dart_state *);
 
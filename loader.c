@@ -0,0 +1,544 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module contains the loaders for programs. The file is
+ *	mapped into memory with mmap(), the format is detected from
+ *	the contents:
+ *
+ *		binary images with Mostek header (0xff ll lh)
+ *		Intel hex, all record types
+ *		Motorola S-records S0-S3 and S5-S9
+ *		flat binary images
+ *
+ *	A file name starting with @ is a manifest, which lists the
+ *	segments of an image, see ld_manifest().
+ *
+ *	Hex digits are converted eight at a time inside a 64 bit
+ *	word, valid digits and their values are found for all bytes
+ *	with a few arithmetic and logic operations, without a branch
+ *	for each character. The checksums are verified on the
+ *	converted records. The loaded addresses are marked in a
+ *	bitmap, from which the load ranges are reported.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "config.h"
+#include "global.h"
+
+extern int exatoi(char *);
+
+#define LD_ONES	0x0101010101010101ULL
+#define LD_HIGH	0x8080808080808080ULL
+
+static BYTE ld_map[8192];		/* bitmap of loaded addresses */
+static long ld_out;			/* bytes outside of 64K */
+static long ld_start = -1;		/* start address, -1 if none */
+
+/*
+ *	Value of a hex digit, -1 if c isn't one
+ */
+static int hexnib(int c)
+{
+	if (c >= '0' && c <= '9')
+		return(c - '0');
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return(c - 'a' + 10);
+	return(-1);
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/*
+ *	Convert 8 hex digits at s into 4 bytes at out
+ *
+ *	Output: 0 ok, 1 invalid digit
+ */
+static int hex8(const char *s, BYTE *out)
+{
+	uint64_t v, l, dig, let, val, t;
+
+	memcpy(&v, s, 8);
+	if (v & LD_HIGH)
+		return(1);
+	l = v | (0x20 * LD_ONES);
+	dig = (v + (0x80 - '0') * LD_ONES) & ~(v + (0x7f - '9') * LD_ONES);
+	let = (l + (0x80 - 'a') * LD_ONES) & ~(l + (0x7f - 'f') * LD_ONES);
+	if (((dig | let) & LD_HIGH) != LD_HIGH)
+		return(1);
+	val = (v & (0x0f * LD_ONES)) + ((v >> 6) & LD_ONES) * 9;
+	t = ((val & 0x000f000f000f000fULL) << 4) |
+	    ((val >> 8) & 0x000f000f000f000fULL);
+	out[0] = t;
+	out[1] = t >> 16;
+	out[2] = t >> 32;
+	out[3] = t >> 48;
+	return(0);
+}
+#endif
+
+/*
+ *	Convert n bytes written as hex digits at s into out
+ *
+ *	Output: 0 ok, 1 invalid digit
+ */
+static int hexdec(const char *s, BYTE *out, int n)
+{
+	register int hi, lo;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; n >= 4; n -= 4, s += 8, out += 4)
+		if (hex8(s, out))
+			return(1);
+#endif
+	for (; n > 0; n--, s += 2) {
+		if ((hi = hexnib(s[0])) < 0 || (lo = hexnib(s[1])) < 0)
+			return(1);
+		*out++ = (hi << 4) | lo;
+	}
+	return(0);
+}
+
+/*
+ *	Store n bytes at address adr
+ */
+static void ld_store(unsigned long adr, BYTE *data, long n)
+{
+	register long i;
+
+	if (adr >= 65536L) {
+		ld_out += n;
+		return;
+	}
+	if (adr + n > 65536L) {
+		ld_out += adr + n - 65536L;
+		n = 65536L - adr;
+	}
+	memcpy(ram + adr, data, n);
+	for (i = adr; i < adr + n; i++)
+		ld_map[i >> 3] |= 1 << (i & 7);
+}
+
+/*
+ *	Next line of a text file
+ */
+static char *ld_nextline(char *p, char *end)
+{
+	while (p < end && *p != '\n')
+		p++;
+	return(p + 1);
+}
+
+/*
+ *	Loader for Intel hex, with data, end of file, extended segment
+ *	and linear address and start address records
+ */
+static int ld_ihex(char *p, char *end)
+{
+	BYTE rec[260];
+	register int n;
+	unsigned long base = 0;
+	int line, sum;
+
+	for (line = 1; p < end; p = ld_nextline(p, end), line++) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p >= end || *p != ':')
+			continue;
+		p++;
+		if (end - p < 10 || hexdec(p, rec, 1)) {
+			printf("invalid hex record in line %d\n", line);
+			return(1);
+		}
+		n = rec[0] + 5;
+		if (end - p < 2 * n || hexdec(p, rec, n)) {
+			printf("invalid hex record in line %d\n", line);
+			return(1);
+		}
+		for (sum = 0; n--; )
+			sum += rec[n];
+		if (sum & 0xff) {
+			printf("invalid checksum in hex record in line %d\n",
+			       line);
+			return(1);
+		}
+		n = rec[0];
+		switch (rec[3]) {
+		case 0:				/* data */
+			ld_store(base + (rec[1] << 8) + rec[2], rec + 4, n);
+			break;
+		case 1:				/* end of file */
+			return(0);
+		case 2:				/* extended segment address */
+			base = ((rec[4] << 8) + rec[5]) << 4;
+			break;
+		case 3:				/* start segment address */
+			ld_start = ((rec[6] << 8) + rec[7]) & 0xffff;
+			break;
+		case 4:				/* extended linear address */
+			base = (unsigned long) ((rec[4] << 8) + rec[5]) << 16;
+			break;
+		case 5:				/* start linear address */
+			ld_start = ((rec[6] << 8) + rec[7]) & 0xffff;
+			break;
+		default:
+			printf("unknown hex record type %02x in line %d\n",
+			       rec[3], line);
+			return(1);
+		}
+	}
+	return(0);
+}
+
+/*
+ *	Loader for Motorola S-records
+ */
+static int ld_srec(char *p, char *end)
+{
+	BYTE rec[260];
+	register int n, i, type, alen;
+	unsigned long adr;
+	int line, sum;
+
+	for (line = 1; p < end; p = ld_nextline(p, end), line++) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p >= end || *p != 'S')
+			continue;
+		if (end - p < 4 || !isdigit((int)p[1]) || hexdec(p + 2, rec, 1)) {
+			printf("invalid S-record in line %d\n", line);
+			return(1);
+		}
+		type = p[1] - '0';
+		n = rec[0] + 1;
+		if (end - p < 2 + 2 * n || hexdec(p + 2, rec, n)) {
+			printf("invalid S-record in line %d\n", line);
+			return(1);
+		}
+		for (sum = 0, i = 0; i < n; i++)
+			sum += rec[i];
+		if ((sum & 0xff) != 0xff) {
+			printf("invalid checksum in S-record in line %d\n",
+			       line);
+			return(1);
+		}
+		switch (type) {
+		case 0: case 1: case 5: case 9:
+			alen = 2;
+			break;
+		case 2: case 6: case 8:
+			alen = 3;
+			break;
+		case 3: case 7:
+			alen = 4;
+			break;
+		default:
+			printf("unknown S-record type S%d in line %d\n",
+			       type, line);
+			return(1);
+		}
+		if (rec[0] < alen + 1) {
+			printf("invalid S-record in line %d\n", line);
+			return(1);
+		}
+		for (adr = 0, i = 1; i <= alen; i++)
+			adr = (adr << 8) + rec[i];
+		switch (type) {
+		case 1: case 2: case 3:		/* data */
+			ld_store(adr, rec + 1 + alen, rec[0] - alen - 1);
+			break;
+		case 7: case 8: case 9:		/* start address */
+			ld_start = adr & 0xffff;
+			return(0);
+		}
+	}
+	return(0);
+}
+
+/*
+ *	Loader for a manifest of segments, one segment per line:
+ *
+ *		file address [offset=n] [length=n] [bank=n] [rom|ram]
+ *		entry address
+ *
+ *	Numbers are hex, everything after a # is a comment, file names
+ *	are relative to the directory of the manifest. The segments
+ *	are read with pread() right into the memory, from offset in the
+ *	file with length bytes, default is up to the end of the file.
+ *	Only bank 0 exists, the simulated CPU has no memory banking.
+ */
+static int ld_manifest(char *fn)
+{
+	FILE *fp;
+	struct stat st;
+	char line[LENCMD * 2], path[LENCMD * 2], *tok[8], *p;
+	register int n, i;
+	long adr, off, len, bank, got;
+	int fd, rom, lno = 0, rc = 0;
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lno++;
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		n = 0;
+		for (p = strtok(line, " \t\r\n"); p != NULL && n < 8;
+		     p = strtok(NULL, " \t\r\n"))
+			tok[n++] = p;
+		if (n == 0)
+			continue;
+		if (n < 2) {
+			printf("%s line %d: address missing\n", fn, lno);
+			rc = 1;
+			continue;
+		}
+		if (strcmp(tok[0], "entry") == 0) {
+			ld_start = exatoi(tok[1]) & 0xffff;
+			continue;
+		}
+		adr = exatoi(tok[1]) & 0xffff;
+		off = 0;
+		len = -1;
+		bank = 0;
+		rom = 0;
+		for (i = 2; i < n; i++) {
+			if (strncmp(tok[i], "offset=", 7) == 0)
+				off = exatoi(tok[i] + 7);
+			else if (strncmp(tok[i], "length=", 7) == 0)
+				len = exatoi(tok[i] + 7);
+			else if (strncmp(tok[i], "bank=", 5) == 0)
+				bank = exatoi(tok[i] + 5);
+			else if (strcmp(tok[i], "rom") == 0)
+				rom = 1;
+			else if (strcmp(tok[i], "ram") == 0)
+				rom = 0;
+			else
+				printf("%s line %d: unknown %s ignored\n", fn,
+				       lno, tok[i]);
+		}
+		if (bank != 0) {
+			printf("%s line %d: no memory banks, %s not loaded\n",
+			       fn, lno, tok[0]);
+			rc = 1;
+			continue;
+		}
+		if (tok[0][0] != '/' && (p = strrchr(fn, '/')) != NULL)
+			snprintf(path, sizeof(path), "%.*s/%s", (int) (p - fn),
+				 fn, tok[0]);
+		else
+			snprintf(path, sizeof(path), "%s", tok[0]);
+		if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+			printf("can't open file %s\n", path);
+			if (fd != -1)
+				close(fd);
+			rc = 1;
+			continue;
+		}
+		if (off > st.st_size)
+			off = st.st_size;
+		if (len < 0 || off + len > st.st_size)
+			len = st.st_size - off;
+		if (adr + len > 65536L) {
+			ld_out += adr + len - 65536L;
+			len = 65536L - adr;
+		}
+		for (got = 0; got < len; got += n)
+			if ((n = pread(fd, ram + adr + got, len - got,
+				       off + got)) <= 0)
+				break;
+		close(fd);
+		if (got < len) {
+			printf("can't read file %s\n", path);
+			rc = 1;
+		}
+		for (i = adr; i < adr + got; i++)
+			ld_map[i >> 3] |= 1 << (i & 7);
+		if (rom && got)
+			rom_set(adr, got);
+		printf("SEGMENT: %04lx-%04lx %s %s+%lx\n", adr, adr + got - 1,
+		       rom ? "ROM" : "RAM", tok[0], off);
+	}
+	fclose(fp);
+	return(rc);
+}
+
+/*
+ *	Check if the file looks like text records starting with c,
+ *	the first line which isn't empty decides
+ */
+static int ld_istext(char *p, char *end, int c)
+{
+	while (p < end && isspace((int)*p))
+		p++;
+	if (p >= end || *p != c)
+		return(0);
+	if (c == 'S')
+		return(end - p > 3 && isdigit((int)p[1]) &&
+		       isxdigit((int)p[2]) && isxdigit((int)p[3]));
+	return(end - p > 2 && isxdigit((int)p[1]) && isxdigit((int)p[2]));
+}
+
+/*
+ *	Print the loader statistics and the loaded ranges
+ */
+static void ld_report(char *fn)
+{
+	register long i, j;
+	long first = -1, last = 0, cnt = 0, nrange = 0;
+
+	for (i = 0; i < 65536L; i++)
+		if (ld_map[i >> 3] & (1 << (i & 7))) {
+			if (first < 0)
+				first = i;
+			last = i;
+			cnt++;
+		}
+	printf("\nLoader statistics for file %s:\n", fn);
+	if (first < 0) {
+		puts("nothing loaded\n");
+		return;
+	}
+	printf("START : %04lx\n", first);
+	printf("END   : %04lx\n", last);
+	printf("LOADED: %04lx (%ld)\n", cnt, cnt);
+	for (i = first; i <= last; i = j) {
+		for (; i <= last && !(ld_map[i >> 3] & (1 << (i & 7))); i++)
+			;
+		for (j = i; j <= last && (ld_map[j >> 3] & (1 << (j & 7))); j++)
+			;
+		if (i < j && (nrange++ || j <= last))	/* more than one */
+			printf("RANGE : %04lx-%04lx\n", i, j - 1);
+	}
+	if (ld_start >= 0)
+		printf("ENTRY : %04lx\n", ld_start);
+	if (ld_out)
+		printf("%ld bytes outside of 64K not loaded\n", ld_out);
+	putchar('\n');
+}
+
+/*
+ *	Test if address adr was loaded from the last file
+ */
+int load_test(WORD adr)
+{
+	return(ld_map[adr >> 3] & (1 << (adr & 7)));
+}
+
+/*
+ *	Start address of the last file loaded, -1 if none
+ */
+long load_entry(void)
+{
+	return(ld_start);
+}
+
+/*
+ *	Read a file into the memory of the emulated CPU, s is the
+ *	file name, optional followed by a comma and the load address
+ *	for binary images, or @ and the name of a manifest.
+ *
+ *	Output: 0 ok, 1 error
+ */
+int load_file(char *s)
+{
+	char fn[LENCMD];
+	register char *pfn = fn;
+	struct stat st;
+	char *p;
+	long adr = -1, n;
+	int fd, rc = 0;
+
+	while (isspace((int)*s))
+		s++;
+	while (*s != ',' && *s != '\n' && *s != '\0' && pfn < fn + LENCMD - 1)
+		*pfn++ = *s++;
+	*pfn = '\0';
+	if (strlen(fn) == 0) {
+		puts("no input file given");
+		return(1);
+	}
+	memset(ld_map, 0, sizeof(ld_map));
+	ld_out = 0;
+	ld_start = -1;
+	rom_clear();
+	if (*fn == '@') {			/* manifest */
+#ifdef SNSIZE
+		snap_dirty();
+#endif
+		rc = ld_manifest(fn + 1);
+		ld_report(fn + 1);
+		goto done;
+	}
+	if ((fd = open(fn, O_RDONLY)) == -1) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	if (fstat(fd, &st) == -1) {
+		printf("can't stat file %s\n", fn);
+		close(fd);
+		return(1);
+	}
+	if (st.st_size == 0)
+		p = NULL;
+	else if ((p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+		 == MAP_FAILED) {
+		printf("can't map file %s\n", fn);
+		close(fd);
+		return(1);
+	}
+	close(fd);
+#ifdef SNSIZE
+	snap_dirty();
+#endif
+	if (*s == ',')
+		adr = exatoi(++s) & 0xffff;
+	if (st.st_size >= 3 && (BYTE) p[0] == 0xff) {	/* Mostek header */
+		printf("Reading as Mostek file.\n");
+		if (adr < 0)
+			adr = (BYTE) p[1] + ((BYTE) p[2] << 8);
+		ld_store(adr, (BYTE *) p + 3, st.st_size - 3);
+		ld_start = adr;
+	} else if (ld_istext(p, p + st.st_size, ':')) {
+		printf("Reading as Intel hex file.\n");
+		rc = ld_ihex(p, p + st.st_size);
+	} else if (ld_istext(p, p + st.st_size, 'S')) {
+		printf("Reading as Motorola S-record file.\n");
+		rc = ld_srec(p, p + st.st_size);
+	} else {
+		printf("Reading as flat binary file...\n");
+		if (adr < 0)
+			adr = 0;
+		if ((n = st.st_size) > 0)
+			ld_store(adr, (BYTE *) p, n);
+		ld_start = adr;
+	}
+	if (p != NULL)
+		munmap(p, st.st_size);
+	ld_report(fn);
+	done:
+	if (ld_out)
+		rc = 1;
+	if (ld_start < 0)		/* no entry, first address loaded */
+		for (ld_start = 0; ld_start < 65535L; ld_start++)
+			if (ld_map[ld_start >> 3] & (1 << (ld_start & 7)))
+				break;
+	PC = wrk_ram = ram + ld_start;
+	return(rc);
+}
@@ -0,0 +1,520 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module runs a program on two execution engines in
+ *	lockstep and compares them, to find the first instruction
+ *	where an engine differs from the reference. The reference is
+ *	this simulator, the other engine is a simulator binary started
+ *	with --peer, which serves the commands below on stdin and
+ *	stdout. Engines are selected when the simulator is built, so
+ *	another core or another configuration is another binary.
+ *
+ *	After every block of n instructions (default 1) both engines
+ *	report all registers, the pending interrupt, the CPU error,
+ *	the T-states and a hash of the memory. If they differ, both
+ *	go back to the start of the block and single step up to the
+ *	instruction which differs. It is shown disassembled with the
+ *	registers of both engines and the first different memory
+ *	locations.
+ *
+ *	With --fuzz both engines run random memory from random
+ *	registers, case by case, until a trap, HALT or LS_FUZZN
+ *	instructions.
+ *
+ *	Commands to the peer, binary in host byte order:
+ *	'L' struct lsregs, memory, size and state of the I/O devices
+ *	'S' long n: run n instructions, answer struct lsregs
+ *	'M' answer the memory
+ *	'Q' end
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sysexits.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "config.h"
+#include "global.h"
+
+#define LS_NREG		27		/* no. of compared registers */
+#define LS_FUZZN	10000		/* max. instructions of a fuzz case */
+#define LS_NMEM		16		/* shown memory differences */
+
+extern void cpu(void);
+extern void dart_files(int, int, int);
+extern size_t io_export(BYTE *);
+extern int io_import(BYTE *, size_t);
+extern int dis_r(unsigned char *, int, char *);
+
+struct lsregs {				/* state reported by an engine */
+	long r_reg[LS_NREG];
+	long r_steps;			/* executed instructions */
+	long long r_ts;			/* T-states, -1 unknown */
+	unsigned long long r_hash;	/* hash of the memory */
+};
+
+static char *ls_name[LS_NREG] = {
+	"A", "F", "B", "C", "D", "E", "H", "L",
+	"A'", "F'", "B'", "C'", "D'", "E'", "H'", "L'",
+	"IX", "IY", "SP", "PC", "I", "R", "IFF", "IM",
+	"INT", "VEC", "ERR"
+};
+
+static int ls_in = -1, ls_out = -1;	/* pipes to and from the peer */
+static pid_t ls_pid;
+static int ls_null, ls_stdout;		/* stdout is quiet while running */
+static BYTE *ls_io;			/* state of the I/O devices */
+static size_t ls_iolen;
+static BYTE ls_mem[65536];		/* memory of the peer or saved */
+static struct lsregs ls_start;		/* registers at the block start */
+static WORD ls_pc;			/* last instruction */
+static BYTE ls_ins[4];
+static unsigned long ls_seed;
+
+/*
+ *	Read or write exactly n bytes
+ *
+ *	Output: 0 ok, -1 error or end of file
+ */
+static int ls_read(int fd, void *p, size_t n)
+{
+	register ssize_t i;
+
+	while (n > 0) {
+		if ((i = read(fd, p, n)) <= 0)
+			return(-1);
+		p = (char *) p + i;
+		n -= i;
+	}
+	return(0);
+}
+
+static int ls_write(int fd, void *p, size_t n)
+{
+	register ssize_t i;
+
+	while (n > 0) {
+		if ((i = write(fd, p, n)) <= 0)
+			return(-1);
+		p = (char *) p + i;
+		n -= i;
+	}
+	return(0);
+}
+
+static unsigned long long ls_hash(void)
+{
+	register unsigned long long h = 14695981039346656037ULL;
+	register int i;
+	unsigned long long w;
+
+	for (i = 0; i < 65536; i += sizeof(w)) {
+		memcpy(&w, ram + i, sizeof(w));
+		h = (h ^ w) * 1099511628211ULL;
+	}
+	return(h);
+}
+
+/*
+ *	Get the state of the CPU into r and set the CPU from r
+ */
+static void ls_get(struct lsregs *r)
+{
+	register long *p = r->r_reg;
+
+	*p++ = A; *p++ = F & 0xff; *p++ = B; *p++ = C;
+	*p++ = D; *p++ = E; *p++ = H; *p++ = L;
+	*p++ = A_; *p++ = F_ & 0xff; *p++ = B_; *p++ = C_;
+	*p++ = D_; *p++ = E_; *p++ = H_; *p++ = L_;
+	*p++ = IX; *p++ = IY; *p++ = STACK - ram; *p++ = PC - ram;
+	*p++ = I; *p++ = R & 0xff; *p++ = IFF; *p++ = int_mode;
+	*p++ = int_type; *p++ = int_lsb; *p = cpu_error;
+}
+
+static void ls_set(struct lsregs *r)
+{
+	register long *p = r->r_reg;
+
+	A = *p++; F = *p++; B = *p++; C = *p++;
+	D = *p++; E = *p++; H = *p++; L = *p++;
+	A_ = *p++; F_ = *p++; B_ = *p++; C_ = *p++;
+	D_ = *p++; E_ = *p++; H_ = *p++; L_ = *p++;
+	IX = *p++; IY = *p++; STACK = ram + (WORD) *p++;
+	PC = ram + (WORD) *p++;
+	I = *p++; R = *p++; IFF = *p++; int_mode = *p++;
+	int_type = *p++; int_lsb = *p++; cpu_error = *p;
+}
+
+/*
+ *	Run n instructions, stop at an error
+ */
+static void ls_exec(long n, struct lsregs *r)
+{
+	register long i;
+#ifdef WANT_TIM
+	unsigned long long ts = cpu_tstates;
+#endif
+
+	cpu_error = NONE;
+	for (i = 0; i < n && cpu_error == NONE; i++) {
+		ls_pc = PC - ram;
+		memcpy(ls_ins, PC, PC - ram > 65532 ? 65536 - (PC - ram) : 4);
+		cpu_state = SINGLE_STEP;
+		cpu();
+	}
+	ls_get(r);
+	r->r_steps = i;
+#ifdef WANT_TIM
+	if ((r->r_ts = cpu_tstates - ts) == 0)	/* variant without counting */
+		r->r_ts = -1;
+#else
+	r->r_ts = -1;
+#endif
+	r->r_hash = ls_hash();
+}
+
+/*
+ *	Save the machine into the buffers and restore it
+ */
+static void ls_save(void)
+{
+	ls_get(&ls_start);
+	memcpy(ls_mem, ram, 65536);
+	io_export(ls_io);
+}
+
+static void ls_restore(void)
+{
+	ls_set(&ls_start);
+	memcpy(ram, ls_mem, 65536);
+	io_import(ls_io, ls_iolen);
+}
+
+/*
+ *	The peer side: serve the commands on stdin and stdout
+ */
+int lockstep_peer(void)
+{
+	struct lsregs r;
+	long n;
+	char c;
+	int in, out;
+
+	if ((ls_io = malloc(ls_iolen = io_export(NULL))) == NULL)
+		return(EX_OSERR);
+	in = dup(0);
+	out = dup(1);
+	ls_null = open("/dev/null", O_RDWR);
+	dup2(ls_null, 0);
+	dup2(ls_null, 1);
+	dart_files(0, ls_null, ls_null);
+	dart_files(1, ls_null, ls_null);
+	f_flag = 0;
+	for (;;) {
+		if (ls_read(in, &c, 1))
+			return(EX_OK);
+		switch (c) {
+		case 'L':
+			if (ls_read(in, &r, sizeof(r))
+			    || ls_read(in, ram, 65536)
+			    || ls_read(in, &ls_iolen, sizeof(ls_iolen))
+			    || ls_read(in, ls_io, ls_iolen))
+				return(EX_PROTOCOL);
+			ls_set(&r);
+			if (io_import(ls_io, ls_iolen))
+				return(EX_PROTOCOL);
+			break;
+		case 'S':
+			if (ls_read(in, &n, sizeof(n)))
+				return(EX_PROTOCOL);
+			ls_exec(n, &r);
+			if (ls_write(out, &r, sizeof(r)))
+				return(EX_IOERR);
+			break;
+		case 'M':
+			if (ls_write(out, ram, 65536))
+				return(EX_IOERR);
+			break;
+		case 'Q':
+			return(EX_OK);
+		default:
+			return(EX_PROTOCOL);
+		}
+	}
+}
+
+/*
+ *	Start the peer with the shell command cmd
+ */
+static int ls_spawn(char *cmd)
+{
+	char buf[LENCMD];
+	int in[2], out[2];
+
+	snprintf(buf, sizeof(buf), "exec %s --peer", cmd);
+	if (pipe(in) == -1 || pipe(out) == -1) {
+		perror("pipe");
+		return(-1);
+	}
+	fflush(stdout);
+	if ((ls_pid = fork()) == 0) {
+		dup2(out[0], 0);
+		dup2(in[1], 1);
+		close(in[0]); close(in[1]);
+		close(out[0]); close(out[1]);
+		execl("/bin/sh", "sh", "-c", buf, (char *) NULL);
+		_exit(127);
+	}
+	close(out[0]);
+	close(in[1]);
+	if (ls_pid == -1) {
+		perror("fork");
+		return(-1);
+	}
+	ls_out = out[1];
+	ls_in = in[0];
+	return(0);
+}
+
+/*
+ *	Load the machine into the peer
+ */
+static int ls_load(void)
+{
+	struct lsregs r;
+	char c = 'L';
+
+	ls_get(&r);
+	io_export(ls_io);
+	if (ls_write(ls_out, &c, 1) || ls_write(ls_out, &r, sizeof(r))
+	    || ls_write(ls_out, ram, 65536)
+	    || ls_write(ls_out, &ls_iolen, sizeof(ls_iolen))
+	    || ls_write(ls_out, ls_io, ls_iolen))
+		return(-1);
+	return(0);
+}
+
+/*
+ *	Run n instructions on both engines, the state of this one
+ *	into a, the state of the peer into b
+ *
+ *	Output: 0 same state, 1 different, -1 peer failed
+ */
+static int ls_step(long n, struct lsregs *a, struct lsregs *b)
+{
+	char c = 'S';
+
+	if (ls_write(ls_out, &c, 1) || ls_write(ls_out, &n, sizeof(n)))
+		return(-1);
+	ls_exec(n, a);
+	if (ls_read(ls_in, b, sizeof(*b)))
+		return(-1);
+	if (a->r_steps != b->r_steps || a->r_hash != b->r_hash
+	    || (a->r_ts != b->r_ts && a->r_ts != -1 && b->r_ts != -1))
+		return(1);
+	return(memcmp(a->r_reg, b->r_reg, sizeof(a->r_reg)) != 0);
+}
+
+static void ls_quiet(int on)
+{
+	fflush(stdout);
+	dup2(on ? ls_null : ls_stdout, 1);
+}
+
+/*
+ *	Show the first difference, a is this engine, b the peer,
+ *	done the no. of instructions before
+ */
+static void ls_report(struct lsregs *a, struct lsregs *b, long done)
+{
+	register int i, n;
+	char mn[DISLEN], *s;
+	BYTE ins[4];
+	char c = 'M';
+
+	memcpy(ins, ls_ins, sizeof(ins));
+	dis_r(ins, ls_pc, mn);
+	if ((s = strchr(mn, '\n')) != NULL)
+		*s = '\0';
+	printf("Engines differ at instruction %ld, %04x  %s\n",
+	       done + a->r_steps, ls_pc, mn);
+	printf("Reg   this   peer\n");
+	for (i = 0; i < LS_NREG; i++)
+		if (a->r_reg[i] != b->r_reg[i])
+			printf("%-4s  %04lx   %04lx\n", ls_name[i],
+			       a->r_reg[i], b->r_reg[i]);
+	if (a->r_ts != b->r_ts && a->r_ts != -1 && b->r_ts != -1)
+		printf("T-states this %lld, peer %lld\n", a->r_ts, b->r_ts);
+	if (a->r_steps != b->r_steps)
+		printf("Instructions this %ld, peer %ld\n", a->r_steps,
+		       b->r_steps);
+	if (a->r_hash != b->r_hash) {
+		if (ls_write(ls_out, &c, 1) || ls_read(ls_in, ls_mem, 65536))
+			return;
+		for (i = n = 0; i < 65536 && n < LS_NMEM; i++)
+			if (ram[i] != ls_mem[i]) {
+				printf("Memory %04x  this %02x  peer %02x\n", i,
+				       ram[i], ls_mem[i]);
+				n++;
+			}
+	}
+}
+
+/*
+ *	Compare the engines in blocks of n instructions up to limit
+ *	instructions (0 = until a stop), the no. of instructions is
+ *	added to *done
+ *
+ *	Output: 0 same, 1 different, -1 peer failed
+ */
+static int ls_compare(long n, long limit, long *done)
+{
+	struct lsregs a, b;
+	register long k, start = *done;
+	register int i;
+
+	for (;;) {
+		k = (limit && limit - (*done - start) < n) ?
+			limit - (*done - start) : n;
+		if (n > 1)
+			ls_save();
+		if ((i = ls_step(k, &a, &b)) < 0)
+			return(-1);
+		if (i && a.r_reg[LS_NREG - 1] != USERINT) {
+			if (n > 1) {		/* find the instruction */
+				ls_restore();
+				if (ls_load())
+					return(-1);
+				while ((i = ls_step(1, &a, &b)) == 0
+				       && a.r_steps)
+					(*done)++;
+				if (i < 0)
+					return(-1);
+			}
+			ls_quiet(0);
+			if (i == 0)
+				printf("Engines differ in the block after "
+				       "instruction %ld, not single stepped\n",
+				       *done);
+			else
+				ls_report(&a, &b, *done);
+			return(1);
+		}
+		*done += a.r_steps;
+		if (cpu_error != NONE || (limit && *done - start >= limit))
+			return(0);
+	}
+}
+
+static unsigned long ls_rand(void)
+{
+	ls_seed ^= ls_seed << 13;
+	ls_seed ^= ls_seed >> 17;
+	ls_seed ^= ls_seed << 5;
+	return(ls_seed);
+}
+
+/*
+ *	Random memory and registers for a fuzz case
+ */
+static void ls_random(unsigned long seed)
+{
+	register int i;
+
+	ls_seed = seed * 2654435761UL + 1;
+	for (i = 0; i < 65536; i++)
+		ram[i] = ls_rand() >> 8;
+	A = ls_rand(); F = ls_rand() & 0xff; B = ls_rand(); C = ls_rand();
+	D = ls_rand(); E = ls_rand(); H = ls_rand(); L = ls_rand();
+	A_ = ls_rand(); F_ = ls_rand() & 0xff; B_ = ls_rand();
+	C_ = ls_rand(); D_ = ls_rand(); E_ = ls_rand(); H_ = ls_rand();
+	L_ = ls_rand();
+	IX = ls_rand(); IY = ls_rand(); I = ls_rand(); R = ls_rand() & 0x7f;
+	STACK = ram + (WORD) ls_rand();
+	PC = ram + (WORD) ls_rand();
+	IFF = 0;
+	int_mode = 0;
+	int_type = INT_NONE;
+}
+
+/*
+ *	Compare the engine of this simulator with the peer, arg is
+ *	peer[,n] with the command of the peer and the block size,
+ *	fuzz is NULL for the loaded program or cases[,seed]
+ *
+ *	Output: exit code, 0 same, 1 different
+ */
+int lockstep_run(char *arg, char *fuzz)
+{
+	register char *s;
+	long n = 1, done = 0, cases = 0, i = 0;
+	unsigned long seed = 1;
+	int res = 0;
+
+	if ((s = strrchr(arg, ',')) != NULL) {
+		*s++ = '\0';
+		if ((n = atol(s)) < 1) {
+			puts("block size must be at least 1");
+			return(EX_USAGE);
+		}
+	}
+	if (fuzz != NULL) {
+		cases = atol(fuzz);
+		if ((s = strchr(fuzz, ',')) != NULL)
+			seed = strtoul(s + 1, NULL, 0);
+		if (cases < 1) {
+			puts("no. of fuzz cases must be at least 1");
+			return(EX_USAGE);
+		}
+	}
+	if ((ls_io = malloc(ls_iolen = io_export(NULL))) == NULL) {
+		puts("not enough memory for lockstep");
+		return(EX_OSERR);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if (ls_spawn(arg))
+		return(EX_OSERR);
+	ls_null = open("/dev/null", O_RDWR);
+	ls_stdout = dup(1);
+	dart_files(0, ls_null, ls_null);
+	dart_files(1, ls_null, ls_null);
+	f_flag = 0;
+	ls_quiet(1);
+	if (fuzz == NULL) {
+		if ((res = ls_load()) == 0)
+			res = ls_compare(n, 0, &done);
+	} else {
+		for (i = 0; i < cases && res == 0; i++) {
+			ls_random(seed + i);
+			if ((res = ls_load()) == 0)
+				res = ls_compare(n, LS_FUZZN, &done);
+			if (res == 1)
+				printf("Fuzz case %ld, seed %lu\n", i, seed + i);
+			if (cpu_error == USERINT)
+				break;
+		}
+	}
+	ls_quiet(0);
+	if (res < 0)
+		printf("peer %s failed\n", arg);
+	else if (res == 0) {
+		if (fuzz != NULL)
+			printf("%ld fuzz cases, ", i);
+		printf("%ld instructions, no difference\n", done);
+	}
+	ls_write(ls_out, "Q", 1);
+	close(ls_out);
+	close(ls_in);
+	waitpid(ls_pid, NULL, 0);
+	return(res < 0 ? EX_SOFTWARE : res);
+}
@@ -16,27 +16,39 @@
 #include <fcntl.h>
 #include <memory.h>
 #include <getopt.h>
+#include <sysexits.h>
 
 #include "config.h"
 #include "global.h"
 
-#define BUFSIZE	256		/* buffer size for file I/O */
-
-int load_core(void);
-static void save_core(void);
-static int load_mos(int, char *), load_hex(char *), load_bin(char *), checksum(char *);
 extern void int_on(void), int_off(void), mon(void);
 extern void init_io(void), exit_io(void);
 extern int exatoi(char *);
+extern int dasm_main(int, char **);
+static void exit_sim(void);
+
+static char *sfn = "core.z80";	/* core file for option -s */
+static char *rfn = "core.z80";	/* core file for option -l */
+
+#ifdef WANT_PROF
+static char *pfn;		/* profile file, option --profile */
+static char *cfn;		/* call graph file, option --callgraph */
+static int cfold;		/* call graph as folded stacks */
+#endif
+#ifdef WANT_COV
+static char *vfn;		/* coverage file, option --coverage */
+static char *lfn;		/* lcov report, option --lcov */
+static char *lst;		/* assembler listing for lcov report */
+#endif
 
 void help(char *name) {
 #ifndef Z80_UNDOC
-	printf("usage:\t%s -s -l -i -mn -q -fn -xfilename\n",name);
+	printf("usage:\t%s -s -l -i -mn -q -fn -Hn -yfilename -Tfilename -xfilename\n",name);
 #else
-	printf("usage:\t%s -s -l -i -z -mn -q -fn -xfilename\n",name);
+	printf("usage:\t%s -s -l -i -z -mn -q -fn -Hn -yfilename -Tfilename -xfilename\n",name);
 #endif
-	puts("\ts = save core and cpu on exit");
-	puts("\tl = load core and cpu on start");
+	puts("\ts[filename] = save core and cpu on exit, default core.z80");
+	puts("\tl[filename] = load core and cpu on start, default core.z80");
 	puts("\ti = trap on I/O to unused ports");
 #ifdef Z80_UNDOC
 	puts("\tz = trap on undocumented Z80 ops");
@@ -45,12 +57,64 @@ void help(char *name) {
 	puts("\tf = CPU frequenzy n in MHz");
 	puts("\tx = load and execute filename");
 	puts("\tq = exit on HALT");
+	puts("\t--snapshot-at adr|@T-states[,filename] = run -x program to adr or");
+	puts("\t\tT-states, save core into filename (core.z80) and exit");
+	puts("\t--restore filename = load core from filename and run it");
+	puts("\t--run-until adr|@T-states|halt = run -x program or --restore core");
+	puts("\t\tuntil adr, T-states or HALT, show registers and exit");
+	puts("\t--script filename = run monitor commands from filename");
+	puts("\tWithout terminal on stdin, with --script or --run-until the");
+	puts("\tmonitor runs in batch mode and the exit code is the CPU error:");
+	puts("\t0 none/reached, 1 HALT, 2 I/O trap, 3 I/O error, 4/5/6 op-code");
+	puts("\ttrap 1/2/4 bytes, 7 user interrupt, 8 gdb breakpoint, 64 usage,");
+	puts("\t66 no input");
+	puts("\t--rpc socket = load -x program or --restore core and serve");
+	puts("\t\tJSON-RPC requests on the Unix domain socket");
+	puts("\t--gdb port|socket = load -x program or --restore core and serve");
+	puts("\t\tthe gdb remote protocol on a local TCP port or Unix socket");
+	puts("\t--bench secs[,filename] = run the benchmark workloads for secs");
+	puts("\t\teach, write the results as JSON into filename and exit");
+	puts("\t--opbench count[,filename] = run every op-code count times, show");
+	puts("\t\tthe slowest, write all as JSON into filename and exit");
+	puts("\t--lockstep command[,n] = run -x program or --restore core here and");
+	puts("\t\tin the engine started by command --peer, compare them after");
+	puts("\t\tevery n instructions and show the first difference, exit");
+	puts("\t\tcode 0 same, 1 different");
+	puts("\t--fuzz cases[,seed] = --lockstep with random memory and registers");
+	puts("\t--peer = serve as engine of --lockstep on stdin and stdout");
+	puts("\t--cpm filename = run CP/M COM file with BDOS console output,");
+	puts("\t\tcount OK/ERROR test groups, exit code 0 all OK");
+	puts("\t--core auto|fast|timed|traced|debug = variant of the CPU emulation,");
+	puts("\t\tauto takes the fastest one with the options in use");
+#ifdef HISIZE
+	puts("\tH = history for n instructions, 0 = off, in batch mode off");
+	puts("\t\twithout -H");
+#endif
+	puts("\ty = load symbols from filename");
+#ifdef WANT_PROF
+	puts("\t--profile filename = profile and write it into filename at exit");
+	puts("\t--callgraph filename[,f] = write call graph at exit, f = folded");
+#endif
+#ifdef WANT_COV
+	puts("\t--coverage filename = merge code coverage into filename at exit");
+	puts("\t--lcov filename[,listing] = write lcov report at exit");
+#endif
+#ifdef WANT_TRACE
+	puts("\tT = trace into filename[,z], z = compressed");
+	puts("\t--tracedump filename[,n] = print trace from instruction n");
+#endif
 	exit(1);
 }
 
 int main(int argc, char **argv) {
 	register char *s, *p;
 	register char *pn = argv[0];
+#ifdef WANT_TRACE
+	char *tfn = NULL;
+#endif
+#ifdef HISIZE
+	int h_opt = 0;		/* history size given with -H */
+#endif
 
 #ifdef CPU_SPEED
 	f_flag = CPU_SPEED;
@@ -59,8 +123,8 @@ int main(int argc, char **argv) {
 
 	const struct option long_opts[] = {
 		{"help", no_argument, NULL, 'h'},
-		{"savecore", required_argument, NULL, 's'}, 
-		{"loadcore", required_argument, NULL, 'l'},
+		{"savecore", optional_argument, NULL, 's'},
+		{"loadcore", optional_argument, NULL, 'l'},
 		{"trapio", no_argument, NULL, 'i'},
 #ifdef Z80_UNDOC
 		{"trapundoc", no_argument, NULL, 'z'},
@@ -68,23 +132,57 @@ int main(int argc, char **argv) {
 		{"initmem", required_argument, NULL, 'm'},
 		{"cpufreq", required_argument, NULL, 'f'},
 		{"run", required_argument, NULL, 'x'},
+		{"snapshot-at", required_argument, NULL, 'A'},
+		{"restore", required_argument, NULL, 'R'},
+		{"run-until", required_argument, NULL, 'U'},
+		{"script", required_argument, NULL, 'S'},
+		{"rpc", required_argument, NULL, 'J'},
+		{"gdb", required_argument, NULL, 'G'},
+		{"bench", required_argument, NULL, 'B'},
+		{"opbench", required_argument, NULL, 'K'},
+		{"lockstep", required_argument, NULL, 'W'},
+		{"fuzz", required_argument, NULL, 'F'},
+		{"peer", no_argument, NULL, 'E'},
+		{"cpm", required_argument, NULL, 'M'},
+		{"core", required_argument, NULL, 'O'},
 		{"haltquit", no_argument, NULL, 'q'},
+#ifdef HISIZE
+		{"history", required_argument, NULL, 'H'},
+#endif
+		{"symbols", required_argument, NULL, 'y'},
+#ifdef WANT_PROF
+		{"profile", required_argument, NULL, 'P'},
+		{"callgraph", required_argument, NULL, 'C'},
+#endif
+#ifdef WANT_COV
+		{"coverage", required_argument, NULL, 'V'},
+		{"lcov", required_argument, NULL, 'L'},
+#endif
+#ifdef WANT_TRACE
+		{"trace", required_argument, NULL, 'T'},
+		{"tracedump", required_argument, NULL, 'D'},
+#endif
 		{NULL,0,NULL,0}
 	};
 
-	const char *short_opts = "hs:l:izm:f:x:q";
+	const char *short_opts = "hs::l::izm:f:x:qH:T:y:";
 	int option_index=0;
 	int c;
 
+	if ((s=strrchr(pn,'/'))!=NULL) s++; else s=pn;
+	if (strcmp(s,"z80dis")==0) return(dasm_main(argc,argv));
+
 	while ((c=getopt_long(argc,argv,short_opts,long_opts,&option_index))!=-1) {
 		switch (c) {
 			case 'h':
 				help(pn);
 			case 's':
 				s_flag=1;
+				if (optarg!=NULL) sfn=optarg;
 				break;
 			case 'l':
 				l_flag=1;
+				if (optarg!=NULL) rfn=optarg;
 				break;
 			case 'i':
 				break;
@@ -110,6 +208,100 @@ int main(int argc, char **argv) {
 			case 'q':
 				q_flag=1;
 				break;
+			case 'A':
+				sa_arg=optarg;
+				break;
+			case 'R':
+				r_flag=1;
+				l_flag=1;
+				rfn=optarg;
+				break;
+			case 'U':
+				ru_arg=optarg;
+				b_flag=1;
+				break;
+			case 'S':
+				b_file=optarg;
+				b_flag=1;
+				break;
+			case 'J':
+				rpc_path=optarg;
+				b_flag=1;
+				break;
+			case 'G':
+				gdb_arg=optarg;
+				b_flag=1;
+				break;
+			case 'B':
+				bn_arg=optarg;
+				b_flag=1;
+				break;
+			case 'K':
+				ob_arg=optarg;
+				b_flag=1;
+				break;
+			case 'W':
+				ls_arg=optarg;
+				b_flag=1;
+				break;
+			case 'F':
+				fz_arg=optarg;
+				break;
+			case 'E':
+				pe_flag=1;
+				b_flag=1;
+				break;
+			case 'M':
+				cp_arg=optarg;
+				b_flag=1;
+				break;
+			case 'O':
+				if (core_set(optarg)) {
+					printf("unknown CPU variant %s\n",optarg);
+					return(EX_USAGE);
+				}
+				break;
+#ifdef HISIZE
+			case 'H':
+				h_size=atol(optarg);
+				h_opt=1;
+				break;
+#endif
+			case 'y':
+				if (sym_load(optarg)<0) return(1);
+				break;
+#ifdef WANT_PROF
+			case 'P':
+				pfn=optarg;
+				p_flag=1;
+				break;
+			case 'C':
+				if ((p=strchr(optarg,','))!=NULL) *p++='\0';
+				cfn=optarg;
+				cfold=(p && *p=='f');
+				cg_flag=1;
+				break;
+#endif
+#ifdef WANT_COV
+			case 'V':
+				vfn=optarg;
+				cov_flag=1;
+				break;
+			case 'L':
+				if ((p=strchr(optarg,','))!=NULL) *p++='\0';
+				lfn=optarg;
+				lst=p;
+				cov_flag=1;
+				break;
+#endif
+#ifdef WANT_TRACE
+			case 'T':
+				tfn=optarg;
+				break;
+			case 'D':
+				if ((p=strchr(optarg,','))!=NULL) *p++='\0';
+				return(trace_dump(optarg,p?strtoull(p,NULL,0):0));
+#endif
 			case '?':
 				help(pn);
 			default:
@@ -117,327 +309,93 @@ int main(int argc, char **argv) {
 		}
 	}
 
-	putchar('\n');
-	puts("#######  #####    ###            #####    ###   #     #");
-	puts("     #  #     #  #   #          #     #    #    ##   ##");
-	puts("    #   #     # #     #         #          #    # # # #");
-	puts("   #     #####  #     #  #####   #####     #    #  #  #");
-	puts("  #     #     # #     #               #    #    #     #");
-	puts(" #      #     #  #   #          #     #    #    #     #");
-	puts("#######  #####    ###            #####    ###   #     #");
-	printf("\nRelease %s,%s\n",RELEASE,COPYR);
+	if (sa_arg!=NULL && !x_flag) {
+		puts("--snapshot-at needs a program to run with -x");
+		return(1);
+	}
+	if (ru_arg!=NULL && !x_flag && !r_flag) {
+		puts("--run-until needs a program to run with -x or --restore");
+		return(EX_USAGE);
+	}
+	if (ls_arg!=NULL && !x_flag && !r_flag && fz_arg==NULL) {
+		puts("--lockstep needs a program to run with -x or --restore, or --fuzz");
+		return(EX_USAGE);
+	}
+	if (fz_arg!=NULL && ls_arg==NULL) {
+		puts("--fuzz needs a peer with --lockstep");
+		return(EX_USAGE);
+	}
+	if (!isatty(0)) b_flag=1;
+
+	if (!b_flag) {
+		putchar('\n');
+		puts("#######  #####    ###            #####    ###   #     #");
+		puts("     #  #     #  #   #          #     #    #    ##   ##");
+		puts("    #   #     # #     #         #          #    # # # #");
+		puts("   #     #####  #     #  #####   #####     #    #  #  #");
+		puts("  #     #     # #     #               #    #    #     #");
+		puts(" #      #     #  #   #          #     #    #    #     #");
+		puts("#######  #####    ###            #####    ###   #     #");
+		printf("\nRelease %s,%s\n",RELEASE,COPYR);
 #ifdef USR_COM
-	printf("%s %s\n",USR_REL,USR_COM);
+		printf("%s %s\n",USR_REL,USR_COM);
 #endif
-
-if (f_flag > 0)
-	printf("\nCPU speed is %d MHz\n", f_flag);
-	else
-	printf("\nCPU speed is unlimited\n");
+		if (f_flag > 0)
+			printf("\nCPU speed is %d MHz\n", f_flag);
+		else
+			printf("\nCPU speed is unlimited\n");
+	}
 
 	fflush(stdout);
 
+#ifdef HISIZE
+	if (b_flag && !h_opt)	/* batch runs take the fast variant */
+		h_size=0;
+	if (hist_init(h_size)) {
+		puts("not enough memory for history");
+		return(1);
+	}
+#endif
+
 	wrk_ram	= PC = ram;
 	STACK = ram + 0xffff;
 	memset((char *)	ram, m_flag, 65536);
-if (l_flag)
-	if (load_core()) return(1);
 	int_on();
 	init_io();
+	if (l_flag && core_load(rfn)) return(1);
+#ifdef WANT_TRACE
+	if (tfn!=NULL) {
+		if ((p=strchr(tfn,','))!=NULL) *p++='\0';
+		if (trace_open(tfn,p && *p=='z')) return(1);
+	}
+#endif
+	atexit(exit_sim);
 	mon();
-	if (s_flag) save_core();
+	if (s_flag) core_save(sfn);
 	exit_io();
 	int_off();
-	return(0);
-	}
-
-/*
- *	This function saves the CPU and the memory into the file core.z80
- *
- */
-static void save_core(void)
-{
-	int fd;
-
-	if ((fd	= open("core.z80", O_WRONLY | O_CREAT, 0600)) == -1) {
-		puts("can't open file core.z80");
-		return;
-	}
-	write(fd, (char	*) &A, sizeof(A));
-	write(fd, (char	*) &F, sizeof(F));
-	write(fd, (char	*) &B, sizeof(B));
-	write(fd, (char	*) &C, sizeof(C));
-	write(fd, (char	*) &D, sizeof(D));
-	write(fd, (char	*) &E, sizeof(E));
-	write(fd, (char	*) &H, sizeof(H));
-	write(fd, (char	*) &L, sizeof(L));
-	write(fd, (char	*) &A_,	sizeof(A_));
-	write(fd, (char	*) &F_,	sizeof(F_));
-	write(fd, (char	*) &B_,	sizeof(B_));
-	write(fd, (char	*) &C_,	sizeof(C_));
-	write(fd, (char	*) &D_,	sizeof(D_));
-	write(fd, (char	*) &E_,	sizeof(E_));
-	write(fd, (char	*) &H_,	sizeof(H_));
-	write(fd, (char	*) &L_,	sizeof(L_));
-	write(fd, (char	*) &I, sizeof(I));
-	write(fd, (char	*) &IFF, sizeof(IFF));
-	write(fd, (char	*) &R, sizeof(R));
-	write(fd, (char	*) &PC,	sizeof(PC));
-	write(fd, (char	*) &STACK, sizeof(STACK));
-	write(fd, (char	*) &IX,	sizeof(IX));
-	write(fd, (char	*) &IY,	sizeof(IY));
-	write(fd, (char	*) ram,	65536);
-	close(fd);
-}
-
-/*
- *	This function loads the CPU and memory from the file core.z80
- *
- */
-int load_core(void)
-{
-	int fd;
-
-	if ((fd	= open("core.z80", O_RDONLY)) == -1) {
-		puts("can't open file core.z80");
-		return(1);
+	return(b_flag ? cpu_error : 0);
 	}
-	read(fd, (char *) &A, sizeof(A));
-	read(fd, (char *) &F, sizeof(F));
-	read(fd, (char *) &B, sizeof(B));
-	read(fd, (char *) &C, sizeof(C));
-	read(fd, (char *) &D, sizeof(D));
-	read(fd, (char *) &E, sizeof(E));
-	read(fd, (char *) &H, sizeof(H));
-	read(fd, (char *) &L, sizeof(L));
-	read(fd, (char *) &A_, sizeof(A_));
-	read(fd, (char *) &F_, sizeof(F_));
-	read(fd, (char *) &B_, sizeof(B_));
-	read(fd, (char *) &C_, sizeof(C_));
-	read(fd, (char *) &D_, sizeof(D_));
-	read(fd, (char *) &E_, sizeof(E_));
-	read(fd, (char *) &H_, sizeof(H_));
-	read(fd, (char *) &L_, sizeof(L_));
-	read(fd, (char *) &I, sizeof(I));
-	read(fd, (char *) &IFF,	sizeof(IFF));
-	read(fd, (char *) &R, sizeof(R));
-	read(fd, (char *) &PC, sizeof(PC));
-	read(fd, (char *) &STACK, sizeof(STACK));
-	read(fd, (char *) &IX, sizeof(IX));
-	read(fd, (char *) &IY, sizeof(IY));
-	read(fd, (char *) ram, 65536);
-	close(fd);
-
-	return(0);
-}
 
 /*
- *	Read a file into the memory of the emulated CPU.
- *	The following file formats are supported:
- *
- *		binary images with Mostek header
- *		Intel hex
+ *	This function is called at exit, also if the simulation
+ *	is ended by -q or a signal
  */
-int load_file(char *s)
+static void exit_sim(void)
 {
-	char fn[LENCMD];
-	BYTE fileb[5];
-	register char *pfn = fn;
-	int fd;
-
-	while (isspace((int)*s))
-		s++;
-	while (*s != ',' && *s != '\n' && *s !=	'\0')
-		*pfn++ = *s++;
-	*pfn = '\0';
-	if (strlen(fn) == 0) {
-		puts("no input file given");
-		return(1);
-	}
-	if ((fd	= open(fn, O_RDONLY)) == -1) {
-		printf("can't open file %s\n", fn);
-		return(1);
-	}
-	if (*s == ',')
-		wrk_ram	= ram +	exatoi(++s);
-	else
-		wrk_ram	= NULL;
-	read(fd, (char *) fileb, 5); /*	read first 5 bytes of file */
-	if (*fileb == (BYTE) 0xff) {	/* Mostek header ? */
-		lseek(fd, 0l, 0);
-		printf("Reading as Mostek file.\n");
-		return (load_mos(fd, fn));
-	}
-	else {
-		close(fd);
-		//printf("Reading as Intel hex file.\n"); // TODO: add flag for this
-		//return (load_hex(fn));
-		printf("Reading as flat binary file...\n");
-		return (load_bin(fn));
-	}
-}
-
-/*
- *	Loader for binary images with Mostek header.
- *	Format of the first 3 bytes:
- *
- *	0xff ll	lh
- *
- *	ll = load address low
- *	lh = load address high
- */
-static int load_mos(int fd, char *fn)
-{
-	BYTE fileb[3];
-	unsigned count,	readed;
-	int rc = 0;
-
-	read(fd, (char *) fileb, 3);	/* read load address */
-	if (wrk_ram == NULL)		/* and set if not given */
-		wrk_ram	= ram +	(fileb[2] * 256	+ fileb[1]);
-	count =	ram + 65535 - wrk_ram;
-	if ((readed = read(fd, (char *)	wrk_ram, count)) == count) {
-		puts("Too much to load, stopped at 0xffff");
-		rc = 1;
-	}
-	close(fd);
-	printf("\nLoader statistics for file %s:\n", fn);
-	printf("START : %04x\n", (unsigned int)(wrk_ram - ram));
-	printf("END   : %04x\n", (unsigned int)(wrk_ram - ram + readed - 1));
-	printf("LOADED: %04x\n\n", readed);
-	PC = wrk_ram;
-	return(rc);
-}
-
-/*
- *  Loader for flat binary
- */
-static int load_bin(char *fn)
-{
-	FILE *fd;
-	int addr = 0;
-	int saddr = 0;
-	int eaddr = 0;
-
-	if ((fd = fopen(fn, "rb")) == NULL) {
-		printf("can't open file %s\n", fn);
-		return(1);
-	}
-
-	fseek(fd, 0, SEEK_END);
-	unsigned long flen=ftell(fd);
-	fseek(fd, 0, SEEK_SET);
-
-	fread(ram+addr,flen,1,fd);
-	eaddr=addr+flen;
-
-	fclose(fd);
-	printf("\nLoader statistics for file %s:\n", fn);
-	printf("START : 0x%04x\n", saddr);
-	printf("END   : 0x%04x\n", eaddr);
-	printf("LOADED: 0x%04x (%d)\n\n", eaddr - saddr + 1, eaddr - saddr + 1);
-	PC = wrk_ram = ram + saddr;
-
-	return(0);
-}
-
-/*
- *	Loader for Intel hex
- */
-static int load_hex(char *fn)
-{
-	register int i;
-	FILE *fd;
-	char buf[BUFSIZE];
-	char *s;
-	int count = 0;
-	int addr = 0;
-	int saddr = 0xffff;
-	int eaddr = 0;
-	int data;
-
-	if ((fd = fopen(fn, "r")) == NULL) {
-		printf("can't open file %s\n", fn);
-		return(1);
-	}
-
-	while (fgets(&buf[0], BUFSIZE, fd) != NULL) {
-		s = &buf[0];
-		while (isspace(*s))
-			s++;
-		if (*s != ':')
-			continue;
-		if (checksum(s + 1) != 0) {
-			printf("invalid checksum in hex record: %s\n", s);
-			return(1);
-		}
-		s++;
-		count = (*s <= '9') ? (*s - '0') << 4 :
-			(*s - 'A' + 10) << 4;
-		s++;
-		count += (*s <= '9') ? (*s - '0') :
-			(*s - 'A' + 10);
-		s++;
-		if (count == 0)
-			break;
-		addr = (*s <= '9') ? (*s - '0') << 4 :
-			(*s - 'A' + 10) << 4;
-		s++;
-		addr += (*s <= '9') ? (*s - '0') :
-			(*s - 'A' + 10);
-		s++;
-		addr *= 256;
-		addr += (*s <= '9') ? (*s - '0') << 4 :
-			(*s - 'A' + 10) << 4;
-		s++;
-		addr += (*s <= '9') ? (*s - '0') :
-			(*s - 'A' + 10);
-		s++;
-		if (addr < saddr)
-			saddr = addr;
-		eaddr = addr + count - 1;
-		s += 2;
-		for (i = 0; i < count; i++) {
-			data = (*s <= '9') ? (*s - '0') << 4 :
-				(*s - 'A' + 10) << 4;
-			s++;
-			data += (*s <= '9') ? (*s - '0') :
-				(*s - 'A' + 10);
-			s++;
-			*(ram + addr + i) = data;
-		}
-	}
-
-	fclose(fd);
-	printf("\nLoader statistics for file %s:\n", fn);
-	printf("START : %04x\n", saddr);
-	printf("END   : %04x\n", eaddr);
-	printf("LOADED: %04x\n\n", eaddr - saddr + 1);
-	PC = wrk_ram = ram + saddr;
-
-	return(0);
-}
-
-/*
- *	Verify checksum of Intel hex records
- */
-static int checksum(char *s)
-{
-	int chk = 0;
-
-	while (*s != '\n') {
-		chk += (*s <= '9') ?
-			(*s - '0') << 4 :
-			(*s - 'A' + 10) << 4;
-		s++;
-		chk += (*s <= '9') ?
-			(*s - '0') :
-			(*s - 'A' + 10);
-		s++;
-	}
-
-	if ((chk & 255) == 0)
-		return(0);
-	else
-		return(1);
+#ifdef WANT_TRACE
+	trace_close();
+#endif
+#ifdef WANT_PROF
+	if (pfn != NULL)
+		prof_write(pfn);
+	if (cfn != NULL)
+		cg_write(cfn, cfold);
+#endif
+#ifdef WANT_COV
+	if (vfn != NULL)
+		cov_save(vfn, 1);
+	if (lfn != NULL)
+		cov_report(lfn, 1, lst);
+#endif
 }
@@ -0,0 +1,271 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module decodes the memory locations the instruction
+ *	where PC points to is going to write, with the current
+ *	contents of the CPU registers. The op-code functions write
+ *	into the memory directly, so everything which needs to know
+ *	about memory writes (trace, ...) asks here before
+ *	the instruction is executed.
+ */
+
+#include <string.h>
+#include "config.h"
+#include "global.h"
+
+/*
+ *	Check the condition of conditional CALL op-codes,
+ *	cc is bits 5-3 of the op-code
+ */
+static int cond(int cc)
+{
+	switch (cc) {
+	case 0:	return(!(F & Z_FLAG));		/* NZ */
+	case 1:	return(F & Z_FLAG);		/* Z */
+	case 2:	return(!(F & C_FLAG));		/* NC */
+	case 3:	return(F & C_FLAG);		/* C */
+	case 4:	return(!(F & P_FLAG));		/* PO */
+	case 5:	return(F & P_FLAG);		/* PE */
+	case 6:	return(!(F & S_FLAG));		/* P */
+	default: return(F & S_FLAG);		/* M */
+	}
+}
+
+/*
+ *	Decode the memory writes of the instruction at PC.
+ *	The written address range is returned in adr and len,
+ *	it may wrap around at 0xffff.
+ *
+ *	Output: 1 instruction writes memory, 0 no memory write
+ */
+int mem_wrspan(WORD *adr, long *len)
+{
+	register WORD pc = PC - ram;
+	register WORD sp = STACK - ram;
+	register int op, b2;
+	WORD hl = (H << 8) + L, de = (D << 8) + E, bc = (B << 8) + C;
+	WORD ir;
+
+#define	MEM(a)	ram[(WORD)(a)]
+#define	SPAN(a, l) { *adr = (a); *len = (l); return(1); }
+
+	op = MEM(pc);
+	switch (op) {
+	case 0x02:				/* LD (BC),A */
+		SPAN(bc, 1);
+	case 0x12:				/* LD (DE),A */
+		SPAN(de, 1);
+	case 0x22:				/* LD (nn),HL */
+		SPAN(MEM(pc + 1) + (MEM(pc + 2) << 8), 2);
+	case 0x32:				/* LD (nn),A */
+		SPAN(MEM(pc + 1) + (MEM(pc + 2) << 8), 1);
+	case 0x34: case 0x35: case 0x36:	/* INC/DEC/LD (HL) */
+	case 0x70: case 0x71: case 0x72: case 0x73:
+	case 0x74: case 0x75: case 0x77:	/* LD (HL),r */
+		SPAN(hl, 1);
+	case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+	case 0xe4: case 0xec: case 0xf4: case 0xfc:	/* CALL cc,nn */
+		if (!cond((op >> 3) & 7))
+			return(0);
+		SPAN(sp - 2, 2);
+	case 0xcd:				/* CALL nn */
+	case 0xc5: case 0xd5: case 0xe5: case 0xf5:	/* PUSH */
+	case 0xc7: case 0xcf: case 0xd7: case 0xdf:
+	case 0xe7: case 0xef: case 0xf7: case 0xff:	/* RST */
+		SPAN(sp - 2, 2);
+	case 0xe3:				/* EX (SP),HL */
+		SPAN(sp, 2);
+	case 0xcb:
+		b2 = MEM(pc + 1);
+		if ((b2 & 7) == 6 && (b2 < 0x40 || b2 > 0x7f))
+			SPAN(hl, 1);
+		return(0);
+	case 0xed:
+		b2 = MEM(pc + 1);
+		switch (b2) {
+		case 0x43: case 0x53: case 0x63: case 0x73: /* LD (nn),rr */
+			SPAN(MEM(pc + 2) + (MEM(pc + 3) << 8), 2);
+		case 0x67: case 0x6f:		/* RRD, RLD */
+			SPAN(hl, 1);
+		case 0xa0: case 0xa8:		/* LDI, LDD */
+			SPAN(de, 1);
+		case 0xb0:			/* LDIR */
+			SPAN(de, bc ? bc : 65536L);
+		case 0xb8:			/* LDDR */
+			SPAN(de - (bc ? bc : 65536L) + 1, bc ? bc : 65536L);
+		case 0xa2: case 0xaa:		/* INI, IND */
+			SPAN(hl, 1);
+		case 0xb2:			/* INIR */
+			SPAN(hl, B ? B : 256);
+		case 0xba:			/* INDR */
+			SPAN(hl - (B ? B : 256) + 1, B ? B : 256);
+		}
+		return(0);
+	case 0xdd:
+	case 0xfd:
+		ir = (op == 0xdd) ? IX : IY;
+		b2 = MEM(pc + 1);
+		switch (b2) {
+		case 0x22:			/* LD (nn),IX */
+			SPAN(MEM(pc + 2) + (MEM(pc + 3) << 8), 2);
+		case 0x34: case 0x35: case 0x36: /* INC/DEC/LD (IX+d) */
+		case 0x70: case 0x71: case 0x72: case 0x73:
+		case 0x74: case 0x75: case 0x77: /* LD (IX+d),r */
+			SPAN(ir + (signed char) MEM(pc + 2), 1);
+		case 0xe3:			/* EX (SP),IX */
+			SPAN(sp, 2);
+		case 0xe5:			/* PUSH IX */
+			SPAN(sp - 2, 2);
+		case 0xcb:			/* shift/bit (IX+d) */
+			b2 = MEM(pc + 3);
+			if (b2 < 0x40 || b2 > 0x7f)
+				SPAN(ir + (signed char) MEM(pc + 2), 1);
+			return(0);
+		}
+		return(0);
+	}
+	return(0);
+
+#undef	MEM
+#undef	SPAN
+}
+
+/*
+ *	Write protection for ROM and hooks for writes. The addresses
+ *	of ROM and with hook are marked in bitmaps and mem_wp is set.
+ *	Before an instruction is executed the bytes it is going to
+ *	write are saved, after the execution the hook function is
+ *	called with the bytes written into addresses with hook, then
+ *	the bytes in ROM are restored, so writes into ROM are without
+ *	effect like on the hardware.
+ */
+static BYTE rom_map[8192];		/* bitmap of ROM addresses */
+static BYTE wh_map[8192];		/* bitmap of addresses with hook */
+static void (*wh_fun)(WORD, BYTE);	/* the hook */
+static BYTE rom_save[65536];		/* bytes before the write */
+static WORD rom_adr;			/* span written by the instruction */
+static long rom_len;
+static int rom_hit;			/* span includes ROM or hook */
+
+#define	ROM(a)	(rom_map[(a) >> 3] & (1 << ((a) & 7)))
+#define	HOOK(a)	(wh_map[(a) >> 3] & (1 << ((a) & 7)))
+
+/*
+ *	Set mem_wp if any address is ROM or has a hook
+ */
+static void mw_check(void)
+{
+	register int i;
+
+	mem_wp = 0;
+	for (i = 0; i < 8192; i++)
+		if (rom_map[i] | wh_map[i]) {
+			mem_wp = 1;
+			break;
+		}
+}
+
+/*
+ *	Mark len bytes from address adr as ROM
+ */
+void rom_set(WORD adr, long len)
+{
+	mem_map(adr, len, 1, -1);
+}
+
+/*
+ *	All memory is RAM again, the hooks stay
+ */
+void rom_clear(void)
+{
+	memset(rom_map, 0, sizeof(rom_map));
+	mw_check();
+}
+
+/*
+ *	Check if address adr is ROM
+ */
+int rom_test(WORD adr)
+{
+	return(ROM(adr) != 0);
+}
+
+/*
+ *	Set len bytes from address adr to ROM (rom 1) or RAM (rom 0)
+ *	and with (hook 1) or without (hook 0) hook for writes,
+ *	-1 leaves it as it is
+ */
+void mem_map(WORD adr, long len, int rom, int hook)
+{
+	register long i;
+	register WORD a;
+
+	for (i = 0; i < len; i++) {
+		a = adr + i;
+		if (rom > 0)
+			rom_map[a >> 3] |= 1 << (a & 7);
+		else if (rom == 0)
+			rom_map[a >> 3] &= ~(1 << (a & 7));
+		if (hook > 0)
+			wh_map[a >> 3] |= 1 << (a & 7);
+		else if (hook == 0)
+			wh_map[a >> 3] &= ~(1 << (a & 7));
+	}
+	mw_check();
+}
+
+/*
+ *	Set the function called for writes into addresses with hook,
+ *	with the address and the byte written
+ */
+void mem_hook(void (*fun)(WORD, BYTE))
+{
+	wh_fun = fun;
+}
+
+/*
+ *	Called from the CPU emulation before the instruction at PC
+ *	is executed, if mem_wp is set
+ */
+void rom_pre(void)
+{
+	register long i;
+	register WORD a;
+
+	rom_hit = 0;
+	if (!mem_wrspan(&rom_adr, &rom_len))
+		return;
+	for (i = 0; i < rom_len; i++) {
+		a = rom_adr + i;
+		if (ROM(a) || HOOK(a)) {
+			rom_save[i] = ram[a];
+			rom_hit = 1;
+		}
+	}
+}
+
+/*
+ *	Called from the CPU emulation after the instruction was
+ *	executed, if mem_wp is set
+ */
+void rom_post(void)
+{
+	register long i;
+	register WORD a;
+
+	if (!rom_hit)
+		return;
+	for (i = 0; i < rom_len; i++) {
+		a = rom_adr + i;
+		if (HOOK(a) && wh_fun != NULL)
+			(*wh_fun)(a, ram[a]);
+		if (ROM(a))
+			ram[a] = rom_save[i];
+	}
+}
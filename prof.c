@@ -0,0 +1,250 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module contains the execution profiler. For every
+ *	address the no. of executions and the T-states used are
+ *	counted, and the same for every op-code, with separate
+ *	tables for the CB, ED, DD, FD, DDCB and FDCB prefixes.
+ *	Reports are sorted by T-states, addresses are shown with
+ *	symbols if a symbol file was loaded.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "global.h"
+
+#ifdef WANT_PROF
+
+#ifndef WANT_TIM
+#error "WANT_PROF needs WANT_TIM"
+#endif
+
+#define P_NTAB	7		/* no. of op-code tables */
+
+static unsigned long p_cnt[65536];	/* executions for each address */
+static unsigned long long p_ts[65536];	/* T-states for each address */
+static unsigned long o_cnt[P_NTAB][256]; /* executions for each op-code */
+static unsigned long long o_ts[P_NTAB][256]; /* T-states for each op-code */
+
+static char *o_pre[P_NTAB] = {
+	"", "CB ", "ED ", "DD ", "FD ", "DD CB ", "FD CB "
+};
+
+static int p_sort[65536];		/* indices sorted by T-states */
+static unsigned long long *p_key;	/* what is sorted */
+
+/*
+ *	Count the instruction at pc, which used t T-states,
+ *	called from the CPU emulation after the execution
+ */
+void prof_put(WORD pc, int t)
+{
+	register int op = ram[pc], tab = 0;
+
+	p_cnt[pc]++;
+	p_ts[pc] += t;
+	switch (op) {
+	case 0xcb:
+		tab = 1;
+		op = ram[(WORD) (pc + 1)];
+		break;
+	case 0xed:
+		tab = 2;
+		op = ram[(WORD) (pc + 1)];
+		break;
+	case 0xdd:
+	case 0xfd:
+		tab = (op == 0xdd) ? 3 : 4;
+		op = ram[(WORD) (pc + 1)];
+		if (op == 0xcb) {
+			tab += 2;
+			op = ram[(WORD) (pc + 3)];
+		}
+		break;
+	}
+	o_cnt[tab][op]++;
+	o_ts[tab][op] += t;
+}
+
+/*
+ *	Clear all counters
+ */
+void prof_clear(void)
+{
+	memset(p_cnt, 0, sizeof(p_cnt));
+	memset(p_ts, 0, sizeof(p_ts));
+	memset(o_cnt, 0, sizeof(o_cnt));
+	memset(o_ts, 0, sizeof(o_ts));
+}
+
+static int p_cmp(const void *a, const void *b)
+{
+	register unsigned long long x = p_key[*(int *) a];
+	register unsigned long long y = p_key[*(int *) b];
+
+	return((x < y) ? 1 : (x > y) ? -1 : 0);
+}
+
+/*
+ *	Sum of all T-states counted
+ */
+static unsigned long long p_total(void)
+{
+	register int i;
+	unsigned long long sum = 0;
+
+	for (i = 0; i < 65536; i++)
+		sum += p_ts[i];
+	return(sum);
+}
+
+static double p_pct(unsigned long long t, unsigned long long total)
+{
+	return(total ? 100.0 * (double) t / (double) total : 0.0);
+}
+
+/*
+ *	Print the n addresses with the most T-states
+ */
+static void p_addr(FILE *fp, int n)
+{
+	register int i, m = 0;
+	unsigned long long total = p_total();
+	char *s;
+	int off;
+
+	for (i = 0; i < 65536; i++)
+		if (p_cnt[i])
+			p_sort[m++] = i;
+	p_key = p_ts;
+	qsort(p_sort, m, sizeof(int), p_cmp);
+	fprintf(fp, "Addr  Symbol                  Count        T-states      %%\n");
+	for (i = 0; i < m && i < n; i++) {
+		fprintf(fp, "%04x  ", p_sort[i]);
+		if ((s = sym_lookup(p_sort[i], &off)) != NULL) {
+			if (off)
+				fprintf(fp, "%-16.16s+%-5x  ", s, off);
+			else
+				fprintf(fp, "%-22.22s  ", s);
+		} else
+			fprintf(fp, "%-22s  ", "");
+		fprintf(fp, "%10lu  %14llu  %5.1f\n", p_cnt[p_sort[i]],
+			p_ts[p_sort[i]], p_pct(p_ts[p_sort[i]], total));
+	}
+}
+
+/*
+ *	Print the n symbols with the most T-states, all addresses
+ *	from a symbol up to the next one are counted for it
+ */
+static void p_sym(FILE *fp, int n)
+{
+	static unsigned long long s_ts[65536];
+	static unsigned long s_cnt[65536];
+	register int i, m = 0;
+	unsigned long long total = p_total();
+	char *s;
+	int off;
+
+	if (sym_count() == 0) {
+		fprintf(fp, "No symbols loaded\n");
+		return;
+	}
+	memset(s_ts, 0, sizeof(s_ts));
+	memset(s_cnt, 0, sizeof(s_cnt));
+	for (i = 0; i < 65536; i++)
+		if (p_cnt[i] && sym_lookup(i, &off) != NULL) {
+			s_ts[i - off] += p_ts[i];
+			s_cnt[i - off] += p_cnt[i];
+		}
+	for (i = 0; i < 65536; i++)
+		if (s_cnt[i])
+			p_sort[m++] = i;
+	p_key = s_ts;
+	qsort(p_sort, m, sizeof(int), p_cmp);
+	fprintf(fp, "Addr  Symbol                  Instr        T-states      %%\n");
+	for (i = 0; i < m && i < n; i++) {
+		s = sym_lookup(p_sort[i], &off);
+		fprintf(fp, "%04x  %-22.22s  %10lu  %14llu  %5.1f\n",
+			p_sort[i], s, s_cnt[p_sort[i]], s_ts[p_sort[i]],
+			p_pct(s_ts[p_sort[i]], total));
+	}
+}
+
+/*
+ *	Print the n op-codes with the most T-states
+ */
+static void p_opc(FILE *fp, int n)
+{
+	static unsigned long long k[P_NTAB * 256];
+	register int i, m = 0;
+	unsigned long long total = p_total();
+
+	for (i = 0; i < P_NTAB * 256; i++) {
+		k[i] = o_ts[i >> 8][i & 0xff];
+		if (o_cnt[i >> 8][i & 0xff])
+			p_sort[m++] = i;
+	}
+	p_key = k;
+	qsort(p_sort, m, sizeof(int), p_cmp);
+	fprintf(fp, "Op-code        Count        T-states      %%\n");
+	for (i = 0; i < m && i < n; i++)
+		fprintf(fp, "%6s%02x  %12lu  %14llu  %5.1f\n",
+			o_pre[p_sort[i] >> 8], p_sort[i] & 0xff,
+			o_cnt[p_sort[i] >> 8][p_sort[i] & 0xff], k[p_sort[i]],
+			p_pct(k[p_sort[i]], total));
+}
+
+/*
+ *	Print a report, type is 'a' for addresses, 's' for
+ *	symbols and 'o' for op-codes, n is the no. of lines
+ */
+void prof_print(FILE *fp, int type, int n)
+{
+	switch (type) {
+	case 'a':
+		p_addr(fp, n);
+		break;
+	case 's':
+		p_sym(fp, n);
+		break;
+	case 'o':
+		p_opc(fp, n);
+		break;
+	}
+}
+
+/*
+ *	Write all reports into file fn
+ *
+ *	Output: 0 ok, 1 error
+ */
+int prof_write(char *fn)
+{
+	FILE *fp;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	fprintf(fp, "Total T-states: %llu\n\n", p_total());
+	p_addr(fp, 65536);
+	fputc('\n', fp);
+	if (sym_count()) {
+		p_sym(fp, 65536);
+		fputc('\n', fp);
+	}
+	p_opc(fp, P_NTAB * 256);
+	fclose(fp);
+	return(0);
+}
+
+#endif
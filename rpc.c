@@ -0,0 +1,605 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module serves the monitor operations as JSON-RPC requests
+ *	on a Unix domain socket, so that test harnesses can drive the
+ *	simulator from another program. A request is one line like
+ *
+ *	{"id":1,"method":"read","params":{"addr":256,"len":16}}
+ *
+ *	and the answer is one line with the same id and a "result" or
+ *	an "error". Memory and DART transfers are binary: the "len"
+ *	bytes of "write" and "dart" follow the request line, the bytes
+ *	of "read" follow the answer line. Numbers can be given as JSON
+ *	numbers or as strings like "0x100".
+ *
+ *	Methods:
+ *	load {file}			load a file like the r command
+ *	regs				get all registers
+ *	set_regs {a,f,...,pc,sp}	set the given registers
+ *	read {addr,len}			read memory
+ *	write {addr,len}		write memory
+ *	step {count}			single step count instructions
+ *	run {tstates} | {until} | {}	run for T-states, until adr,
+ *					@T-states or halt, or until stop
+ *	break {addr,pass}		set a breakpoint
+ *	clear {addr}			remove a breakpoint
+ *	dart {chan,len}			inject input bytes into the DART
+ *	save {file}, restore {file}	core snapshot and restore
+ *	quit				end the server
+ *
+ *	One client is served at a time.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sysexits.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "config.h"
+#include "global.h"
+
+#define RPC_LINE	4096		/* max. length of a request line */
+
+#define RPC_PARSE	-32700		/* JSON-RPC error codes */
+#define RPC_METHOD	-32601
+#define RPC_PARAMS	-32602
+#define RPC_FAIL	-32000
+
+extern int load_file(char *);
+extern int dart_inject(int, BYTE *, int);
+
+static int rp_fd;			/* socket of the client */
+static int rp_quit;
+static char rp_buf[RPC_LINE];		/* input buffer of the socket */
+static int rp_pos, rp_n;
+static char *rp_err;			/* message of an error answer */
+static BYTE rp_mem[65536];		/* binary payload */
+static int rp_len;			/* payload of the answer */
+
+static struct rpreg {			/* registers of regs and set_regs */
+	char *r_name;
+	int r_type;			/* 1 BYTE, 2 WORD, 3 int, 4 long */
+	void *r_p;
+} rp_regs[] = {
+	{ "a", 1, &A }, { "f", 3, &F }, { "b", 1, &B }, { "c", 1, &C },
+	{ "d", 1, &D }, { "e", 1, &E }, { "h", 1, &H }, { "l", 1, &L },
+	{ "a_", 1, &A_ }, { "f_", 3, &F_ }, { "b_", 1, &B_ }, { "c_", 1, &C_ },
+	{ "d_", 1, &D_ }, { "e_", 1, &E_ }, { "h_", 1, &H_ }, { "l_", 1, &L_ },
+	{ "ix", 2, &IX }, { "iy", 2, &IY }, { "i", 1, &I }, { "r", 4, &R },
+	{ "iff", 1, &IFF },
+	{ NULL, 0, NULL }
+};
+
+/*
+ *	Fill the input buffer if it is empty
+ *
+ *	Output: 0 ok, 1 end of connection
+ */
+static int rp_fill(void)
+{
+	register int n;
+
+	if (rp_pos < rp_n)
+		return(0);
+	do
+		n = read(rp_fd, rp_buf, sizeof(rp_buf));
+	while (n == -1 && errno == EINTR);
+	if (n <= 0)
+		return(1);
+	rp_pos = 0;
+	rp_n = n;
+	return(0);
+}
+
+/*
+ *	Read a request line without the newline into s
+ *
+ *	Output: 0 ok, 1 end of connection, 2 line too long
+ */
+static int rp_line(char *s, int len)
+{
+	register int i = 0, big = 0;
+	register char c;
+
+	for (;;) {
+		if (rp_fill())
+			return(1);
+		if ((c = rp_buf[rp_pos++]) == '\n')
+			break;
+		if (i < len - 1)
+			s[i++] = c;
+		else
+			big = 1;
+	}
+	if (i && s[i - 1] == '\r')
+		i--;
+	s[i] = '\0';
+	return(big ? 2 : 0);
+}
+
+/*
+ *	Read n bytes of binary payload into p
+ *
+ *	Output: 0 ok, 1 end of connection
+ */
+static int rp_recv(BYTE *p, int n)
+{
+	register int i;
+
+	while (n > 0) {
+		if (rp_fill())
+			return(1);
+		if ((i = rp_n - rp_pos) > n)
+			i = n;
+		memcpy(p, rp_buf + rp_pos, i);
+		rp_pos += i;
+		p += i;
+		n -= i;
+	}
+	return(0);
+}
+
+static void rp_send(char *p, int n)
+{
+	register int i;
+
+	while (n > 0) {
+		if ((i = send(rp_fd, p, n, MSG_NOSIGNAL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += i;
+		n -= i;
+	}
+}
+
+/*
+ *	Find the value of key in the JSON text s
+ *
+ *	Output: pointer to the value, NULL if not found
+ */
+static char *js_find(char *s, char *key)
+{
+	register int n = strlen(key);
+
+	while ((s = strchr(s, '"')) != NULL) {
+		s++;
+		if (strncmp(s, key, n) == 0 && s[n] == '"') {
+			s += n + 1;
+			while (*s == ' ' || *s == '\t')
+				s++;
+			if (*s++ != ':')
+				continue;
+			while (*s == ' ' || *s == '\t')
+				s++;
+			return(s);
+		}
+	}
+	return(NULL);
+}
+
+/*
+ *	Get the number of key, as JSON number or string
+ *
+ *	Output: 1 found, 0 not found or no number
+ */
+static int js_num(char *s, char *key, long long *v)
+{
+	char *e;
+
+	if ((s = js_find(s, key)) == NULL)
+		return(0);
+	if (*s == '"')
+		s++;
+	*v = strtoll(s, &e, 0);
+	return(e != s);
+}
+
+/*
+ *	Get the string of key into buf
+ *
+ *	Output: 1 found, 0 not found or no string
+ */
+static int js_str(char *s, char *key, char *buf, int len)
+{
+	register int i = 0;
+
+	if ((s = js_find(s, key)) == NULL || *s++ != '"')
+		return(0);
+	while (*s && *s != '"') {
+		if (*s == '\\' && s[1])
+			s++;
+		if (i < len - 1)
+			buf[i++] = *s;
+		s++;
+	}
+	buf[i] = '\0';
+	return(*s == '"');
+}
+
+/*
+ *	Copy the raw id of the request into buf, "null" if there is none
+ */
+static void js_id(char *s, char *buf, int len)
+{
+	register int i = 0;
+
+	if ((s = js_find(s, "id")) != NULL) {
+		if (*s == '"')
+			do
+				buf[i++] = *s++;
+			while (i < len - 2 && *s && *s != '"');
+		while (i < len - 1 && *s && *s != ',' && *s != '}'
+		       && *s != ' ')
+			buf[i++] = *s++;
+	}
+	buf[i] = '\0';
+	if (i == 0)
+		strcpy(buf, "null");
+}
+
+/*
+ *	Result of the methods which run the CPU
+ */
+static int rp_state(char *res)
+{
+#ifdef WANT_TIM
+	sprintf(res, "\"pc\":%u,\"error\":%d,\"tstates\":%llu,\"steps\":%llu",
+		(unsigned int)(PC - ram), cpu_error, cpu_tstates, cpu_steps);
+#else
+	sprintf(res, "\"pc\":%u,\"error\":%d", (unsigned int)(PC - ram),
+		cpu_error);
+#endif
+	return(0);
+}
+
+static int rp_load(char *p, char *res)
+{
+	char fn[LENCMD];
+
+	if (!js_str(p, "file", fn, sizeof(fn)))
+		return(RPC_PARAMS);
+	if (load_file(fn)) {
+		rp_err = "can't load file";
+		return(RPC_FAIL);
+	}
+	return(0);
+}
+
+static int rp_getregs(char *p, char *res)
+{
+	register struct rpreg *r;
+	register int n;
+	unsigned int v = 0;
+
+	n = sprintf(res, "\"pc\":%u,\"sp\":%u", (unsigned int)(PC - ram),
+		    (unsigned int)(STACK - ram));
+	for (r = rp_regs; r->r_name != NULL; r++) {
+		switch (r->r_type) {
+		case 1:
+			v = *(BYTE *) r->r_p;
+			break;
+		case 2:
+			v = *(WORD *) r->r_p;
+			break;
+		case 3:
+			v = *(int *) r->r_p & 0xff;
+			break;
+		case 4:
+			v = *(long *) r->r_p & 0xff;
+			break;
+		}
+		n += sprintf(res + n, ",\"%s\":%u", r->r_name, v);
+	}
+#ifdef WANT_TIM
+	sprintf(res + n, ",\"tstates\":%llu,\"steps\":%llu", cpu_tstates,
+		cpu_steps);
+#endif
+	return(0);
+}
+
+static int rp_setregs(char *p, char *res)
+{
+	register struct rpreg *r;
+	long long v;
+
+	if (js_num(p, "pc", &v))
+		PC = ram + (v & 0xffff);
+	if (js_num(p, "sp", &v))
+		STACK = ram + (v & 0xffff);
+	for (r = rp_regs; r->r_name != NULL; r++) {
+		if (!js_num(p, r->r_name, &v))
+			continue;
+		switch (r->r_type) {
+		case 1:
+			*(BYTE *) r->r_p = v;
+			break;
+		case 2:
+			*(WORD *) r->r_p = v;
+			break;
+		case 3:
+			*(int *) r->r_p = v & 0xff;
+			break;
+		case 4:
+			*(long *) r->r_p = v & 0xff;
+			break;
+		}
+	}
+	return(rp_getregs(p, res));
+}
+
+/*
+ *	Get addr and len of a memory range
+ *
+ *	Output: 0 ok, 1 not in memory
+ */
+static int rp_range(char *p, long long *adr, long long *len)
+{
+	if (!js_num(p, "addr", adr) || !js_num(p, "len", len))
+		return(1);
+	return(*adr < 0 || *len < 0 || *adr + *len > 65536);
+}
+
+static int rp_read(char *p, char *res)
+{
+	long long adr, len;
+
+	if (rp_range(p, &adr, &len))
+		return(RPC_PARAMS);
+	memcpy(rp_mem, ram + adr, len);
+	rp_len = len;
+	sprintf(res, "\"addr\":%lld,\"len\":%lld", adr, len);
+	return(0);
+}
+
+static int rp_write(char *p, char *res)
+{
+	long long adr, len;
+
+	if (!js_num(p, "len", &len) || len < 0 || len > 65536)
+		return(RPC_PARAMS);
+	if (rp_recv(rp_mem, len))
+		return(RPC_PARAMS);
+	if (rp_range(p, &adr, &len))
+		return(RPC_PARAMS);
+	memcpy(ram + adr, rp_mem, len);
+#ifdef SNSIZE
+	snap_dirty();
+#endif
+	return(0);
+}
+
+static int rp_step(char *p, char *res)
+{
+	long long n;
+
+	if (!js_num(p, "count", &n))
+		n = 1;
+	while (n-- > 0)
+		if (mon_step() != NONE)
+			break;
+	return(rp_state(res));
+}
+
+static int rp_run(char *p, char *res)
+{
+	char s[LENCMD];
+	long long n;
+
+	if (js_num(p, "tstates", &n)) {
+#ifdef WANT_TIM
+		if (n < 0)
+			return(RPC_PARAMS);
+		sprintf(s, "@%llu", cpu_tstates + n);
+		if (run_until(s) == EX_USAGE) {
+			rp_err = "can't run to the T-states";
+			return(RPC_FAIL);
+		}
+#else
+		rp_err = "no T-state counting, recompile with WANT_TIM";
+		return(RPC_FAIL);
+#endif
+	} else if (js_str(p, "until", s, sizeof(s))) {
+		if (run_until(s) == EX_USAGE)
+			return(RPC_PARAMS);
+	} else
+		mon_go();
+	return(rp_state(res));
+}
+
+static int rp_break(char *p, char *res)
+{
+	long long adr, pass;
+	register int i;
+
+	if (!js_num(p, "addr", &adr))
+		return(RPC_PARAMS);
+	if (!js_num(p, "pass", &pass))
+		pass = 1;
+	if ((i = mon_break(adr, pass)) == -1) {
+		rp_err = "no free breakpoint";
+		return(RPC_FAIL);
+	}
+	sprintf(res, "\"index\":%d", i);
+	return(0);
+}
+
+static int rp_clear(char *p, char *res)
+{
+	long long adr;
+
+	if (!js_num(p, "addr", &adr))
+		return(RPC_PARAMS);
+	if (mon_clear(adr)) {
+		rp_err = "no breakpoint at addr";
+		return(RPC_FAIL);
+	}
+	return(0);
+}
+
+static int rp_dart(char *p, char *res)
+{
+	long long chan, len;
+
+	if (!js_num(p, "chan", &chan) || !js_num(p, "len", &len)
+	    || len < 0 || len > 65536)
+		return(RPC_PARAMS);
+	if (rp_recv(rp_mem, len))
+		return(RPC_PARAMS);
+	sprintf(res, "\"queued\":%d", dart_inject(chan, rp_mem, len));
+	return(0);
+}
+
+static int rp_save(char *p, char *res)
+{
+	char fn[LENCMD];
+
+	if (!js_str(p, "file", fn, sizeof(fn)))
+		return(RPC_PARAMS);
+	if (core_save(fn)) {
+		rp_err = "can't save core";
+		return(RPC_FAIL);
+	}
+	return(0);
+}
+
+static int rp_restore(char *p, char *res)
+{
+	char fn[LENCMD];
+
+	if (!js_str(p, "file", fn, sizeof(fn)))
+		return(RPC_PARAMS);
+	if (core_load(fn)) {
+		rp_err = "can't restore core";
+		return(RPC_FAIL);
+	}
+	return(rp_state(res));
+}
+
+static int rp_end(char *p, char *res)
+{
+	rp_quit = 1;
+	return(0);
+}
+
+static struct rpmeth {
+	char *m_name;
+	int (*m_fn)(char *, char *);
+} rp_meth[] = {
+	{ "load", rp_load },
+	{ "regs", rp_getregs },
+	{ "set_regs", rp_setregs },
+	{ "read", rp_read },
+	{ "write", rp_write },
+	{ "step", rp_step },
+	{ "run", rp_run },
+	{ "break", rp_break },
+	{ "clear", rp_clear },
+	{ "dart", rp_dart },
+	{ "save", rp_save },
+	{ "restore", rp_restore },
+	{ "quit", rp_end },
+	{ NULL, NULL }
+};
+
+/*
+ *	Execute one request and send the answer
+ */
+static void rp_request(char *s, int big)
+{
+	static char out[RPC_LINE + 128];
+	char res[RPC_LINE], id[64], m[32], *p;
+	register struct rpmeth *mp;
+	register int err, n;
+
+	js_id(s, id, sizeof(id));
+	res[0] = '\0';
+	rp_err = NULL;
+	rp_len = 0;
+	if (big || *s != '{' || !js_str(s, "method", m, sizeof(m)))
+		err = RPC_PARSE;
+	else {
+		if ((p = js_find(s, "params")) == NULL)
+			p = "";
+		for (mp = rp_meth; mp->m_name != NULL; mp++)
+			if (strcmp(mp->m_name, m) == 0)
+				break;
+		err = mp->m_name ? (*mp->m_fn)(p, res) : RPC_METHOD;
+	}
+	if (err) {
+		if (rp_err == NULL)
+			rp_err = err == RPC_PARSE ? "parse error" :
+				 err == RPC_METHOD ? "method not found" :
+				 "invalid params";
+		n = sprintf(out, "{\"id\":%s,\"error\":{\"code\":%d,\"message\":\"%s\"}}\n",
+			    id, err, rp_err);
+		rp_len = 0;
+	} else
+		n = sprintf(out, "{\"id\":%s,\"result\":{%s}}\n", id, res);
+	rp_send(out, n);
+	if (rp_len)
+		rp_send((char *) rp_mem, rp_len);
+}
+
+/*
+ *	Serve JSON-RPC requests on the Unix domain socket path,
+ *	until a client sends quit
+ *
+ *	Output: 0 ok, 1 error
+ */
+int rpc_serve(char *path)
+{
+	struct sockaddr_un sa;
+	static char line[RPC_LINE];
+	register int s, i;
+
+	if (strlen(path) >= sizeof(sa.sun_path)) {
+		printf("socket name %s too long\n", path);
+		return(1);
+	}
+	tc_flag = 1;			/* run {tstates} needs T-states */
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		perror("socket");
+		return(1);
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	unlink(path);
+	if (bind(s, (struct sockaddr *) &sa, sizeof(sa)) == -1
+	    || listen(s, 1) == -1) {
+		perror(path);
+		close(s);
+		return(1);
+	}
+	printf("JSON-RPC on %s\n", path);
+	fflush(stdout);
+	rp_quit = 0;
+	while (!rp_quit) {
+		if ((rp_fd = accept(s, NULL, NULL)) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			break;
+		}
+		rp_pos = rp_n = 0;
+		while (!rp_quit && (i = rp_line(line, sizeof(line))) != 1)
+			rp_request(line, i == 2);
+		close(rp_fd);
+	}
+	close(s);
+	unlink(path);
+	return(0);
+}
@@ -0,0 +1,648 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module contains the snapshots for reverse execution.
+ *
+ *	While the CPU runs, a snapshot of CPU, memory and I/O devices
+ *	is taken every sn_int T-states. The memory is stored in pages
+ *	of 256 bytes, pages which did not change since the snapshot
+ *	before are shared and not copied. The only input which is not
+ *	deterministic, bytes received by the DART sockets, is written
+ *	into a log. To go back in time, the newest snapshot before the
+ *	wanted point is restored and the CPU runs to that point again,
+ *	with DART input taken from the log and DART output suppressed.
+ *
+ *	Snapshots are off until they are switched on with S, while
+ *	they are on the debug variant of the CPU emulation runs.
+ *
+ *	If all SNSIZE snapshots are used, one in the middle is dropped,
+ *	so that the distance between snapshots grows with their age.
+ *	If registers, memory or I/O are modified from the monitor, a
+ *	new timeline starts, snapshots and log after this point are
+ *	dropped.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "global.h"
+
+#ifdef SNSIZE
+
+#ifndef WANT_TIM
+#error "SNSIZE needs WANT_TIM"
+#endif
+
+#define SN_DEFINT	10000000L	/* default T-states between snapshots */
+#define SN_PAGES	256		/* no. of memory pages */
+#define SN_NEVER	(~0ULL)		/* no stop */
+
+extern void cpu(void);
+extern size_t io_size(void);
+extern void io_save(void *), io_restore(void *);
+
+struct snpage {				/* shared memory page */
+	int p_ref;
+	BYTE p_data[256];
+};
+
+struct snapshot {
+	unsigned long long s_steps;	/* no. of executed instructions */
+	unsigned long long s_tstates;	/* no. of executed T-states */
+	BYTE s_a, s_b, s_c, s_d, s_e, s_h, s_l;
+	BYTE s_a_, s_b_, s_c_, s_d_, s_e_, s_h_, s_l_;
+	int s_f, s_f_;
+	WORD s_ix, s_iy, s_pc, s_sp;
+	BYTE s_i, s_iff;
+	long s_r;
+	int s_int_mode, s_int_type, s_int_lsb;
+	int s_halt;			/* CPU in HALT, cpu_halt */
+	void *s_io;			/* state of the I/O devices */
+	struct snpage *s_page[SN_PAGES];
+};
+
+struct snin {				/* DART input log */
+	unsigned long long l_steps;
+	int l_chan;
+	int l_len;
+	BYTE *l_data;
+};
+
+static struct snapshot sn[SNSIZE];	/* snapshots, oldest first */
+static int sn_n;			/* no. of snapshots */
+static long sn_int;			/* T-states between snapshots, 0 off */
+static unsigned long long sn_tsnap = SN_NEVER;	/* T-states of next snapshot */
+static unsigned long long sn_tstop = SN_NEVER;	/* stop at T-states */
+static unsigned long long sn_live;	/* instructions of the timeline */
+static unsigned long long sn_hit;	/* last breakpoint hit in sn_run() */
+static unsigned long long sn_hlim;	/* hits before this are counted */
+static int sn_dirty = 1;		/* state modified from the monitor */
+static struct snin *sn_log;		/* DART input log */
+static long sn_nlog, sn_maxlog;
+static long sn_lpos;			/* next log entry for replay */
+static BYTE sn_wpage[SN_PAGES];		/* pages written since last snapshot */
+static unsigned long sn_nwr, sn_ncmp;	/* pages taken written/compared */
+
+/*
+ *	Recalculate the T-states of the next event for the CPU loop
+ */
+static void sn_setev(void)
+{
+	sn_tev = (sn_tsnap < sn_tstop) ? sn_tsnap : sn_tstop;
+}
+
+/*
+ *	Release the pages of a snapshot
+ */
+static void sn_free(struct snapshot *s)
+{
+	register int i;
+
+	for (i = 0; i < SN_PAGES; i++)
+		if (--s->s_page[i]->p_ref == 0)
+			free(s->s_page[i]);
+	free(s->s_io);
+}
+
+/*
+ *	Drop snapshot i
+ */
+static void sn_drop(int i)
+{
+	sn_free(&sn[i]);
+	memmove(&sn[i], &sn[i + 1], (sn_n - i - 1) * sizeof(struct snapshot));
+	sn_n--;
+}
+
+/*
+ *	Make room for a new snapshot, the oldest one is kept,
+ *	from the others the one is dropped, which leaves the
+ *	smallest gap relative to its age
+ */
+static void sn_thin(void)
+{
+	register int i, best = 1;
+	double cost, min = -1.0;
+
+	for (i = 1; i < sn_n - 1; i++) {
+		cost = (double) (sn[i + 1].s_tstates - sn[i - 1].s_tstates) /
+		       (double) (cpu_tstates - sn[i].s_tstates + 1);
+		if (min < 0.0 || cost < min) {
+			min = cost;
+			best = i;
+		}
+	}
+	sn_drop(best);
+}
+
+/*
+ *	Copy memory page p into buf, with the original
+ *	op-codes at the addresses of software breakpoints
+ */
+static void sn_getpage(int p, BYTE *buf)
+{
+	memcpy(buf, ram + (p << 8), 256);
+#ifdef SBSIZE
+	{
+		register int i;
+
+		for (i = 0; i < SBSIZE; i++)
+			if (soft[i].sb_pass && (soft[i].sb_adr >> 8) == p)
+				buf[soft[i].sb_adr & 0xff] = soft[i].sb_oldopc;
+	}
+#endif
+}
+
+/*
+ *	Mark all pages as written, after the memory was changed
+ *	in other ways than by the CPU emulation
+ */
+static void sn_wrall(void)
+{
+	memset(sn_wpage, 1, sizeof(sn_wpage));
+}
+
+/*
+ *	Called from the CPU emulation before an instruction writes
+ *	len bytes of memory from address adr, and for interrupts
+ */
+void snap_wr(WORD adr, long len)
+{
+	register int p = adr >> 8;
+	register long n = ((adr & 0xff) + len + 255) >> 8;
+
+	if (n >= SN_PAGES) {
+		sn_wrall();
+		return;
+	}
+	while (n--) {
+		sn_wpage[p] = 1;
+		p = (p + 1) & (SN_PAGES - 1);
+	}
+}
+
+/*
+ *	Take a snapshot of the current state, pages not written
+ *	since the last snapshot are shared with it
+ */
+static void sn_take(void)
+{
+	register struct snapshot *s, *prev;
+	register int i;
+	BYTE buf[256];
+
+	if (sn_n && sn[sn_n - 1].s_steps >= cpu_steps)
+		return;			/* replay, already there */
+	if (sn_n == SNSIZE)
+		sn_thin();
+	prev = sn_n ? &sn[sn_n - 1] : NULL;
+	s = &sn[sn_n];
+	if ((s->s_io = malloc(io_size())) == NULL)
+		return;
+	for (i = 0; i < SN_PAGES; i++) {
+		if (prev && !sn_wpage[i]) {
+			s->s_page[i] = prev->s_page[i];
+			s->s_page[i]->p_ref++;
+			continue;
+		}
+		sn_ncmp++;
+		sn_getpage(i, buf);
+		if (prev && memcmp(prev->s_page[i]->p_data, buf, 256) == 0) {
+			s->s_page[i] = prev->s_page[i];
+		} else {
+			sn_nwr++;
+			if ((s->s_page[i] = malloc(sizeof(struct snpage))) == NULL) {
+				while (i--)
+					if (--s->s_page[i]->p_ref == 0)
+						free(s->s_page[i]);
+				free(s->s_io);
+				puts("not enough memory for snapshot");
+				return;
+			}
+			s->s_page[i]->p_ref = 0;
+			memcpy(s->s_page[i]->p_data, buf, 256);
+		}
+		s->s_page[i]->p_ref++;
+	}
+	memset(sn_wpage, 0, sizeof(sn_wpage));
+	io_save(s->s_io);
+	s->s_steps = cpu_steps;
+	s->s_tstates = cpu_tstates;
+	s->s_a = A; s->s_b = B; s->s_c = C; s->s_d = D;
+	s->s_e = E; s->s_h = H; s->s_l = L; s->s_f = F;
+	s->s_a_ = A_; s->s_b_ = B_; s->s_c_ = C_; s->s_d_ = D_;
+	s->s_e_ = E_; s->s_h_ = H_; s->s_l_ = L_; s->s_f_ = F_;
+	s->s_ix = IX;
+	s->s_iy = IY;
+	s->s_pc = PC - ram;
+	s->s_sp = STACK - ram;
+	s->s_i = I;
+	s->s_iff = IFF;
+	s->s_r = R;
+	s->s_int_mode = int_mode;
+	s->s_int_type = int_type;
+	s->s_int_lsb = int_lsb;
+	s->s_halt = cpu_halt;
+	sn_n++;
+}
+
+/*
+ *	Restore snapshot i
+ */
+static void sn_restore(int i)
+{
+	register struct snapshot *s = &sn[i];
+	register int p;
+
+	if (cpu_steps > sn_live)
+		sn_live = cpu_steps;
+	for (p = 0; p < SN_PAGES; p++)
+		memcpy(ram + (p << 8), s->s_page[p]->p_data, 256);
+	sn_wrall();
+#ifdef SBSIZE
+	for (p = 0; p < SBSIZE; p++)	/* set breakpoints again */
+		if (soft[p].sb_pass) {
+			soft[p].sb_oldopc = ram[soft[p].sb_adr];
+			ram[soft[p].sb_adr] = 0x76;
+		}
+#endif
+	io_restore(s->s_io);
+	A = s->s_a; B = s->s_b; C = s->s_c; D = s->s_d;
+	E = s->s_e; H = s->s_h; L = s->s_l; F = s->s_f;
+	A_ = s->s_a_; B_ = s->s_b_; C_ = s->s_c_; D_ = s->s_d_;
+	E_ = s->s_e_; H_ = s->s_h_; L_ = s->s_l_; F_ = s->s_f_;
+	IX = s->s_ix;
+	IY = s->s_iy;
+	PC = ram + s->s_pc;
+	STACK = ram + s->s_sp;
+	I = s->s_i;
+	IFF = s->s_iff;
+	R = s->s_r;
+	int_mode = s->s_int_mode;
+	int_type = s->s_int_type;
+	int_lsb = s->s_int_lsb;
+	cpu_halt = s->s_halt;
+	cpu_steps = s->s_steps;
+	cpu_tstates = s->s_tstates;
+	for (sn_lpos = 0; sn_lpos < sn_nlog; sn_lpos++)
+		if (sn_log[sn_lpos].l_steps >= cpu_steps)
+			break;
+	sn_tsnap = sn_int ? cpu_tstates + sn_int : SN_NEVER;
+	sn_setev();
+}
+
+/*
+ *	Find the newest snapshot at or before instruction steps,
+ *	or if steps is SN_NEVER, at or before T-states ts
+ *
+ *	Output: index of the snapshot, -1 if none
+ */
+static int sn_find(unsigned long long steps, unsigned long long ts)
+{
+	register int i;
+
+	for (i = sn_n - 1; i >= 0; i--)
+		if ((steps != SN_NEVER) ? sn[i].s_steps <= steps
+					: sn[i].s_tstates <= ts)
+			break;
+	return(i);
+}
+
+/*
+ *	Run the CPU until instruction steps or T-states ts is reached,
+ *	software breakpoints are passed, the last one hit before
+ *	sn_hlim is remembered in sn_hit.
+ *
+ *	Output: 0 ok, 1 stopped because of an error
+ */
+static int sn_run(unsigned long long steps, unsigned long long ts)
+{
+	register int i;
+	int f = f_flag;
+
+	f_flag = 0;			/* run at full speed */
+	while (cpu_steps < steps && cpu_tstates < ts) {
+		sn_stop = steps;
+		sn_tstop = ts;
+		sn_setev();
+		cpu_state = CONTIN_RUN;
+		cpu_error = NONE;
+		cpu();
+		if (cpu_error == OPHALT) {
+#ifdef SBSIZE
+			for (i = 0; i < SBSIZE; i++)
+				if (soft[i].sb_pass &&
+				    soft[i].sb_adr == PC - ram - 1)
+					break;
+			if (i < SBSIZE) {	/* execute original op-code */
+#ifdef HISIZE
+				hist_undo();
+#endif
+#ifdef WANT_TRACE
+				trace_undo();
+#endif
+				cpu_steps--;
+				if (cpu_steps + 1 < sn_hlim)
+					sn_hit = cpu_steps;
+				PC--;
+				*PC = soft[i].sb_oldopc;
+				cpu_state = SINGLE_STEP;
+				cpu_error = NONE;
+				cpu();
+				ram[soft[i].sb_adr] = 0x76;
+				if (cpu_error == NONE || cpu_error == OPHALT)
+					continue;
+				break;
+			}
+#endif
+			continue;	/* HALT, run again like the user did */
+		}
+		if (cpu_error != NONE)
+			break;
+	}
+	sn_stop = SN_NEVER;
+	sn_tstop = SN_NEVER;
+	sn_setev();
+	f_flag = f;
+	return(cpu_error != NONE && cpu_error != OPHALT);
+}
+
+/*
+ *	Called from the CPU emulation when cpu_steps reached sn_stop
+ *	or cpu_tstates reached sn_tev
+ */
+void snap_event(void)
+{
+	if (cpu_error == OPHALT)	/* maybe a breakpoint, try later */
+		return;
+	if (cpu_steps >= sn_stop || cpu_tstates >= sn_tstop) {
+		cpu_state = STOPPED;
+		sn_stop = SN_NEVER;
+		sn_tstop = SN_NEVER;
+	}
+	if (cpu_tstates >= sn_tsnap) {
+		sn_take();
+		sn_tsnap = cpu_tstates + sn_int;
+	}
+	sn_setev();
+}
+
+/*
+ *	Called from the CPU emulation before it starts, if the state
+ *	was modified from the monitor. A new timeline starts here.
+ */
+void snap_sync(void)
+{
+	sn_dirty = 0;
+	sn_wflag = (sn_int != 0);
+	sn_wrall();
+	if (sn_int == 0)
+		return;
+	while (sn_n && sn[sn_n - 1].s_steps >= cpu_steps)
+		sn_drop(sn_n - 1);
+	while (sn_nlog && sn_log[sn_nlog - 1].l_steps >= cpu_steps)
+		free(sn_log[--sn_nlog].l_data);
+	sn_lpos = sn_nlog;
+	sn_live = cpu_steps;
+	sn_take();
+	sn_tsnap = cpu_tstates + sn_int;
+	sn_setev();
+}
+
+/*
+ *	The state of the CPU, memory or I/O was modified
+ *	from the monitor
+ */
+void snap_dirty(void)
+{
+	sn_dirty = 1;
+}
+
+/*
+ *	Check if the state is to be synchronized, called
+ *	at start of the CPU emulation
+ */
+int snap_isdirty(void)
+{
+	return(sn_dirty);
+}
+
+/*
+ *	Check if the CPU executes instructions again, which
+ *	were executed before
+ */
+int snap_replay(void)
+{
+	return(cpu_steps < sn_live);
+}
+
+/*
+ *	Log n bytes received by DART channel chan
+ */
+void snap_putin(int chan, BYTE *buf, int n)
+{
+	register struct snin *l;
+
+	if (n <= 0 || sn_int == 0)
+		return;
+	if (sn_nlog == sn_maxlog) {
+		sn_maxlog = sn_maxlog ? sn_maxlog * 2 : 256;
+		if ((l = realloc(sn_log, sn_maxlog * sizeof(struct snin))) == NULL) {
+			sn_maxlog = sn_nlog;
+			return;
+		}
+		sn_log = l;
+	}
+	l = &sn_log[sn_nlog];
+	if ((l->l_data = malloc(n)) == NULL)
+		return;
+	memcpy(l->l_data, buf, n);
+	l->l_steps = cpu_steps;
+	l->l_chan = chan;
+	l->l_len = n;
+	sn_lpos = ++sn_nlog;
+}
+
+/*
+ *	Get the bytes received by DART channel chan from the log,
+ *	while instructions are executed again
+ *
+ *	Output: no. of bytes, -1 if nothing was received
+ */
+int snap_getin(int chan, BYTE *buf)
+{
+	register struct snin *l;
+
+	if (sn_lpos >= sn_nlog)
+		return(-1);
+	l = &sn_log[sn_lpos];
+	if (l->l_steps != cpu_steps || l->l_chan != chan)
+		return(-1);
+	memcpy(buf, l->l_data, l->l_len);
+	sn_lpos++;
+	return(l->l_len);
+}
+
+/*
+ *	Go to instruction steps, or if steps is SN_NEVER, to T-states ts
+ *
+ *	Output: 0 ok, 1 error
+ */
+static int sn_goto(unsigned long long steps, unsigned long long ts)
+{
+	register int i;
+
+	if (sn_dirty)
+		snap_sync();
+	if ((steps != SN_NEVER) ? steps < cpu_steps : ts < cpu_tstates) {
+		if ((i = sn_find(steps, ts)) == -1) {
+			puts("no snapshot old enough");
+			return(1);
+		}
+		sn_restore(i);
+	}
+	sn_hlim = 0;
+	return(sn_run(steps, (steps != SN_NEVER) ? SN_NEVER : ts));
+}
+
+/*
+ *	Go back count instructions
+ *
+ *	Output: 0 ok, 1 error
+ */
+int snap_rstep(unsigned long long count)
+{
+	if (sn_int == 0) {
+		puts("snapshots are off, switch them on with S on");
+		return(1);
+	}
+	if (count > cpu_steps)
+		count = cpu_steps;
+	return(sn_goto(cpu_steps - count, SN_NEVER));
+}
+
+/*
+ *	Go to T-states ts, back or forward
+ *
+ *	Output: 0 ok, 1 error
+ */
+int snap_tgoto(unsigned long long ts)
+{
+	return(sn_goto(SN_NEVER, ts));
+}
+
+/*
+ *	Go back to the last software breakpoint reached,
+ *	the state after the execution of the original op-code
+ *	like a breakpoint stop
+ *
+ *	Output: 0 ok, 1 no breakpoint found or error
+ */
+int snap_rcont(void)
+{
+	register int i;
+	unsigned long long now, end;
+
+	if (sn_int == 0) {
+		puts("snapshots are off, switch them on with S on");
+		return(1);
+	}
+	if (sn_dirty)
+		snap_sync();
+	now = cpu_steps;
+	for (i = sn_find(now ? now - 1 : 0, 0); i >= 0; i--) {
+		end = (i + 1 < sn_n && sn[i + 1].s_steps < now) ?
+		      sn[i + 1].s_steps : now;
+		sn_restore(i);
+		sn_hit = SN_NEVER;
+		sn_hlim = now;
+		if (sn_run(end, SN_NEVER))
+			return(1);
+		if (sn_hit != SN_NEVER) {
+			end = sn_hit + 1;
+			sn_restore(i);
+			sn_hlim = 0;
+			return(sn_run(end, SN_NEVER));
+		}
+	}
+	puts("no breakpoint reached before");
+	sn_goto(now, SN_NEVER);
+	return(1);
+}
+
+/*
+ *	Set T-states between snapshots, 0 switches snapshots off,
+ *	-1 sets the default
+ */
+void snap_setint(long n)
+{
+	if (n < 0)
+		n = SN_DEFINT;
+	snap_clear();
+	sn_int = n;
+	sn_wflag = (n != 0);
+	sn_tsnap = SN_NEVER;
+	sn_setev();
+}
+
+/*
+ *	Check if snapshots are on
+ */
+int snap_on(void)
+{
+	return(sn_int != 0);
+}
+
+/*
+ *	Drop all snapshots and the input log
+ */
+void snap_clear(void)
+{
+	while (sn_n)
+		sn_drop(sn_n - 1);
+	while (sn_nlog)
+		free(sn_log[--sn_nlog].l_data);
+	sn_lpos = 0;
+	sn_live = 0;
+	sn_dirty = 1;
+	sn_nwr = sn_ncmp = 0;
+	sn_wrall();
+}
+
+/*
+ *	Show state of the snapshots
+ */
+void snap_stat(void)
+{
+	register int i, p;
+	long pages = 0;
+
+	printf("Instructions: %llu  T-states: %llu\n", cpu_steps, cpu_tstates);
+	if (sn_int == 0) {
+		puts("Snapshots off");
+		return;
+	}
+	for (i = 0; i < sn_n; i++)
+		for (p = 0; p < SN_PAGES; p++)
+			if (i == 0 || sn[i].s_page[p] != sn[i - 1].s_page[p])
+				pages++;
+	printf("Snapshots every %ld T-states, %d of %d used, %ld KB\n",
+	       sn_int, sn_n, SNSIZE, pages / 4);
+	printf("Pages compared %lu, stored %lu, unwritten pages not compared\n",
+	       sn_ncmp, sn_nwr);
+	if (sn_n)
+		printf("Oldest at T-states %llu, newest at %llu\n",
+		       sn[0].s_tstates, sn[sn_n - 1].s_tstates);
+	if (snap_replay())
+		printf("Replaying, timeline ends at instruction %llu\n",
+		       sn_live);
+}
+
+#endif
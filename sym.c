@@ -0,0 +1,228 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module contains the symbol table. Symbols are loaded
+ *	from the symbol and map files of the usual assemblers, as
+ *
+ *		name EQU value			sjasmplus --sym/--exp
+ *		name: equ value
+ *		name = value
+ *		DEF name value			SDCC .noi
+ *		value name module		SDCC .map
+ *		name value name value ...	z80asm symbol table
+ *		value name
+ *
+ *	Values are hexadecimal, written as 1234, 1234h, $1234 or
+ *	0x1234, only the low 16 bits are used, so banked SDCC
+ *	addresses map into the 64K of the CPU. Everything after a ;
+ *	is a comment, lines which are not symbols are skipped.
+ *	The table is sorted by address, so that the symbol for an
+ *	address is found with a binary search, without allocating
+ *	memory, because it is used for every line of a trace.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+#include "global.h"
+
+struct sym {
+	WORD s_adr;
+	char *s_name;
+};
+
+static struct sym *sym_tab;		/* symbols sorted by address */
+static int sym_n, sym_max;
+
+/*
+ *	Convert a hexadecimal number in one of the forms
+ *	1234, 1234h, $1234 and 0x1234
+ *
+ *	Output: 0 ok, 1 not a number
+ */
+static int sym_num(char *s, WORD *v)
+{
+	char *p;
+	unsigned long n;
+
+	if (*s == '$')
+		s++;
+	else if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		s += 2;
+	else if (!isdigit((int)*s))
+		return(1);
+	n = strtoul(s, &p, 16);
+	if (p == s || (*p != '\0' && ((*p != 'h' && *p != 'H') || p[1])))
+		return(1);
+	*v = n;
+	return(0);
+}
+
+/*
+ *	Add a symbol to the table
+ */
+static int sym_add(char *name, WORD adr)
+{
+	register struct sym *t;
+
+	if (sym_n == sym_max) {
+		sym_max = sym_max ? sym_max * 2 : 256;
+		if ((t = realloc(sym_tab, sym_max * sizeof(struct sym))) == NULL)
+			return(1);
+		sym_tab = t;
+	}
+	if ((sym_tab[sym_n].s_name = strdup(name)) == NULL)
+		return(1);
+	sym_tab[sym_n++].s_adr = adr;
+	return(0);
+}
+
+/*
+ *	Check if s can be the name of a symbol
+ */
+static int sym_isname(char *s)
+{
+	return(isalpha((int)*s) || *s == '_' || *s == '.' || *s == '?' ||
+	       *s == '@');
+}
+
+static int sym_cmp(const void *a, const void *b)
+{
+	return(((struct sym *) a)->s_adr - ((struct sym *) b)->s_adr);
+}
+
+/*
+ *	Remove all symbols
+ */
+void sym_clear(void)
+{
+	while (sym_n)
+		free(sym_tab[--sym_n].s_name);
+}
+
+/*
+ *	Load symbols from file fn, added to the symbols
+ *	already loaded
+ *
+ *	Output: no. of symbols loaded, -1 on error
+ */
+int sym_load(char *fn)
+{
+	FILE *fp;
+	char line[LENCMD * 2], *tok[16], *p;
+	register int n, i;
+	WORD v;
+	int cnt = 0;
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return(-1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if ((p = strchr(line, ';')) != NULL)
+			*p = '\0';
+		n = 0;
+		for (p = strtok(line, " \t\r\n:="); p != NULL && n < 16;
+		     p = strtok(NULL, " \t\r\n:="))
+			tok[n++] = p;
+		i = 0;
+		if (n == 3 && strcmp(tok[0], "DEF") == 0)
+			i = 1;
+		else if (n == 3 && strcasecmp(tok[1], "equ") == 0) {
+			tok[1] = tok[2];
+			n = 2;
+		}
+		/* pairs of name and value in any order */
+		for (; i + 1 < n; i += 2) {
+			if (sym_isname(tok[i]) && sym_num(tok[i + 1], &v) == 0)
+				p = tok[i];
+			else if (sym_isname(tok[i + 1]) &&
+				 sym_num(tok[i], &v) == 0)
+				p = tok[i + 1];
+			else
+				break;
+			if (sym_add(p, v)) {
+				puts("not enough memory for symbols");
+				goto out;
+			}
+			cnt++;
+		}
+	}
+out:
+	fclose(fp);
+	qsort(sym_tab, sym_n, sizeof(struct sym), sym_cmp);
+	return(cnt);
+}
+
+/*
+ *	No. of symbols loaded
+ */
+int sym_count(void)
+{
+	return(sym_n);
+}
+
+/*
+ *	Symbol no. i in the order of the addresses, for
+ *	walking through the table
+ *
+ *	Output: name of the symbol, NULL if i is out of range
+ */
+char *sym_get(int i, WORD *adr)
+{
+	if (i < 0 || i >= sym_n)
+		return(NULL);
+	*adr = sym_tab[i].s_adr;
+	return(sym_tab[i].s_name);
+}
+
+/*
+ *	Find the symbol at or before address adr,
+ *	the distance is returned in off
+ *
+ *	Output: name of the symbol, NULL if none
+ */
+char *sym_lookup(WORD adr, int *off)
+{
+	register int lo = 0, hi = sym_n - 1, m;
+
+	if (sym_n == 0 || sym_tab[0].s_adr > adr)
+		return(NULL);
+	while (lo < hi) {		/* last entry with s_adr <= adr */
+		m = (lo + hi + 1) / 2;
+		if (sym_tab[m].s_adr <= adr)
+			lo = m;
+		else
+			hi = m - 1;
+	}
+	*off = adr - sym_tab[lo].s_adr;
+	return(sym_tab[lo].s_name);
+}
+
+/*
+ *	Format address adr as name or name+offset into buf of
+ *	size len, offsets larger than max are not shown as symbol
+ *
+ *	Output: buf, empty if there is no symbol
+ */
+char *sym_str(WORD adr, int max, char *buf, int len)
+{
+	register char *s;
+	int off;
+
+	if ((s = sym_lookup(adr, &off)) == NULL || off > max)
+		*buf = '\0';
+	else if (off)
+		snprintf(buf, len, "%s+%x", s, off);
+	else
+		snprintf(buf, len, "%s", s);
+	return(buf);
+}
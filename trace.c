@@ -0,0 +1,734 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module writes a trace of all executed instructions
+ *	into a file, and prints trace files as text for offline
+ *	comparison.
+ *
+ *	The CPU emulation fills one of two buffers with records,
+ *	a full buffer is handed to a background thread, which
+ *	optionally compresses it and writes it as one block into
+ *	the file, while the other buffer is filled.
+ *
+ *	File layout, all numbers little endian:
+ *
+ *	header	"Z80TRACE", version (2), flags (2), reserved (4)
+ *	blocks	raw length (4), stored length (4), no. of the first
+ *		instruction (8), T-states before the first
+ *		instruction (8), data; if stored length is
+ *		different from raw length the data is compressed
+ *	index	one entry for each block: file offset (8), first
+ *		instruction (8), T-states (8), raw length (4),
+ *		stored length (4)
+ *	footer	offset of the index (8), no. of entries (8),
+ *		"Z80TIDX\0"
+ *
+ *	Records in a block, the first byte is the type:
+ *
+ *	TR_INSN	PC (2), length (1), op-code bytes
+ *	TR_IN	port (1), data (1)
+ *	TR_OUT	port (1), data (1)
+ *	TR_REGS	T-states (v), mask (v), registers flagged in
+ *		mask (2 each): AF BC DE HL IX IY SP AF' BC' DE' HL'
+ *		and I/IFF, all in the first record of a block
+ *	TR_MEMW	address (2), length (v), bytes written
+ *	TR_INT	PC before (2), PC after (2) the interrupt
+ *
+ *	(v) is a variable length number, 7 bits per byte, low
+ *	bits first, bit 7 set if more bytes follow. TR_IN, TR_OUT,
+ *	TR_REGS and TR_MEMW belong to the TR_INSN before them.
+ *
+ *	Compressed blocks use the LZ4 block format.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "config.h"
+#include "global.h"
+
+#ifdef WANT_TRACE
+
+#define TR_BLKSIZE	(256 * 1024)	/* records in a block */
+#define TR_SLACK	(96 * 1024)	/* room for the largest instruction */
+#define TR_BUFSIZE	(TR_BLKSIZE + TR_SLACK)
+#define TR_ZSIZE	(TR_BUFSIZE + TR_BUFSIZE / 255 + 16)
+#define TR_NREG		12		/* no. of registers in TR_REGS */
+#define TR_VERSION	1
+#define TR_FZ		1		/* flag for compressed blocks */
+
+#define TR_INSN		1		/* record types */
+#define TR_IN		2
+#define TR_OUT		3
+#define TR_REGS		4
+#define TR_MEMW		5
+#define TR_INT		6
+
+#define LZ_HBITS	14		/* size of compressor hash table */
+
+extern int opsize(unsigned char *, int);
+extern int mem_wrspan(WORD *, long *);
+
+struct tridx {				/* index entry for a block */
+	unsigned long long ti_off;
+	unsigned long long ti_insn;
+	unsigned long long ti_ts;
+	unsigned long ti_raw;
+	unsigned long ti_stored;
+};
+
+static char *tr_regnam[TR_NREG] = {
+	"AF", "BC", "DE", "HL", "IX", "IY", "SP",
+	"AF'", "BC'", "DE'", "HL'", "IFF"
+};
+
+static int tr_fd = -1;			/* trace file */
+static int tr_z;			/* flag for compression */
+static BYTE *tr_buf[2];			/* the two record buffers */
+static long tr_len[2];			/* bytes in the buffers */
+static unsigned long long tr_binsn[2];	/* first instruction in buffer */
+static unsigned long long tr_bts[2];	/* T-states before buffer */
+static int tr_full[2];			/* buffer handed to the writer */
+static int tr_cur;			/* buffer filled by the CPU */
+static int tr_quit;			/* writer thread should exit */
+static int tr_err;			/* no memory for the index, stopped */
+static unsigned long long tr_insn;	/* no. of traced instructions */
+static unsigned long long tr_ts;	/* T-states of traced instructions */
+static WORD tr_prev[TR_NREG];		/* registers of last TR_REGS */
+static int tr_key;			/* next TR_REGS with all registers */
+static long tr_ilen = -1;		/* buffer length before last insn */
+static int tr_ikey;			/* tr_key before last insn */
+static int tr_its;			/* T-states of last insn */
+static int tr_wr;			/* instruction writes memory */
+static WORD tr_wadr;			/* and where */
+static long tr_wlen;
+static struct tridx *tr_idx;		/* index of the written blocks */
+static unsigned long long tr_nidx, tr_maxidx;
+static unsigned long long tr_off;	/* file offset of the next block */
+static pthread_t tr_thread;
+static pthread_mutex_t tr_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tr_cv = PTHREAD_COND_INITIALIZER;
+
+/*
+ *	Little endian numbers
+ */
+static BYTE *put16(BYTE *p, unsigned v)
+{
+	*p++ = v;
+	*p++ = v >> 8;
+	return(p);
+}
+
+static BYTE *put32(BYTE *p, unsigned long v)
+{
+	p = put16(p, v & 0xffff);
+	return(put16(p, (v >> 16) & 0xffff));
+}
+
+static BYTE *put64(BYTE *p, unsigned long long v)
+{
+	p = put32(p, v & 0xffffffffUL);
+	return(put32(p, (v >> 32) & 0xffffffffUL));
+}
+
+static BYTE *putv(BYTE *p, unsigned long v)
+{
+	while (v >= 0x80) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return(p);
+}
+
+static unsigned long get32(BYTE *p)
+{
+	return(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long) p[3] << 24));
+}
+
+static unsigned long long get64(BYTE *p)
+{
+	return(get32(p) | ((unsigned long long) get32(p + 4) << 32));
+}
+
+static BYTE *getv(BYTE *p, unsigned long *v)
+{
+	register int s = 0;
+
+	*v = 0;
+	do {
+		*v |= (unsigned long) (*p & 0x7f) << s;
+		s += 7;
+	} while (*p++ & 0x80);
+	return(p);
+}
+
+/*
+ *	Compress n bytes from src into dst in LZ4 block format,
+ *	dst must have room for n + n / 255 + 16 bytes.
+ *	Returns the compressed size.
+ */
+static long lz_pack(BYTE *src, long n, BYTE *dst)
+{
+	static long htab[1 << LZ_HBITS];
+	register long ip = 0, op = 0, anchor = 0, ref, l;
+	long lit, mlen, tok;
+	unsigned long v;
+
+	memset(htab, 0xff, sizeof(htab));
+	while (ip < n - 12) {
+		v = get32(src + ip);
+		l = ((v * 2654435761UL) & 0xffffffffUL) >> (32 - LZ_HBITS);
+		ref = htab[l];
+		htab[l] = ip;
+		if (ref < 0 || ip - ref > 65535 || get32(src + ref) != v) {
+			ip++;
+			continue;
+		}
+		mlen = 4;
+		while (ip + mlen < n - 5 && src[ref + mlen] == src[ip + mlen])
+			mlen++;
+		lit = ip - anchor;
+		tok = op++;
+		dst[tok] = ((lit >= 15) ? 15 : lit) << 4;
+		if (lit >= 15) {
+			for (l = lit - 15; l >= 255; l -= 255)
+				dst[op++] = 255;
+			dst[op++] = l;
+		}
+		memcpy(dst + op, src + anchor, lit);
+		op += lit;
+		op = put16(dst + op, ip - ref) - dst;
+		dst[tok] |= (mlen - 4 >= 15) ? 15 : mlen - 4;
+		if (mlen - 4 >= 15) {
+			for (l = mlen - 4 - 15; l >= 255; l -= 255)
+				dst[op++] = 255;
+			dst[op++] = l;
+		}
+		ip += mlen;
+		anchor = ip;
+	}
+	lit = n - anchor;			/* last literals */
+	dst[op++] = ((lit >= 15) ? 15 : lit) << 4;
+	if (lit >= 15) {
+		for (l = lit - 15; l >= 255; l -= 255)
+			dst[op++] = 255;
+		dst[op++] = l;
+	}
+	memcpy(dst + op, src + anchor, lit);
+	return(op + lit);
+}
+
+/*
+ *	Decompress a LZ4 block
+ *
+ *	Output: size of the data, -1 if corrupted
+ */
+static long lz_unpack(BYTE *src, long n, BYTE *dst, long max)
+{
+	register long ip = 0, op = 0;
+	long lit, mlen, off;
+	int tok, b;
+
+	while (ip < n) {
+		tok = src[ip++];
+		lit = tok >> 4;
+		if (lit == 15)
+			do {
+				b = src[ip++];
+				lit += b;
+			} while (b == 255 && ip < n);
+		if (op + lit > max || ip + lit > n)
+			return(-1);
+		memcpy(dst + op, src + ip, lit);
+		ip += lit;
+		op += lit;
+		if (ip >= n)
+			break;
+		off = src[ip] | (src[ip + 1] << 8);
+		ip += 2;
+		mlen = tok & 15;
+		if (mlen == 15)
+			do {
+				b = src[ip++];
+				mlen += b;
+			} while (b == 255 && ip < n);
+		mlen += 4;
+		if (off == 0 || off > op || op + mlen > max)
+			return(-1);
+		while (mlen--) {
+			dst[op] = dst[op - off];
+			op++;
+		}
+	}
+	return(op);
+}
+
+/*
+ *	Write buffer b as one block into the trace file,
+ *	runs in the writer thread
+ */
+static void tr_wblock(int b, BYTE *z)
+{
+	BYTE hdr[24];
+	struct iovec iov[2];
+	struct tridx *idx;
+	long n = tr_len[b], stored = n;
+
+	if (tr_err)
+		return;
+	if (tr_nidx == tr_maxidx) {
+		if ((idx = realloc(tr_idx, (tr_maxidx ? tr_maxidx * 2 : 1024) *
+				   sizeof(struct tridx))) == NULL) {
+			puts("not enough memory for the trace index, trace stopped");
+			tr_err = 1;
+			tr_flag = 0;
+			return;
+		}
+		tr_idx = idx;
+		tr_maxidx = tr_maxidx ? tr_maxidx * 2 : 1024;
+	}
+	iov[1].iov_base = tr_buf[b];
+	if (tr_z && z != NULL) {	/* else uncompressed */
+		stored = lz_pack(tr_buf[b], n, z);
+		if (stored < n)
+			iov[1].iov_base = z;
+		else
+			stored = n;
+	}
+	iov[1].iov_len = stored;
+	put64(put64(put32(put32(hdr, n), stored), tr_binsn[b]), tr_bts[b]);
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(hdr);
+	if (writev(tr_fd, iov, 2) != sizeof(hdr) + stored)
+		perror("trace");
+	tr_idx[tr_nidx].ti_off = tr_off;
+	tr_idx[tr_nidx].ti_insn = tr_binsn[b];
+	tr_idx[tr_nidx].ti_ts = tr_bts[b];
+	tr_idx[tr_nidx].ti_raw = n;
+	tr_idx[tr_nidx].ti_stored = stored;
+	tr_nidx++;
+	tr_off += sizeof(hdr) + stored;
+}
+
+/*
+ *	The writer thread, writes the buffers in turn as they
+ *	are handed over by the CPU emulation
+ */
+static void *tr_writer(void *arg)
+{
+	register int b = 0;
+	BYTE *z = malloc(TR_ZSIZE);	/* NULL writes uncompressed */
+
+	pthread_mutex_lock(&tr_mtx);
+	for (;;) {
+		while (!tr_full[b] && !tr_quit)
+			pthread_cond_wait(&tr_cv, &tr_mtx);
+		if (!tr_full[b])
+			break;
+		pthread_mutex_unlock(&tr_mtx);
+		tr_wblock(b, z);
+		pthread_mutex_lock(&tr_mtx);
+		tr_full[b] = 0;
+		pthread_cond_broadcast(&tr_cv);
+		b ^= 1;
+	}
+	pthread_mutex_unlock(&tr_mtx);
+	free(z);
+	return(NULL);
+}
+
+/*
+ *	Hand the current buffer to the writer thread and
+ *	continue with the other one
+ */
+static void tr_flush(void)
+{
+	register int b = tr_cur;
+
+	if (tr_len[b] == 0)
+		return;
+	pthread_mutex_lock(&tr_mtx);
+	tr_full[b] = 1;
+	pthread_cond_broadcast(&tr_cv);
+	b ^= 1;
+	while (tr_full[b])
+		pthread_cond_wait(&tr_cv, &tr_mtx);
+	pthread_mutex_unlock(&tr_mtx);
+	tr_cur = b;
+	tr_len[b] = 0;
+	tr_binsn[b] = tr_insn;
+	tr_bts[b] = tr_ts;
+	tr_key = 1;
+	tr_ilen = -1;
+}
+
+/*
+ *	Open a trace file and start tracing, z = 1 compresses
+ *	the blocks
+ *
+ *	Output: 0 ok, 1 error
+ */
+int trace_open(char *fn, int z)
+{
+	BYTE hdr[16];
+
+	if (tr_fd != -1)
+		trace_close();
+	if ((tr_fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	if (tr_buf[0] == NULL) {
+		tr_buf[0] = malloc(TR_BUFSIZE);
+		tr_buf[1] = malloc(TR_BUFSIZE);
+		if (tr_buf[0] == NULL || tr_buf[1] == NULL) {
+			puts("not enough memory for trace buffers");
+			close(tr_fd);
+			tr_fd = -1;
+			return(1);
+		}
+	}
+	tr_z = z;
+	memcpy(hdr, "Z80TRACE", 8);
+	put32(put16(put16(hdr + 8, TR_VERSION), z ? TR_FZ : 0), 0);
+	write(tr_fd, hdr, sizeof(hdr));
+	tr_off = sizeof(hdr);
+	tr_nidx = 0;
+	tr_insn = tr_ts = 0;
+	tr_cur = 0;
+	tr_len[0] = tr_len[1] = 0;
+	tr_full[0] = tr_full[1] = 0;
+	tr_binsn[0] = tr_bts[0] = 0;
+	tr_key = 1;
+	tr_ilen = -1;
+	tr_wr = 0;
+	tr_quit = 0;
+	tr_err = 0;
+	if (pthread_create(&tr_thread, NULL, tr_writer, NULL)) {
+		puts("can't create trace writer");
+		close(tr_fd);
+		tr_fd = -1;
+		return(1);
+	}
+	tr_flag = 1;
+	return(0);
+}
+
+/*
+ *	Stop tracing, write the outstanding records and the
+ *	index and close the trace file
+ */
+void trace_close(void)
+{
+	BYTE e[32];
+	unsigned long long i;
+
+	if (tr_fd == -1)
+		return;
+	tr_flag = 0;
+	tr_flush();
+	pthread_mutex_lock(&tr_mtx);
+	tr_quit = 1;
+	pthread_cond_broadcast(&tr_cv);
+	pthread_mutex_unlock(&tr_mtx);
+	pthread_join(tr_thread, NULL);
+	for (i = 0; i < tr_nidx; i++) {
+		put32(put32(put64(put64(put64(e, tr_idx[i].ti_off),
+			tr_idx[i].ti_insn), tr_idx[i].ti_ts),
+			tr_idx[i].ti_raw), tr_idx[i].ti_stored);
+		write(tr_fd, e, 32);
+	}
+	put64(put64(e, tr_off), tr_nidx);
+	memcpy(e + 16, "Z80TIDX", 8);
+	write(tr_fd, e, 24);
+	close(tr_fd);
+	tr_fd = -1;
+	printf("Trace closed, %llu instructions in %llu blocks\n",
+	       tr_insn, tr_nidx);
+}
+
+/*
+ *	Show state of the trace
+ */
+void trace_stat(void)
+{
+	if (tr_fd == -1)
+		puts("Trace off");
+	else
+		printf("Trace on%s, %llu instructions\n",
+		       tr_z ? " (compressed)" : "", tr_insn);
+}
+
+/*
+ *	Called from the CPU emulation before the instruction
+ *	at PC is executed
+ */
+void trace_pre(void)
+{
+	register BYTE *p;
+	register int i, n;
+	register WORD pc = PC - ram;
+
+	if (tr_len[tr_cur] >= TR_BLKSIZE)
+		tr_flush();
+	tr_ilen = tr_len[tr_cur];
+	tr_ikey = tr_key;
+	p = tr_buf[tr_cur] + tr_len[tr_cur];
+	n = opsize(ram, pc);
+	*p++ = TR_INSN;
+	p = put16(p, pc);
+	*p++ = n;
+	for (i = 0; i < n; i++)
+		*p++ = ram[(WORD) (pc + i)];
+	tr_len[tr_cur] = p - tr_buf[tr_cur];
+	tr_wr = mem_wrspan(&tr_wadr, &tr_wlen);
+}
+
+/*
+ *	Add a record for a memory write
+ */
+static void tr_memw(WORD adr, long len)
+{
+	register BYTE *p = tr_buf[tr_cur] + tr_len[tr_cur];
+
+	*p++ = TR_MEMW;
+	p = put16(p, adr);
+	p = putv(p, len);
+	while (len--)
+		*p++ = ram[adr++];
+	tr_len[tr_cur] = p - tr_buf[tr_cur];
+}
+
+/*
+ *	Called from the CPU emulation after the instruction
+ *	was executed, t is the no. of T-states it took
+ */
+void trace_post(int t)
+{
+	register BYTE *p = tr_buf[tr_cur] + tr_len[tr_cur];
+	register int i, m = 0;
+	WORD r[TR_NREG];
+
+	r[0] = (A << 8) + F;
+	r[1] = (B << 8) + C;
+	r[2] = (D << 8) + E;
+	r[3] = (H << 8) + L;
+	r[4] = IX;
+	r[5] = IY;
+	r[6] = STACK - ram;
+	r[7] = (A_ << 8) + F_;
+	r[8] = (B_ << 8) + C_;
+	r[9] = (D_ << 8) + E_;
+	r[10] = (H_ << 8) + L_;
+	r[11] = (I << 8) + IFF;
+	for (i = 0; i < TR_NREG; i++)
+		if (tr_key || r[i] != tr_prev[i])
+			m |= 1 << i;
+	tr_key = 0;
+	*p++ = TR_REGS;
+	p = putv(p, t);
+	p = putv(p, m);
+	for (i = 0; i < TR_NREG; i++)
+		if (m & (1 << i)) {
+			p = put16(p, r[i]);
+			tr_prev[i] = r[i];
+		}
+	tr_len[tr_cur] = p - tr_buf[tr_cur];
+	if (tr_wr)
+		tr_memw(tr_wadr, tr_wlen);
+	tr_insn++;
+	tr_ts += t;
+	tr_its = t;
+}
+
+/*
+ *	Remove the records of the last instruction, used if a
+ *	software breakpoint was hit and the original op-code
+ *	is executed again. Only the last instruction can be removed.
+ */
+void trace_undo(void)
+{
+	if (tr_fd == -1 || tr_ilen == -1)
+		return;
+	tr_len[tr_cur] = tr_ilen;
+	tr_key = tr_ikey;
+	tr_insn--;
+	tr_ts -= tr_its;
+	tr_ilen = -1;
+}
+
+/*
+ *	Called from the I/O emulation for IN (out = 0)
+ *	and OUT (out = 1)
+ */
+void trace_io(int out, BYTE port, BYTE data)
+{
+	register BYTE *p = tr_buf[tr_cur] + tr_len[tr_cur];
+
+	if (tr_len[tr_cur] >= TR_BUFSIZE - 3)	/* INIR etc. */
+		return;
+	*p++ = out ? TR_OUT : TR_IN;
+	*p++ = port;
+	*p++ = data;
+	tr_len[tr_cur] = p - tr_buf[tr_cur];
+}
+
+/*
+ *	Called from the CPU emulation when an interrupt was
+ *	accepted, pc is the PC before the interrupt
+ */
+void trace_int(BYTE *pc)
+{
+	register BYTE *p = tr_buf[tr_cur] + tr_len[tr_cur];
+
+	*p++ = TR_INT;
+	p = put16(p, pc - ram);
+	p = put16(p, PC - ram);
+	tr_len[tr_cur] = p - tr_buf[tr_cur];
+	tr_memw(STACK - ram, 2);
+}
+
+/*
+ *	Print a trace file as text, one line for each instruction,
+ *	starting with instruction no. first
+ *
+ *	Output: 0 ok, 1 error
+ */
+int trace_dump(char *fn, unsigned long long first)
+{
+	FILE *fp;
+	BYTE h[32], *raw, *z, *p, *e;
+	unsigned long rlen, slen, v;
+	unsigned long long insn, ts, ioff, n, i;
+	int c, k, b;
+	char sym[LENCMD];
+
+	if ((fp = fopen(fn, "rb")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	if (fread(h, 16, 1, fp) != 1 || memcmp(h, "Z80TRACE", 8)) {
+		printf("%s is not a trace file\n", fn);
+		fclose(fp);
+		return(1);
+	}
+
+	/* find the block with the first instruction in the index */
+	ioff = 16;
+	if (fseek(fp, -24L, SEEK_END) == 0 && fread(h, 24, 1, fp) == 1 &&
+	    memcmp(h + 16, "Z80TIDX", 8) == 0) {
+		n = get64(h + 8);
+		fseek(fp, get64(h), SEEK_SET);
+		for (i = 0; i < n && fread(h, 32, 1, fp) == 1; i++)
+			if (get64(h + 8) <= first)
+				ioff = get64(h);
+	} else
+		puts("trace file has no index, not closed?");
+	fseek(fp, ioff, SEEK_SET);
+
+	raw = malloc(TR_BUFSIZE);
+	z = malloc(TR_ZSIZE);
+	while (fread(h, 24, 1, fp) == 1) {
+		rlen = get32(h);
+		slen = get32(h + 4);
+		insn = get64(h + 8);
+		ts = get64(h + 16);
+		if (rlen > TR_BUFSIZE || slen > TR_ZSIZE)
+			break;
+		if (fread((slen == rlen) ? raw : z, slen, 1, fp) != 1)
+			break;
+		if (slen != rlen && lz_unpack(z, slen, raw, rlen) != rlen) {
+			puts("corrupted block in trace file");
+			break;
+		}
+		c = 0;				/* line printed */
+		for (p = raw, e = raw + rlen; p < e;) {
+			switch (*p++) {
+			case TR_INSN:
+				if (c)
+					putchar('\n');
+				c = insn >= first;
+				if (c) {
+					printf("%llu %llu %04x ", insn, ts,
+					       p[0] | (p[1] << 8));
+					for (k = 0; k < 4; k++)
+						printf(k < p[2] ? "%02x" : "  ",
+						       p[3 + k]);
+					if (*sym_str(p[0] | (p[1] << 8), 0xffff,
+						     sym, sizeof(sym)))
+						printf(" <%s>", sym);
+				}
+				p += 3 + p[2];
+				break;
+			case TR_IN:
+			case TR_OUT:
+				if (c)
+					printf(" %s(%02x)=%02x",
+					       (p[-1] == TR_IN) ? "in" : "out",
+					       p[0], p[1]);
+				p += 2;
+				break;
+			case TR_REGS:
+				p = getv(p, &v);
+				ts += v;
+				insn++;
+				p = getv(p, &v);
+				for (k = 0; k < TR_NREG; k++)
+					if (v & (1 << k)) {
+						if (c)
+							printf(" %s=%04x",
+							       tr_regnam[k],
+							       p[0] | (p[1] << 8));
+						p += 2;
+					}
+				break;
+			case TR_MEMW:
+				b = p[0] | (p[1] << 8);
+				p = getv(p + 2, &v);
+				if (c) {
+					printf(" [%04x]=", b);
+					for (k = 0; k < v && k < 8; k++)
+						printf("%02x", p[k]);
+					if (v > 8)
+						printf("..(%lu)", v);
+				}
+				p += v;
+				break;
+			case TR_INT:
+				if (insn >= first) {
+					if (c)
+						putchar('\n');
+					printf("%llu %llu INT %04x -> %04x",
+					       insn, ts, p[0] | (p[1] << 8),
+					       p[2] | (p[3] << 8));
+					c = 1;
+				}
+				p += 4;
+				break;
+			default:
+				puts("\ncorrupted record in trace file");
+				p = e;
+				break;
+			}
+		}
+		if (c)
+			putchar('\n');
+	}
+	free(raw);
+	free(z);
+	fclose(fp);
+	return(0);
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	This module selects the variant of the CPU emulation, see
+ *	variant.h. Every start of the CPU takes the variant with the
+ *	least options which has all options in use, so a program runs
+ *	in the fast variant until e.g. the history or a trace is
+ *	switched on, and back in the fast variant when it's off again.
+ *	With the option --core a variant can be fixed, options in use
+ *	which it hasn't got are not done then.
+ */
+
+#include <string.h>
+#include "config.h"
+#include "global.h"
+
+#define CO_FAST		0		/* index into co_tab */
+#define CO_TIMED	1
+#define CO_TRACED	2
+#define CO_DEBUG	3
+
+extern void cpu_fast(void), cpu_timed(void), cpu_traced(void);
+extern void cpu_debug(void);
+
+static struct core {
+	char *c_name;
+	void (*c_fun)(void);
+} co_tab[] = {
+	{ "fast", cpu_fast },
+	{ "timed", cpu_timed },
+	{ "traced", cpu_traced },
+	{ "debug", cpu_debug },
+	{ NULL, NULL }
+};
+
+static int co_fix = -1;			/* variant of --core, -1 auto */
+static char *co_why;			/* option which needs the variant */
+
+/*
+ *	The variant needed for the options in use
+ */
+static int co_auto(void)
+{
+#ifdef HISIZE
+	if (h_flag) {
+		co_why = "history";
+		return(CO_DEBUG);
+	}
+#endif
+#ifdef SNSIZE
+	if (snap_on() || sn_stop != ~0ULL || sn_tev != ~0ULL) {
+		co_why = "snapshots";
+		return(CO_DEBUG);
+	}
+#endif
+#ifdef WANT_TRACE
+	if (tr_flag) {
+		co_why = "trace";
+		return(CO_TRACED);
+	}
+#endif
+#ifdef WANT_PROF
+	if (p_flag || cg_flag) {
+		co_why = "profile";
+		return(CO_TRACED);
+	}
+#endif
+#ifdef WANT_COV
+	if (cov_flag) {
+		co_why = "coverage";
+		return(CO_TRACED);
+	}
+#endif
+#ifdef WANT_TIM
+	if (f_flag) {
+		co_why = "CPU speed";
+		return(CO_TIMED);
+	}
+	if (tc_flag || t_flag || t_start != ram + 65535 ||
+	    cpu_tstop != ~0ULL) {
+		co_why = "T-state count";
+		return(CO_TIMED);
+	}
+#endif
+	co_why = "no options";
+	return(CO_FAST);
+}
+
+/*
+ *	Run the CPU emulation with the selected variant
+ */
+void cpu(void)
+{
+	(*co_tab[(co_fix >= 0) ? co_fix : co_auto()].c_fun) ();
+}
+
+/*
+ *	Fix the variant, name is a variant or auto
+ *
+ *	Output: 0 ok, 1 unknown name
+ */
+int core_set(char *name)
+{
+	register int i;
+
+	if (strcmp(name, "auto") == 0) {
+		co_fix = -1;
+		return(0);
+	}
+	for (i = 0; co_tab[i].c_name != NULL; i++)
+		if (strcmp(name, co_tab[i].c_name) == 0) {
+			co_fix = i;
+			return(0);
+		}
+	return(1);
+}
+
+/*
+ *	Name of the variant which runs at the next start,
+ *	with auto if it isn't fixed
+ */
+char *core_name(int *fixed)
+{
+	*fixed = (co_fix >= 0);
+	return(co_tab[(co_fix >= 0) ? co_fix : co_auto()].c_name);
+}
+
+/*
+ *	The option in use which selects the variant without --core
+ */
+char *core_why(void)
+{
+	co_auto();
+	return(co_why);
+}
@@ -0,0 +1,57 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	Variants of the CPU emulation. The modules instr_*.c are
+ *	compiled once for every variant, the Makefile defines
+ *	CORE_FAST, CORE_TIMED or CORE_TRACED, without one of them
+ *	it's the debug variant with all options of config.h.
+ *	A variant switches off the options of config.h it hasn't got
+ *	and gives its global functions own names, cpu() in variant.c
+ *	calls the variant which has all options in use.
+ *
+ *	fast	no counting of instructions and T-states, no hooks
+ *	timed	WANT_TIM
+ *	traced	WANT_TIM, WANT_TRACE, WANT_PROF, WANT_COV
+ *	debug	all, also HISIZE and SNSIZE
+ *
+ *	The options of the simulated machine (WANT_INT, WANT_SPC,
+ *	WANT_PCC, WANT_COUNTERS, BUS_8080, ...) are the same in all.
+ *	This file must be included after config.h and global.h.
+ */
+
+#if defined(CORE_FAST) || defined(CORE_TIMED) || defined(CORE_TRACED)
+#undef HISIZE
+#undef SNSIZE
+#endif
+#if defined(CORE_FAST) || defined(CORE_TIMED)
+#undef WANT_TRACE
+#undef WANT_PROF
+#undef WANT_COV
+#endif
+#ifdef CORE_FAST
+#undef WANT_TIM
+#endif
+
+#if defined(CORE_FAST)
+#define	CORE(name)	name##_fast
+#elif defined(CORE_TIMED)
+#define	CORE(name)	name##_timed
+#elif defined(CORE_TRACED)
+#define	CORE(name)	name##_traced
+#else
+#define	CORE(name)	name##_debug
+#endif
+
+#define	cpu		CORE(cpu)
+#define	op_cb_handel	CORE(op_cb_handel)
+#define	op_dd_handel	CORE(op_dd_handel)
+#define	op_ed_handel	CORE(op_ed_handel)
+#define	op_fd_handel	CORE(op_fd_handel)
+#define	op_ddcb_handel	CORE(op_ddcb_handel)
+#define	op_fdcb_handel	CORE(op_fdcb_handel)
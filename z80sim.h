@@ -0,0 +1,121 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2008 by Udo Munk
+ * 2014 fork by Jack Carrozzo <jack@crepinc.com>
+ *
+ */
+
+/*
+ *	Interface of libz80sim, the simulator as library for programs
+ *	which embed the Z80 in their own simulation, see api.c.
+ *	Only this file is needed to use the library, it can be
+ *	included from C and C++. Functions and structures are only
+ *	added to it, so programs for an older Z80SIM_API still work.
+ *
+ *	There is one Z80 per process, the simulator keeps the CPU
+ *	in global variables, z80_create() fails for a second one.
+ */
+
+#ifndef Z80SIM_H
+#define Z80SIM_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define Z80SIM_API	1		/* version of this interface */
+
+typedef struct z80sim z80sim;
+
+/*
+ *	Registers, af is A in the high and the flags in the low byte
+ */
+struct z80_regs {
+	unsigned short af, bc, de, hl;
+	unsigned short af_, bc_, de_, hl_;
+	unsigned short ix, iy, sp, pc;
+	unsigned char i, r, iff, im;	/* iff bit 0 IFF1, bit 1 IFF2 */
+};
+
+/*
+ *	Flags of z80_create()
+ */
+#define Z80_BOARD	1	/* PIO, CTC and DART of the board at ports
+				   00H-0BH, the DART with UDP sockets */
+
+/*
+ *	Kinds of memory for z80_map(), Z80_HOOK can be or-ed with
+ *	Z80_RAM or Z80_ROM, e.g. for bank switching by writes to ROM
+ */
+#define Z80_RAM		0
+#define Z80_ROM		1	/* writes are ignored */
+#define Z80_HOOK	2	/* writes call the write hook */
+
+/*
+ *	Results of z80_run() and z80_step()
+ */
+#define Z80_OK		0	/* T-states done or z80_stop() */
+#define Z80_HALT	1	/* HALT with interrupts disabled */
+#define Z80_IOTRAP	2	/* I/O to unused port with trap */
+#define Z80_IOERROR	3	/* fatal I/O error */
+#define Z80_OPTRAP1	4	/* illegal 1 byte op-code */
+#define Z80_OPTRAP2	5	/* illegal 2 byte op-code */
+#define Z80_OPTRAP4	6	/* illegal 4 byte op-code */
+
+/*
+ *	Port callbacks: in returns the byte read, out returns 0, both
+ *	return -1 for ports they don't handle, these go to the board
+ *	with Z80_BOARD, else reads are FFH and writes are ignored.
+ */
+typedef int (*z80_in_fn)(void *ctx, unsigned char port);
+typedef int (*z80_out_fn)(void *ctx, unsigned char port, unsigned char data);
+
+/*
+ *	Write callback for memory of kind Z80_HOOK, called after the
+ *	instruction with every byte it wrote. Reads come from the
+ *	memory of z80_memory(), a device mapped into the memory keeps
+ *	the bytes there up to date.
+ */
+typedef void (*z80_write_fn)(void *ctx, unsigned short adr, unsigned char data);
+
+/* machine */
+extern z80sim *z80_create(int flags);
+extern void z80_destroy(z80sim *m);
+extern void z80_reset(z80sim *m);
+
+/* memory */
+extern unsigned char *z80_memory(z80sim *m);
+extern int z80_map(z80sim *m, unsigned short adr, unsigned long len, int kind);
+extern int z80_load(z80sim *m, const char *fn);
+
+/* callbacks, NULL switches them off */
+extern void z80_io(z80sim *m, z80_in_fn in, z80_out_fn out, void *ctx);
+extern void z80_write(z80sim *m, z80_write_fn wr, void *ctx);
+
+/* execution */
+extern int z80_run(z80sim *m, unsigned long long tstates);
+extern int z80_step(z80sim *m);
+extern void z80_stop(z80sim *m);
+extern unsigned long long z80_tstates(z80sim *m);
+extern unsigned long long z80_steps(z80sim *m);
+
+/* interrupts, data is the byte on the bus, the vector for IM 2 */
+extern void z80_int(z80sim *m, unsigned char data);
+extern void z80_nmi(z80sim *m);
+
+/* registers */
+extern void z80_getregs(z80sim *m, struct z80_regs *r);
+extern void z80_setregs(z80sim *m, const struct z80_regs *r);
+
+/* snapshots in the format of core files */
+extern size_t z80_save(z80sim *m, void *buf);
+extern int z80_restore(z80sim *m, const void *buf, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif